@@ -0,0 +1,504 @@
+#include <algorithm>
+#include <chrono>
+#include <gui/gui.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "channels.hpp"
+#include "decode/decoder.hpp"
+#include "memory.hpp"
+#include "threadpool.hpp"
+#include "utils.hpp"
+
+#define CHANNEL_SAMPLERATE 48000    /* Decoder input, same as the main channel */
+#define SNAP_INTERVAL 1000
+
+/* ChannelSet::Tap {{{ */
+void
+ChannelSet::Tap::init(dsp::stream<dsp::complex_t> *in, ChannelSet *set, Channel *channel)
+{
+	m_in = in;
+	m_set = set;
+	m_channel = channel;
+
+	dsp::block::registerInput(m_in);
+	dsp::block::_block_init = true;
+}
+
+void
+ChannelSet::Tap::deinit()
+{
+	dsp::block::stop();
+	dsp::block::unregisterInput(m_in);
+	dsp::block::_block_init = false;
+}
+
+int
+ChannelSet::Tap::run()
+{
+	int count, offset, len;
+	Chunk *chunk;
+
+	if ((count = m_in->read()) < 0) return -1;
+
+	for (offset=0; offset<count; offset+=len) {
+		len = std::min(count - offset, CHANNEL_CHUNK);
+		if (!(chunk = m_channel->queue.reserve())) {
+			m_channel->dropped++;
+			continue;
+		}
+		chunk->count = len;
+		memcpy(chunk->samples, m_in->readBuf + offset, len * sizeof(dsp::complex_t));
+		m_channel->queue.commit();
+	}
+
+	m_in->flush();
+
+	/* Only wake the workers up if none is bound to look at this channel already */
+	if (count > 0 && !m_channel->signaled.exchange(true)) m_set->schedule(m_channel);
+	return count;
+}
+/* }}} */
+
+/* ChannelSet {{{ */
+ChannelSet::ChannelSet(const std::string &name, void (*handler)(const SondeFullData *data, double frequency, void *ctx), void *ctx)
+{
+	m_name = name;
+	m_handler = handler;
+	m_ctx = ctx;
+	m_running = false;
+	m_stationLog = false;
+	m_center = 0;
+	m_loadMark = 0;
+	m_workers = 0;
+	m_bytes = sizeof(*this);
+}
+
+ChannelSet::~ChannelSet()
+{
+	stop();
+
+	/* Queued drain tasks point to this set, wait for all of them to bail out */
+	{
+		std::unique_lock<std::mutex> lck(m_mtx);
+		m_cv.wait(lck, [this]{ return m_workers == 0; });
+	}
+	for (Channel *channel : m_channels) destroy(channel);
+}
+
+int
+ChannelSet::add(const Config &config)
+{
+	Channel *channel;
+
+	if (m_channels.size() >= CHANNEL_MAX || frequencyInUse(config.frequency, -1)) return -1;
+
+	channel = create(config);
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_channels.push_back(channel);
+	}
+	if (m_running) open(channel);
+	account();
+	return m_channels.size() - 1;
+}
+
+void
+ChannelSet::remove(int index)
+{
+	Channel *channel = m_channels[index];
+
+	close(channel);
+	{
+		std::unique_lock<std::mutex> lck(m_mtx);
+		m_cv.wait(lck, [channel]{ return !channel->busy; });
+		m_channels.erase(m_channels.begin() + index);
+	}
+	destroy(channel);
+	account();
+}
+
+bool
+ChannelSet::set(int index, const Config &config)
+{
+	Channel *channel = m_channels[index];
+	Channel *replacement;
+
+	if (config.frequency == channel->config.frequency && config.type == channel->config.type) {
+		std::lock_guard<std::mutex> lck(m_mtx);
+		channel->config.priority = config.priority;
+		return true;
+	}
+	if (frequencyInUse(config.frequency, index)) return false;
+
+	/* Different VFO sample rate and decoders: start over */
+	replacement = create(config);
+	close(channel);
+	{
+		std::unique_lock<std::mutex> lck(m_mtx);
+		m_cv.wait(lck, [channel]{ return !channel->busy; });
+		m_channels[index] = replacement;
+	}
+	destroy(channel);
+	if (m_running) open(replacement);
+	account();
+	return true;
+}
+
+void
+ChannelSet::start()
+{
+	if (m_running) return;
+	m_running = true;
+	for (Channel *channel : m_channels) open(channel);
+	account();
+}
+
+void
+ChannelSet::stop()
+{
+	if (!m_running) return;
+	m_running = false;
+	for (Channel *channel : m_channels) close(channel);
+	account();
+}
+
+void
+ChannelSet::setStationLog(bool enabled)
+{
+	m_stationLog = enabled;
+	for (Channel *channel : m_channels) StationLog::shared().setActive(channel->source, enabled);
+}
+
+/* The vector of channels is only modified by the GUI thread, which can walk it without locking */
+void
+ChannelSet::update()
+{
+	const double center = gui::waterfall.getCenterFrequency();
+	const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	const bool measure = now - m_loadMark >= 1;
+	std::vector<int> types;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		for (Channel *channel : m_channels) {
+			types.push_back(channel->type);
+			if (measure) {
+				channel->load = m_loadMark ? (channel->cpuSeconds - channel->cpuMark) / (now - m_loadMark) : 0;
+				channel->cpuMark = channel->cpuSeconds;
+			}
+		}
+	}
+	if (measure) m_loadMark = now;
+
+	for (size_t i=0; i<m_channels.size(); i++) {
+		Channel *channel = m_channels[i];
+
+		if (!channel->vfo) continue;
+		if (center != m_center) channel->vfo->setOffset(channel->config.frequency - center);
+
+		/* Auto channels are opened as wide as the widest type, narrow them down
+		 * once locked, and widen them back when they search again */
+		if (types[i] != CHANNEL_AUTO && channel->appliedBandwidth != sondeTypes[types[i]].bandwidth) {
+			channel->appliedBandwidth = sondeTypes[types[i]].bandwidth;
+			channel->vfo->setBandwidth(channel->appliedBandwidth);
+		} else if (types[i] == CHANNEL_AUTO && channel->appliedBandwidth) {
+			channel->appliedBandwidth = 0;
+			channel->vfo->setBandwidth(channel->samplerate);
+		}
+	}
+	m_center = center;
+}
+
+int
+ChannelSet::size() const
+{
+	return m_channels.size();
+}
+
+ChannelSet::Config
+ChannelSet::config(int index) const
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_channels[index]->config;
+}
+
+ChannelSet::Status
+ChannelSet::status(int index) const
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const Channel *channel = m_channels[index];
+	Status status;
+
+	status.config = channel->config;
+	status.type = channel->type;
+	status.last = channel->last;
+	status.lastFrame = channel->lastFrame;
+	status.load = channel->load;
+	status.chunks = channel->chunks;
+	status.dropped = channel->dropped;
+	return status;
+}
+/* }}} */
+
+/* Private methods {{{ */
+ChannelSet::Channel*
+ChannelSet::create(const Config &config)
+{
+	Channel *channel = new Channel();
+	char vfoName[64];
+
+	channel->config = config;
+	channel->vfo = NULL;
+	channel->busy = false;
+	channel->type = config.type;
+	channel->lastFrame = 0;
+	channel->cpuSeconds = channel->cpuMark = channel->load = 0;
+	channel->appliedBandwidth = 0;
+	channel->chunks = 0;
+	channel->dropped = 0;
+	channel->signaled = false;
+	channel->lastDecoded = 0;
+
+	snprintf(vfoName, sizeof(vfoName), " %.3fMHz", config.frequency / 1e6);
+	channel->vfoName = m_name + vfoName;
+
+	/* Auto channels run every decoder on a VFO wide enough for all of them */
+	if (config.type == CHANNEL_AUTO) {
+		channel->samplerate = 0;
+		for (const SondeType &type : sondeTypes) {
+			channel->slots.push_back({&type, type.init(CHANNEL_SAMPLERATE), SondeFullData()});
+			channel->samplerate = std::max(channel->samplerate, type.bandwidth);
+		}
+	} else {
+		const SondeType &type = sondeTypes[config.type];
+		channel->slots.push_back({&type, type.init(CHANNEL_SAMPLERATE), SondeFullData()});
+		channel->samplerate = type.bandwidth;
+	}
+
+	channel->demod.init(NULL, channel->samplerate, channel->samplerate / 2.0f, false, false);
+	channel->resampler.init(NULL, channel->samplerate, CHANNEL_SAMPLERATE);
+	channel->audio.resize(CHANNEL_CHUNK);
+	channel->resampled.resize(CHANNEL_CHUNK * ceil(CHANNEL_SAMPLERATE / channel->samplerate) + 1);
+
+	channel->source = StationLog::shared().addSource(m_name.c_str());
+	StationLog::shared().setActive(channel->source, m_stationLog);
+	return channel;
+}
+
+/* The channel must be closed and not busy */
+void
+ChannelSet::destroy(Channel *channel)
+{
+	for (Slot &slot : channel->slots) slot.type->deinit(slot.decoder);
+	StationLog::shared().removeSource(channel->source);
+	delete channel;
+}
+
+void
+ChannelSet::open(Channel *channel)
+{
+	float minBandwidth = channel->samplerate;
+
+	if (channel->vfo) return;
+
+	if (channel->config.type == CHANNEL_AUTO) {
+		for (const SondeType &type : sondeTypes) minBandwidth = std::min(minBandwidth, type.bandwidth);
+	}
+
+	m_center = gui::waterfall.getCenterFrequency();
+	channel->vfo = sigpath::vfoManager.createVFO(channel->vfoName, ImGui::WaterfallVFO::REF_CENTER,
+	                                             channel->config.frequency - m_center, channel->samplerate, channel->samplerate,
+	                                             minBandwidth, channel->samplerate, channel->config.type != CHANNEL_AUTO);
+	channel->vfo->setSnapInterval(SNAP_INTERVAL);
+	channel->appliedBandwidth = channel->config.type == CHANNEL_AUTO ? 0 : channel->samplerate;
+
+	channel->tap.init(channel->vfo->output, this, channel);
+	channel->tap.start();
+}
+
+void
+ChannelSet::close(Channel *channel)
+{
+	if (!channel->vfo) return;
+
+	channel->tap.deinit();
+	sigpath::vfoManager.deleteVFO(channel->vfo);
+	channel->vfo = NULL;
+}
+
+/* GUI thread only, like the VFOs */
+void
+ChannelSet::account()
+{
+	size_t bytes = sizeof(*this);
+
+	for (const Channel *channel : m_channels) {
+		bytes += sizeof(Channel) + channel->queue.capacity() * sizeof(Chunk) + channel->source->memoryUsage();
+		bytes += (channel->audio.capacity() + channel->resampled.capacity()) * sizeof(float);
+		bytes += 2 * streamBytes<float>();      /* Output streams of the demodulator and resampler, allocated even if unused */
+		if (channel->vfo) bytes += streamBytes<dsp::complex_t>();
+	}
+	m_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+bool
+ChannelSet::frequencyInUse(double frequency, int except) const
+{
+	for (size_t i=0; i<m_channels.size(); i++) {
+		if ((int)i != except && fabs(m_channels[i]->config.frequency - frequency) < 1) return true;
+	}
+	return false;
+}
+
+/* Called by the taps when a channel gets samples while not signaled yet */
+void
+ChannelSet::schedule(Channel *channel)
+{
+	radiosonde::ThreadPool &pool = radiosonde::ThreadPool::shared();
+	std::lock_guard<std::mutex> lck(m_mtx);
+
+	/* More workers than channels would only find nothing to do; the running
+	 * ones clear the flags and look at every channel again before they stop */
+	if (m_workers >= std::min((int)m_channels.size(), pool.size())) return;
+	if (pool.submit([this]{ drain(); })) {
+		m_workers++;
+	} else if (m_workers == 0) {
+		/* Nobody will take the samples: let the next run of the tap try again */
+		channel->signaled = false;
+	}
+}
+
+/* Pool task: process channels, highest priority first, until none has samples queued */
+void
+ChannelSet::drain()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	for (;;) {
+		Channel *next = NULL;
+		double cpuStart;
+		uint64_t chunks;
+
+		/* Among channels of the same priority, the one lagging the most */
+		for (Channel *channel : m_channels) {
+			if (channel->busy || !channel->queue.size()) continue;
+			if (!next || channel->config.priority > next->config.priority
+			    || (channel->config.priority == next->config.priority && channel->queue.size() > next->queue.size())) {
+				next = channel;
+			}
+		}
+		if (!next) {
+			bool queued = false;
+
+			/* Clear the flags before a last look at the queues: samples
+			 * queued after it make their tap schedule a new worker, which
+			 * waits for this one to be gone. Busy channels are left to
+			 * their worker, which looks again before it stops */
+			for (Channel *channel : m_channels) {
+				if (channel->busy) continue;
+				channel->signaled.exchange(false);
+				queued |= channel->queue.size() > 0;
+			}
+			if (!queued) break;
+			continue;
+		}
+
+		next->busy = true;
+		lck.unlock();
+
+		/* Samples queued from now on either get processed by the loops below,
+		 * or signal the channel again */
+		next->signaled.exchange(false);
+
+		cpuStart = threadCpuSeconds();
+		chunks = 0;
+		for (size_t pending = next->queue.size(); pending > 0; pending--) {
+			const Chunk *chunk = next->queue.peek();
+			if (!chunk) break;
+			process(next, *chunk);
+			next->queue.consume();
+			chunks++;
+		}
+
+		lck.lock();
+		next->cpuSeconds += threadCpuSeconds() - cpuStart;
+		next->chunks += chunks;
+		next->busy = false;
+		m_cv.notify_all();
+	}
+
+	/* Decremented under the same lock as the check above: samples queued after
+	 * it see the worker gone, and schedule a new one */
+	m_workers--;
+	m_cv.notify_all();
+}
+
+/* Demodulate, resample and decode a chunk of a busy channel */
+void
+ChannelSet::process(Channel *channel, const Chunk &chunk)
+{
+	SondeData fragment;
+	int count, locked = -1;
+
+	count = channel->demod.process(chunk.count, chunk.samples, channel->audio.data());
+	count = channel->resampler.process(count, channel->audio.data(), channel->resampled.data());
+
+	for (size_t i=0; i<channel->slots.size(); i++) {
+		Slot &slot = channel->slots[i];
+
+		while (slot.type->decode(slot.decoder, &fragment, channel->resampled.data(), count) != PROCEED) {
+			if (!merge_fragment(&slot.data, &fragment)) continue;
+
+			/* Auto: the first decoder to get a serial number, so a valid frame, wins */
+			if (channel->slots.size() > 1 && locked != (int)i) {
+				if (!slot.data.serial || locked >= 0) continue;
+				locked = i;
+			}
+			deliver(channel, &slot.data);
+			channel->lastDecoded = time(NULL);
+		}
+	}
+
+	if (locked >= 0) {
+		for (size_t i=0; i<channel->slots.size(); i++) {
+			if ((int)i != locked) channel->slots[i].type->deinit(channel->slots[i].decoder);
+		}
+		channel->slots.erase(channel->slots.begin() + locked + 1, channel->slots.end());
+		channel->slots.erase(channel->slots.begin(), channel->slots.begin() + locked);
+
+		std::lock_guard<std::mutex> lck(m_mtx);
+		channel->type = channel->slots[0].type - sondeTypes;
+	} else if (channel->config.type == CHANNEL_AUTO && channel->slots.size() == 1
+	           && time(NULL) - channel->lastDecoded > CHANNEL_RELOCK_TIMEOUT) {
+		search(channel);
+	}
+}
+
+/* Locked auto channel that lost its sonde: back to running every decoder */
+void
+ChannelSet::search(Channel *channel)
+{
+	channel->slots[0].type->deinit(channel->slots[0].decoder);
+	channel->slots.clear();
+	for (const SondeType &type : sondeTypes) {
+		channel->slots.push_back({&type, type.init(CHANNEL_SAMPLERATE), SondeFullData()});
+	}
+
+	/* update() widens the VFO again */
+	std::lock_guard<std::mutex> lck(m_mtx);
+	channel->type = CHANNEL_AUTO;
+}
+
+void
+ChannelSet::deliver(Channel *channel, const SondeFullData *data)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		channel->last = *data;
+		channel->lastFrame = time(NULL);
+	}
+	channel->source->push(*data, channel->config.frequency);
+	m_handler(data, channel->config.frequency, m_ctx);
+}
+/* }}} */
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <dsp/block.h>
+#include <dsp/demod/fm.h>
+#include <dsp/multirate/polyphase_resampler.h>
+#include <mutex>
+#include <signal_path/signal_path.h>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "decode/common.hpp"
+#include "decode/sondetypes.hpp"
+#include "spsc.hpp"
+#include "stationlog.hpp"
+
+#define CHANNEL_AUTO -1             /* Type of a channel that runs every decoder until one locks */
+#define CHANNEL_RELOCK_TIMEOUT 30   /* Seconds without frames before a locked auto channel searches again */
+#define CHANNEL_MAX 16              /* Channels per module instance */
+#define CHANNEL_CHUNK 4096          /* I/Q samples per queued chunk */
+#define CHANNEL_QUEUE_SIZE 32       /* Chunks buffered per channel while the workers are busy */
+
+/**
+ * Set of fixed frequencies decoded at the same time by one module instance,
+ * each with its own sonde type or CHANNEL_AUTO.
+ *
+ * Every channel still needs a VFO to be channelized by SDR++, but the VFO
+ * thread only cuts its output into chunks and queues them. Demodulation,
+ * resampling and decoding run on ThreadPool::shared(): each worker takes the
+ * highest priority channel with queued chunks that no other worker is
+ * processing, so a channel is never processed concurrently, and when the
+ * workers cannot keep up the chunks of the lowest priority channels are the
+ * ones dropped. The CPU time spent on each channel is accounted for.
+ *
+ * Auto channels keep only the decoder that locked, on a VFO narrowed to its
+ * bandwidth, and go back to searching with every decoder on the full width
+ * once no frame was decoded for CHANNEL_RELOCK_TIMEOUT.
+ */
+class ChannelSet {
+public:
+	struct Config {
+		double frequency;           /* Hz */
+		int type;                   /* Index in sondeTypes[], or CHANNEL_AUTO */
+		int priority;               /* Higher is served first */
+	};
+	struct Status {
+		Config config;
+		int type;                   /* Decoder in use, CHANNEL_AUTO while searching */
+		SondeFullData last;
+		time_t lastFrame;           /* Reception time of the last frame, 0 if none */
+		double load;                /* Fraction of one core used over the last second */
+		uint64_t chunks;            /* Chunks processed */
+		uint64_t dropped;           /* Chunks lost because the workers were lagging */
+	};
+
+	/**
+	 * @param name name of the module instance, prefixed to the VFO names
+	 * @param handler called from a worker thread for each decoded frame. The
+	 *        frames of a channel are delivered in order and never concurrently,
+	 *        those of different channels can be
+	 * @param ctx context passed to the handler
+	 */
+	ChannelSet(const std::string &name, void (*handler)(const SondeFullData *data, double frequency, void *ctx), void *ctx);
+	~ChannelSet();
+	ChannelSet(const ChannelSet&) = delete;
+	ChannelSet &operator=(const ChannelSet&) = delete;
+
+	/**
+	 * Add a channel, started right away if the set is.
+	 *
+	 * @return index of the channel, -1 if the set is full or the frequency is
+	 *         already in use
+	 */
+	int add(const Config &config);
+	void remove(int index);
+
+	/**
+	 * Change the settings of a channel. A new frequency or type restarts it.
+	 *
+	 * @return false if the new frequency is already in use, true otherwise
+	 */
+	bool set(int index, const Config &config);
+
+	/**
+	 * Create the VFOs and start queueing samples, or delete them.
+	 */
+	void start();
+	void stop();
+
+	/**
+	 * Log the frames of every channel into StationLog::shared().
+	 */
+	void setStationLog(bool enabled);
+
+	/**
+	 * Follow the center frequency of the waterfall and apply the bandwidth of
+	 * the type auto channels locked to. GUI thread only.
+	 */
+	void update();
+
+	int size() const;
+	Config config(int index) const;
+	Status status(int index) const;
+
+	/**
+	 * Bytes held by the channels: VFO and DSP streams, queues, buffers. The
+	 * decoder states are opaque and not included. Thread-safe.
+	 */
+	size_t memoryUsage() const { return m_bytes.load(std::memory_order_relaxed); }
+
+private:
+	struct Chunk {
+		int count;
+		dsp::complex_t samples[CHANNEL_CHUNK];
+	};
+	struct Slot {
+		const SondeType *type;
+		void *decoder;
+		SondeFullData data;
+	};
+	struct Channel;
+
+	/* Runs on the VFO thread: copies the samples straight into the channel queue */
+	class Tap : public dsp::block {
+	public:
+		void init(dsp::stream<dsp::complex_t> *in, ChannelSet *set, Channel *channel);
+		void deinit();
+		int run() override;
+
+	private:
+		dsp::stream<dsp::complex_t> *m_in;
+		ChannelSet *m_set;
+		Channel *m_channel;
+	};
+
+	struct Channel {
+		Config config;
+		std::string vfoName;
+		VFOManager::VFO *vfo;
+		Tap tap;
+		radiosonde::SpscQueue<Chunk> queue{CHANNEL_QUEUE_SIZE};
+		std::atomic<bool> signaled;     /* Samples were queued since a worker last took the channel */
+		StationLog::Source *source;
+
+		/* Worker currently processing the channel only */
+		dsp::demod::FM<float> demod;
+		dsp::multirate::RationalResampler<float> resampler;
+		std::vector<float> audio, resampled;
+		std::vector<Slot> slots;
+		float samplerate;
+		time_t lastDecoded;
+
+		/* Protected by the set mutex */
+		bool busy;
+		int type;
+		SondeFullData last;
+		time_t lastFrame;
+		double cpuSeconds, cpuMark, load;
+		double appliedBandwidth;    /* GUI thread only */
+		uint64_t chunks;
+		std::atomic<uint64_t> dropped;
+	};
+
+	Channel *create(const Config &config);
+	void destroy(Channel *channel);
+	void open(Channel *channel);
+	void close(Channel *channel);
+	bool frequencyInUse(double frequency, int except) const;
+	void schedule(Channel *channel);
+	void drain();
+	void process(Channel *channel, const Chunk &chunk);
+	void search(Channel *channel);
+	void deliver(Channel *channel, const SondeFullData *data);
+	void account();
+
+	std::string m_name;
+	void (*m_handler)(const SondeFullData *data, double frequency, void *ctx);
+	void *m_ctx;
+	bool m_running;
+	bool m_stationLog;
+
+	/* GUI thread only */
+	double m_center;
+	double m_loadMark;          /* Time of the last load computation, steady clock seconds */
+	std::atomic<size_t> m_bytes;    /* Updated by the GUI thread whenever channels change */
+
+	mutable std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::vector<Channel*> m_channels;
+	int m_workers;              /* Drain tasks submitted and not finished yet */
+};
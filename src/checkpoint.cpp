@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <time.h>
+#include "checkpoint.hpp"
+
+#define CHECKPOINT_MAGIC "RSCKPT01"
+
+static void
+copy_string(char *dst, const char *src, size_t len)
+{
+	strncpy(dst, src, len-1);
+	dst[len-1] = '\0';
+}
+
+/* FlightState {{{ */
+void
+FlightState::setData(const SondeFullData &data)
+{
+	copy_string(serial, serial_name(data.serial).c_str(), sizeof(serial));
+	seq = data.seq;
+	time = data.time;
+	burstkill = data.burstkill;
+	lat = data.lat;
+	lon = data.lon;
+	alt = data.alt;
+	spd = data.spd;
+	hdg = data.hdg;
+	climb = data.climb;
+	temp = data.temp;
+	rh = data.rh;
+	dewpt = data.dewpt;
+	pressure = data.pressure;
+	calibrated = data.calibrated;
+	calibPercent = data.calib_percent;
+	copy_string(auxData, data.auxData.c_str(), sizeof(auxData));
+}
+
+void
+FlightState::getData(SondeFullData *data) const
+{
+	data->serial = SerialTable::shared().intern(std::string(serial, strnlen(serial, sizeof(serial))).c_str());
+	data->seq = seq;
+	data->time = time;
+	data->burstkill = burstkill;
+	data->lat = lat;
+	data->lon = lon;
+	data->alt = alt;
+	data->spd = spd;
+	data->hdg = hdg;
+	data->climb = climb;
+	data->temp = temp;
+	data->rh = rh;
+	data->dewpt = dewpt;
+	data->pressure = pressure;
+	data->calibrated = calibrated;
+	data->calib_percent = calibPercent;
+	data->auxData = std::string(auxData, strnlen(auxData, sizeof(auxData)));
+}
+/* }}} */
+
+/* FlightCheckpoint {{{ */
+FlightCheckpoint::FlightCheckpoint()
+{
+	m_seq = 0;
+	m_running = false;
+	m_dirty = false;
+	m_predictor = NULL;
+	memset(&m_pending, 0, sizeof(m_pending));
+}
+
+FlightCheckpoint::~FlightCheckpoint()
+{
+	stop();
+}
+
+bool
+FlightCheckpoint::open(const char *fname)
+{
+	const size_t size = sizeof(Header) + 2 * sizeof(Slot);
+	Header *header;
+
+	/* Map the existing file read-write if it has the right layout, otherwise start over */
+	if (!m_file.open(fname, true) || m_file.size() != size
+	    || memcmp(((Header*)m_file.data())->magic, CHECKPOINT_MAGIC, sizeof(Header::magic))
+	    || ((Header*)m_file.data())->stateSize != sizeof(FlightState)) {
+		if (!m_file.create(fname, size)) return false;
+		header = (Header*)m_file.data();
+		memset(header, 0, size);
+		memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+		header->stateSize = sizeof(FlightState);
+		m_file.sync(false);
+	}
+
+	m_seq = std::max(slot(0)->seq, slot(1)->seq);
+	return true;
+}
+
+bool
+FlightCheckpoint::restore(FlightState *dst)
+{
+	Slot *best = NULL;
+
+	if (!m_file.isOpen()) return false;
+
+	for (int i=0; i<2; i++) {
+		Slot *s = slot(i);
+		if (!s->seq || s->checksum != checksum(s->state)) continue;
+		if (!best || s->seq > best->seq) best = s;
+	}
+	if (!best || ::time(NULL) - best->state.savedAt > CHECKPOINT_MAX_AGE) return false;
+
+	memcpy(dst, &best->state, sizeof(*dst));
+	return true;
+}
+
+void
+FlightCheckpoint::start(LandingPredictor *predictor)
+{
+	if (m_running || !m_file.isOpen()) return;
+	m_predictor = predictor;
+	m_running = true;
+	m_thread = std::thread(&FlightCheckpoint::worker, this);
+}
+
+void
+FlightCheckpoint::stop()
+{
+	if (!m_running) return;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+void
+FlightCheckpoint::update(const SondeFullData &data, const GPXWriter *gpx)
+{
+	std::unique_lock<std::mutex> lck(m_mtx, std::try_to_lock);
+	if (!lck.owns_lock()) return;
+
+	m_pending.setData(data);
+	if (gpx) {
+		gpx->getState(&m_pending.gpx);
+	} else {
+		memset(&m_pending.gpx, 0, sizeof(m_pending.gpx));
+	}
+	m_dirty = true;
+}
+
+void
+FlightCheckpoint::setGPXState(const GPXWriter *gpx)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (gpx) {
+		gpx->getState(&m_pending.gpx);
+	} else {
+		memset(&m_pending.gpx, 0, sizeof(m_pending.gpx));
+	}
+	m_dirty = true;
+}
+
+void
+FlightCheckpoint::setOutputs(const char *gpxPath, const char *ptuPath)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	copy_string(m_pending.gpxPath, gpxPath ? gpxPath : "", sizeof(m_pending.gpxPath));
+	copy_string(m_pending.ptuPath, ptuPath ? ptuPath : "", sizeof(m_pending.ptuPath));
+	m_dirty = true;
+}
+
+/* Private methods {{{ */
+uint32_t
+FlightCheckpoint::checksum(const FlightState &state)
+{
+	const uint8_t *ptr = (const uint8_t*)&state;
+	uint32_t hash = 2166136261u;
+
+	/* FNV-1a */
+	for (size_t i=0; i<sizeof(state); i++) {
+		hash = (hash ^ ptr[i]) * 16777619u;
+	}
+	return hash;
+}
+
+void
+FlightCheckpoint::worker()
+{
+	FlightState *state = new FlightState();
+	std::unique_lock<std::mutex> lck(m_mtx);
+	Slot *dst;
+
+	for (;;) {
+		m_cv.wait_for(lck, std::chrono::seconds(CHECKPOINT_INTERVAL), [this]{ return !m_running; });
+		const bool stopping = !m_running;
+
+		/* Save one last time when stopping, so that a clean restart loses nothing */
+		if (!m_dirty) {
+			if (stopping) break;
+			continue;
+		}
+
+		memcpy(state, &m_pending, sizeof(*state));
+		m_dirty = false;
+		lck.unlock();
+
+		state->savedAt = ::time(NULL);
+		if (m_predictor) m_predictor->getState(&state->predictor);
+
+		/* Overwrite the oldest slot; the sequence number goes last, so a torn
+		 * write is caught by the checksum and the other slot is used instead */
+		dst = slot(m_seq & 1);
+		dst->seq = 0;
+		memcpy(&dst->state, state, sizeof(dst->state));
+		dst->checksum = checksum(dst->state);
+		dst->seq = ++m_seq;
+		m_file.sync(!stopping);
+
+		lck.lock();
+		if (stopping) break;
+	}
+
+	delete state;
+}
+/* }}} */
+/* }}} */
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include "decode/common.hpp"
+#include "gpx.hpp"
+#include "mmap.hpp"
+#include "predictor.hpp"
+
+#define CHECKPOINT_INTERVAL 5       /* Seconds between two checkpoints */
+#define CHECKPOINT_MAX_AGE 3600     /* Checkpoints older than this are not resumed, seconds */
+
+/* Live state of the module, as plain data so that it can be mapped from disk as-is */
+struct FlightState {
+	int64_t savedAt;            /* Wall clock time of the checkpoint */
+
+	/* Last decoded frame */
+	char serial[32];
+	int32_t seq;
+	int64_t time;
+	int32_t burstkill;
+	float lat, lon, alt;
+	float spd, hdg, climb;
+	float temp, rh, dewpt, pressure;
+	uint8_t calibrated;
+	float calibPercent;
+	char auxData[256];
+
+	/* Outputs, paths are empty if disabled */
+	char gpxPath[2048];
+	char ptuPath[2048];
+	GPXWriter::State gpx;
+
+	LandingPredictor::State predictor;
+
+	void setData(const SondeFullData &data);
+	void getData(SondeFullData *data) const;
+};
+
+/**
+ * Periodic, asynchronous checkpoint of the flight state to a memory-mapped file.
+ * The file holds two slots written alternately, each with a sequence number and
+ * a checksum, so that a crash in the middle of a checkpoint always leaves the
+ * previous one intact. Restoring is a single copy out of the mapping.
+ */
+class FlightCheckpoint {
+public:
+	FlightCheckpoint();
+	~FlightCheckpoint();
+
+	/**
+	 * Map the checkpoint file, creating it if necessary.
+	 *
+	 * @param fname path to the file
+	 * @return true on success, false otherwise
+	 */
+	bool open(const char *fname);
+
+	/**
+	 * Get the most recent valid checkpoint.
+	 *
+	 * @param dst destination for the state
+	 * @return true if a checkpoint younger than CHECKPOINT_MAX_AGE was found
+	 */
+	bool restore(FlightState *dst);
+
+	/**
+	 * Start writing checkpoints in the background.
+	 *
+	 * @param predictor predictor whose state is saved alongside the frame, or NULL
+	 */
+	void start(LandingPredictor *predictor);
+	void stop();
+
+	/**
+	 * Record a new frame. Meant to be called from the frame path: never blocks,
+	 * and drops the update if the writer is busy copying the previous one.
+	 *
+	 * @param data decoded frame
+	 * @param gpx GPX writer the frame was written to, or NULL
+	 */
+	void update(const SondeFullData &data, const GPXWriter *gpx);
+
+	/**
+	 * Record the state of the GPX writer alone, after its track changed outside
+	 * of a frame or the writer was replaced. May block for the duration of a copy.
+	 *
+	 * @param gpx GPX writer, or NULL
+	 */
+	void setGPXState(const GPXWriter *gpx);
+
+	/**
+	 * Record the current output files.
+	 *
+	 * @param gpxPath path to the GPX track, or NULL if disabled
+	 * @param ptuPath path to the PTU log, or NULL if disabled
+	 */
+	void setOutputs(const char *gpxPath, const char *ptuPath);
+
+private:
+	struct Header {
+		char magic[8];
+		uint32_t stateSize;
+		uint32_t reserved;
+	};
+	struct Slot {
+		uint64_t seq;
+		uint32_t checksum;
+		uint32_t reserved;
+		FlightState state;
+	};
+
+	static uint32_t checksum(const FlightState &state);
+	Slot *slot(int idx) { return (Slot*)((uint8_t*)m_file.data() + sizeof(Header)) + idx; }
+	void worker();
+
+	MappedFile m_file;
+	uint64_t m_seq;
+
+	std::thread m_thread;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	bool m_running, m_dirty;
+	FlightState m_pending;
+	LandingPredictor *m_predictor;
+};
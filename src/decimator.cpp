@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <math.h>
+#include "decimator.hpp"
+
+#define EARTH_RADIUS 6371e3
+#define MIN_INTERVAL 1.0f           /* Seconds, vertical mode, however fast the sonde moves */
+#define MIN_CLIMB 0.1f              /* m/s, slower is landed or floating: one fix per interval */
+
+static const char *const modeNames[] = {"All fixes", "Time interval", "Distance", "Vertical speed"};
+
+TrackDecimator::TrackDecimator()
+{
+	m_config.mode = DECIMATE_NONE;
+	m_config.interval = 10;
+	m_config.distance = 100;
+	m_seen = m_kept = 0;
+	reset();
+}
+
+void
+TrackDecimator::setConfig(const Config &config)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_config = config;
+	m_config.interval = std::max(m_config.interval, 0.0f);
+	m_config.distance = std::max(m_config.distance, 0.0f);
+}
+
+TrackDecimator::Config
+TrackDecimator::getConfig()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_config;
+}
+
+bool
+TrackDecimator::accept(const SondeFullData &data)
+{
+	const Config config = getConfig();
+	const Fix fix = toFix(data);
+	const double dt = difftime(fix.time, m_last.time);
+	double dx, dy, dz;
+	float climb;
+	bool keep;
+
+	/* Frames without a position are not part of the track in any mode */
+	if (isnan(fix.lat) || isnan(fix.lon) || (fix.lat == 0 && fix.lon == 0)) return false;
+
+	m_seen++;
+
+	/* A clock going backwards is a different sonde or a corrupted frame: do not stall on it */
+	if (!m_started || dt < 0) {
+		keep = true;
+	} else {
+		switch (config.mode) {
+		case DECIMATE_INTERVAL:
+			keep = dt >= config.interval;
+			break;
+		case DECIMATE_DISTANCE:
+			dx = (fix.lon - m_last.lon) * M_PI / 180 * EARTH_RADIUS * cos(fix.lat * M_PI / 180);
+			dy = (fix.lat - m_last.lat) * M_PI / 180 * EARTH_RADIUS;
+			dz = isnan(fix.alt) || isnan(m_last.alt) ? 0 : fix.alt - m_last.alt;
+			keep = dx*dx + dy*dy + dz*dz >= (double)config.distance * config.distance;
+			break;
+		case DECIMATE_VERTICAL:
+			/* No vertical speed yet counts as floating; the interval bounds the gap regardless */
+			climb = isfinite(data.climb) ? std::max(fabsf(data.climb), MIN_CLIMB) : MIN_CLIMB;
+			keep = dt >= config.interval || dt >= std::max(config.distance / climb, MIN_INTERVAL);
+			break;
+		default:
+			keep = true;
+			break;
+		}
+	}
+
+	if (keep) {
+		m_started = true;
+		m_hasPending = false;
+		m_last = fix;
+		m_kept++;
+	} else {
+		m_hasPending = true;
+		m_pending = fix;
+	}
+	return keep;
+}
+
+bool
+TrackDecimator::pending(Fix *dst) const
+{
+	if (!m_hasPending) return false;
+	*dst = m_pending;
+	return true;
+}
+
+void
+TrackDecimator::reset()
+{
+	m_started = false;
+	m_hasPending = false;
+}
+
+TrackDecimator::Stats
+TrackDecimator::stats() const
+{
+	Stats stats;
+
+	stats.seen = m_seen;
+	stats.kept = m_kept;
+	return stats;
+}
+
+const char*
+TrackDecimator::modeName(Mode mode)
+{
+	return modeNames[mode];
+}
+
+/* Private methods {{{ */
+TrackDecimator::Fix
+TrackDecimator::toFix(const SondeFullData &data)
+{
+	return {data.time, data.lat, data.lon, data.alt, data.spd, data.hdg};
+}
+/* }}} */
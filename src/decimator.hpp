@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <time.h>
+#include "decode/common.hpp"
+
+/**
+ * Picks the fixes of a track worth writing, for outputs that do not need
+ * every frame: one every few seconds, one every few meters, or adaptively,
+ * more often the faster the sonde climbs or falls. A fix is always kept
+ * first, and the last fix skipped is held so that the track can end where
+ * the sonde was last heard.
+ *
+ * setConfig() and stats() can be called from any thread, the other methods
+ * only from the thread writing the output.
+ */
+class TrackDecimator {
+public:
+	enum Mode {
+		DECIMATE_NONE,              /* Every fix */
+		DECIMATE_INTERVAL,          /* At least interval seconds apart */
+		DECIMATE_DISTANCE,          /* At least distance meters apart, in 3D */
+		DECIMATE_VERTICAL,          /* distance meters of climb or descent apart, at most interval seconds */
+	};
+	struct Config {
+		Mode mode;
+		float interval;             /* Seconds */
+		float distance;             /* Meters */
+	};
+	struct Fix {
+		time_t time;
+		float lat, lon, alt;
+		float spd, hdg;
+	};
+	struct Stats {
+		uint64_t seen;
+		uint64_t kept;
+	};
+
+	TrackDecimator();
+
+	void setConfig(const Config &config);
+	Config getConfig();
+
+	/**
+	 * @param data new fix
+	 * @return true if the fix must be written, false if skipped or without
+	 *         a position, which is not counted
+	 */
+	bool accept(const SondeFullData &data);
+
+	/**
+	 * Get the last fix skipped since the last one kept, if any.
+	 *
+	 * @return false if the last fix was kept
+	 */
+	bool pending(Fix *dst) const;
+
+	/**
+	 * Start over for a new track: the next fix is kept.
+	 */
+	void reset();
+
+	Stats stats() const;
+
+	static const char *modeName(Mode mode);
+
+private:
+	static Fix toFix(const SondeFullData &data);
+
+	std::mutex m_mtx;           /* Protects the config */
+	Config m_config;
+
+	/* Writer thread only */
+	bool m_started, m_hasPending;
+	Fix m_last, m_pending;
+
+	std::atomic<uint64_t> m_seen, m_kept;
+};
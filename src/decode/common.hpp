@@ -1,11 +1,12 @@
 #pragma once
 #include <string>
+#include "serials.hpp"
 
 class SondeFullData {
 public:
 	SondeFullData() { init(); }
 	void init() {
-		serial = "";
+		serial = 0;
 		seq = time = burstkill = 0;
 		lat = lon = alt = 0;
 		spd = hdg = climb = 0;
@@ -14,7 +15,7 @@ public:
 		auxData = "";
 	};
 
-	std::string serial;         /* Serial number */
+	SerialId serial;            /* Serial number, see serial_name() */
 	int seq;                    /* Frame sequence number */
 	time_t time;                /* Onboard time */
 	int burstkill;              /* Time to shutdown, -1 if inactive */
@@ -15,29 +15,42 @@ extern "C" {
 
 #define LEN(x) (sizeof(x)/sizeof(*x))
 
+static bool merge_fragment(SondeFullData *data, const SondeData *fragment);
 static float dewpt(float temp, float rh);
 static float altitude_to_pressure(float alt);
 
 namespace radiosonde {
+	/**
+	 * Decoder block whose state survives stop(), so that restarting it keeps the
+	 * calibration and lock it had. The state is only freed by release(), or
+	 * when the block is destroyed.
+	 */
+	class DecoderBlock : public dsp::block {
+		public:
+			/* Free the decoder state, if any. The block must be stopped */
+			virtual void release() = 0;
+	};
+
 	template<typename T, T* (*decoder_init)(int), void (*decoder_deinit)(T*), ParserStatus (*decoder_get)(T*, SondeData*, const float*, size_t)>
-	class Decoder : public dsp::block {
+	class Decoder : public DecoderBlock {
 		public:
-			Decoder() {}
+			Decoder() { m_decoder = NULL; }
 			~Decoder() {
-				if (!dsp::block::_block_init) return;
-				dsp::block::stop();
-				dsp::block::unregisterInput(m_in);
-				dsp::block::_block_init = false;
-
-				decoder_deinit(m_decoder);
+				if (dsp::block::_block_init) {
+					dsp::block::stop();
+					dsp::block::unregisterInput(m_in);
+					dsp::block::_block_init = false;
+				}
+				release();
 			}
 
 			void init(dsp::stream<float> *in, int samplerate, void (*callback)(SondeFullData *data, void *ctx), void *ctx) {
 				m_in = in;
 				m_ctx = ctx;
 				m_callback = callback;
-				m_decoder = decoder_init(samplerate);
+				m_samplerate = samplerate;
 				m_count = m_offset = 0;
+				release();
 
 				dsp::block::registerInput(m_in);
 				dsp::block::_block_init = true;
@@ -46,8 +59,12 @@ namespace radiosonde {
 			void deinit(void) {
 				dsp::block::stop();
 				dsp::block::unregisterInput(m_in);
+				release();
+			}
 
-				decoder_deinit(m_decoder);
+			void release() override {
+				if (m_decoder) decoder_deinit(m_decoder);
+				m_decoder = NULL;
 			}
 
 			int run() {
@@ -59,63 +76,23 @@ namespace radiosonde {
 				if ((count = m_in->read()) < 0) return -1;
 
 				while (decoder_get(m_decoder, &fragment, m_in->readBuf, count) != PROCEED) {
-					std::ostringstream auxStream;
-
-					if (fragment.fields & DATA_SEQ) {
-						m_data.seq = fragment.seq;
-					}
-
-					if (fragment.fields & DATA_POS) {
-						m_data.lat = fragment.lat;
-						m_data.lon = fragment.lon;
-						m_data.alt = fragment.alt;
-					}
-
-					if (fragment.fields & DATA_SPEED) {
-						m_data.spd = fragment.speed;
-						m_data.hdg = fragment.heading;
-						m_data.climb = fragment.climb;
-					}
-
-					if (fragment.fields & DATA_TIME) {
-						m_data.time = fragment.time;
-					}
-
-					if (fragment.fields & DATA_PTU) {
-						m_data.calib_percent = fragment.calib_percent;
-						m_data.calibrated = m_data.calib_percent >= 100.0f;
-						m_data.temp = fragment.temp;
-						m_data.rh = fragment.rh;
-						m_data.pressure = fragment.pressure;
-						m_data.dewpt = dewpt(m_data.temp, m_data.rh);
-					}
-
-					if (fragment.fields & DATA_SERIAL) {
-						m_data.serial = fragment.serial;
-					}
-
-					if (fragment.fields & DATA_SHUTDOWN) {
-						m_data.burstkill = fragment.shutdown;
-					}
-
-					/* Auxiliary data */
-					if (fragment.fields & DATA_OZONE) {
-						auxStream.precision(2);
-						auxStream << "O3=" << std::fixed << fragment.o3_mpa << "mPa";
-						m_data.auxData = auxStream.str();
-					}
-
-					if (m_data.pressure <= 0) {
-						m_data.pressure = altitude_to_pressure(m_data.alt);
-					}
-
-					if (fragment.fields) {
+					if (merge_fragment(&m_data, &fragment)) {
 						m_callback(&m_data, m_ctx);
 					}
 				}
 
 				m_in->flush();
-				return 0;
+				return count;
+			}
+
+		protected:
+			/* Only the decoder of the selected type ever runs: its state is
+			 * allocated the first time it starts, and kept across stops until
+			 * another type is selected, so that the other types cost nothing
+			 * but this block */
+			void doStart() override {
+				if (!m_decoder) m_decoder = decoder_init(m_samplerate);
+				dsp::block::doStart();
 			}
 
 		private:
@@ -123,12 +100,69 @@ namespace radiosonde {
 			void (*m_callback)(SondeFullData *data, void *ctx);
 			void *m_ctx;
 			T *m_decoder;
+			int m_samplerate;
 			int m_count, m_offset;
 			SondeFullData m_data;
 
 	};
 }
 
+/* Update the accumulated state of a sonde, returns whether the fragment carried anything */
+static bool
+merge_fragment(SondeFullData *data, const SondeData *fragment)
+{
+	if (fragment->fields & DATA_SEQ) {
+		data->seq = fragment->seq;
+	}
+
+	if (fragment->fields & DATA_POS) {
+		data->lat = fragment->lat;
+		data->lon = fragment->lon;
+		data->alt = fragment->alt;
+	}
+
+	if (fragment->fields & DATA_SPEED) {
+		data->spd = fragment->speed;
+		data->hdg = fragment->heading;
+		data->climb = fragment->climb;
+	}
+
+	if (fragment->fields & DATA_TIME) {
+		data->time = fragment->time;
+	}
+
+	if (fragment->fields & DATA_PTU) {
+		data->calib_percent = fragment->calib_percent;
+		data->calibrated = data->calib_percent >= 100.0f;
+		data->temp = fragment->temp;
+		data->rh = fragment->rh;
+		data->pressure = fragment->pressure;
+		data->dewpt = dewpt(data->temp, data->rh);
+	}
+
+	if (fragment->fields & DATA_SERIAL) {
+		data->serial = SerialTable::shared().intern(fragment->serial, data->serial);
+	}
+
+	if (fragment->fields & DATA_SHUTDOWN) {
+		data->burstkill = fragment->shutdown;
+	}
+
+	/* Auxiliary data */
+	if (fragment->fields & DATA_OZONE) {
+		std::ostringstream auxStream;
+		auxStream.precision(2);
+		auxStream << "O3=" << std::fixed << fragment->o3_mpa << "mPa";
+		data->auxData = auxStream.str();
+	}
+
+	if (data->pressure <= 0) {
+		data->pressure = altitude_to_pressure(data->alt);
+	}
+
+	return fragment->fields != 0;
+}
+
 static float
 dewpt(float temp, float rh)
 {
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+extern "C" {
+#include "sondedump/include/c50.h"
+#include "sondedump/include/dfm09.h"
+#include "sondedump/include/imet4.h"
+#include "sondedump/include/ims100.h"
+#include "sondedump/include/m10.h"
+#include "sondedump/include/mrzn1.h"
+#include "sondedump/include/rs41.h"
+}
+
+/* Type-erased access to the sondedump decoders, for the offline tools and the channel set */
+struct SondeType {
+	const char *key;            /* Command line identifier */
+	const char *name;           /* Display name, same as in the module */
+	float bandwidth;            /* VFO bandwidth used by the module, Hz */
+	void *(*init)(int samplerate);
+	void (*deinit)(void *decoder);
+	ParserStatus (*decode)(void *decoder, SondeData *dst, const float *src, size_t len);
+};
+
+template<typename T, T* (*decoder_init)(int), void (*decoder_deinit)(T*), ParserStatus (*decoder_get)(T*, SondeData*, const float*, size_t)>
+struct SondeTypeThunk {
+	static void *init(int samplerate) { return decoder_init(samplerate); }
+	static void deinit(void *decoder) { decoder_deinit((T*)decoder); }
+	static ParserStatus decode(void *decoder, SondeData *dst, const float *src, size_t len) {
+		return decoder_get((T*)decoder, dst, src, len);
+	}
+};
+
+#define SONDE_TYPE(key, name, bandwidth, T, prefix) \
+	{key, name, bandwidth, \
+	 SondeTypeThunk<T, prefix##_decoder_init, prefix##_decoder_deinit, prefix##_decode>::init, \
+	 SondeTypeThunk<T, prefix##_decoder_init, prefix##_decoder_deinit, prefix##_decode>::deinit, \
+	 SondeTypeThunk<T, prefix##_decoder_init, prefix##_decoder_deinit, prefix##_decode>::decode}
+
+static const SondeType sondeTypes[] = {
+	SONDE_TYPE("rs41", "RS41", 1e4, RS41Decoder, rs41),
+	SONDE_TYPE("dfm", "DFM06/09", 1.5e4, DFM09Decoder, dfm09),
+	SONDE_TYPE("ims100", "iMS100/RS-11G", 2e4, IMS100Decoder, ims100),
+	SONDE_TYPE("m10", "M10/M20", 5e4, M10Decoder, m10),
+	SONDE_TYPE("imet4", "iMet-4", 2e4, IMET4Decoder, imet4),
+	SONDE_TYPE("c50", "SRS-C50", 2e4, C50Decoder, c50),
+	SONDE_TYPE("mrzn1", "MRZ-N1", 2e4, MRZN1Decoder, mrzn1),
+};
+
+static inline const SondeType*
+findSondeType(const char *key)
+{
+	for (const SondeType &type : sondeTypes) {
+		if (!strcmp(type.key, key)) return &type;
+	}
+	return NULL;
+}
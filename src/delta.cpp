@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.hpp"
+
+#define DELTA_MAGIC 0xD5
+#define DELTA_VERSION 1
+#define DELTA_TYPE_KEYFRAME 0
+#define DELTA_TYPE_DELTA 1
+#define DELTA_TYPE_NACK 2
+#define DELTA_NAN INT64_MIN         /* Quantized value of NaN fields */
+#define DELTA_MAX_STRING 255
+
+/* Quantization step of each field, in the field's units */
+static const double delta_steps[DELTA_FIELD_COUNT] = {
+	1,          /* seq */
+	1,          /* time, s */
+	1,          /* burstkill, s */
+	1e-6,       /* lat, deg (~0.1m) */
+	1e-6,       /* lon, deg */
+	0.1,        /* alt, m */
+	0.01,       /* spd, m/s */
+	0.1,        /* hdg, deg */
+	0.01,       /* climb, m/s */
+	0.01,       /* temp, C */
+	0.1,        /* rh, % */
+	0.01,       /* dewpt, C */
+	0.01,       /* pressure, hPa */
+	1,          /* calibrated flag | calibration percentage << 1 */
+};
+
+/* Varint helpers {{{ */
+static uint8_t*
+put_varint(uint8_t *ptr, uint64_t value)
+{
+	while (value >= 0x80) {
+		*ptr++ = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	*ptr++ = value;
+	return ptr;
+}
+
+static bool
+get_varint(const uint8_t **ptr, const uint8_t *end, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	for (int shift = 0; shift < 64 && *ptr < end; shift += 7) {
+		const uint8_t byte = *(*ptr)++;
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint64_t zigzag(int64_t x) { return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63); }
+static int64_t unzigzag(uint64_t x) { return (int64_t)(x >> 1) ^ -(int64_t)(x & 1); }
+
+static uint8_t*
+put_string(uint8_t *ptr, const std::string &str)
+{
+	const size_t len = std::min(str.size(), (size_t)DELTA_MAX_STRING);
+
+	ptr = put_varint(ptr, len);
+	memcpy(ptr, str.data(), len);
+	return ptr + len;
+}
+
+static bool
+get_string(const uint8_t **ptr, const uint8_t *end, std::string *str)
+{
+	uint64_t len;
+
+	if (!get_varint(ptr, end, &len) || len > (uint64_t)(end - *ptr)) return false;
+	str->assign((const char*)*ptr, len);
+	*ptr += len;
+	return true;
+}
+/* }}} */
+
+/* Quantization {{{ */
+static int64_t
+quantize_float(float value, double step)
+{
+	if (isnan(value) || isinf(value)) return DELTA_NAN;
+	return llround(value / step);
+}
+
+static float
+dequantize_float(int64_t value, double step)
+{
+	if (value == DELTA_NAN) return NAN;
+	return value * step;
+}
+
+static void
+quantize(const SondeFullData &data, int64_t *q)
+{
+	q[DELTA_SEQ] = data.seq;
+	q[DELTA_TIME] = data.time;
+	q[DELTA_BURSTKILL] = data.burstkill;
+	q[DELTA_LAT] = quantize_float(data.lat, delta_steps[DELTA_LAT]);
+	q[DELTA_LON] = quantize_float(data.lon, delta_steps[DELTA_LON]);
+	q[DELTA_ALT] = quantize_float(data.alt, delta_steps[DELTA_ALT]);
+	q[DELTA_SPD] = quantize_float(data.spd, delta_steps[DELTA_SPD]);
+	q[DELTA_HDG] = quantize_float(data.hdg, delta_steps[DELTA_HDG]);
+	q[DELTA_CLIMB] = quantize_float(data.climb, delta_steps[DELTA_CLIMB]);
+	q[DELTA_TEMP] = quantize_float(data.temp, delta_steps[DELTA_TEMP]);
+	q[DELTA_RH] = quantize_float(data.rh, delta_steps[DELTA_RH]);
+	q[DELTA_DEWPT] = quantize_float(data.dewpt, delta_steps[DELTA_DEWPT]);
+	q[DELTA_PRESSURE] = quantize_float(data.pressure, delta_steps[DELTA_PRESSURE]);
+	q[DELTA_CALIB] = (isnan(data.calib_percent) ? 0 : (int64_t)lroundf(data.calib_percent) << 1) | data.calibrated;
+}
+
+static void
+dequantize(const int64_t *q, SondeFullData *data)
+{
+	data->seq = q[DELTA_SEQ];
+	data->time = q[DELTA_TIME];
+	data->burstkill = q[DELTA_BURSTKILL];
+	data->lat = dequantize_float(q[DELTA_LAT], delta_steps[DELTA_LAT]);
+	data->lon = dequantize_float(q[DELTA_LON], delta_steps[DELTA_LON]);
+	data->alt = dequantize_float(q[DELTA_ALT], delta_steps[DELTA_ALT]);
+	data->spd = dequantize_float(q[DELTA_SPD], delta_steps[DELTA_SPD]);
+	data->hdg = dequantize_float(q[DELTA_HDG], delta_steps[DELTA_HDG]);
+	data->climb = dequantize_float(q[DELTA_CLIMB], delta_steps[DELTA_CLIMB]);
+	data->temp = dequantize_float(q[DELTA_TEMP], delta_steps[DELTA_TEMP]);
+	data->rh = dequantize_float(q[DELTA_RH], delta_steps[DELTA_RH]);
+	data->dewpt = dequantize_float(q[DELTA_DEWPT], delta_steps[DELTA_DEWPT]);
+	data->pressure = dequantize_float(q[DELTA_PRESSURE], delta_steps[DELTA_PRESSURE]);
+	data->calibrated = q[DELTA_CALIB] & 1;
+	data->calib_percent = q[DELTA_CALIB] >> 1;
+}
+/* }}} */
+
+/* DeltaEncoder {{{ */
+DeltaEncoder::DeltaEncoder(uint32_t streamId)
+{
+	m_streamId = streamId;
+	m_seq = 0;
+	m_sinceKeyframe = 0;
+	m_forceKeyframe = true;
+	m_serial = 0;
+}
+
+int
+DeltaEncoder::encode(const SondeFullData &data, uint8_t *buf)
+{
+	int64_t q[DELTA_FIELD_COUNT];
+	uint8_t *ptr = buf;
+	uint64_t mask;
+	bool keyframe;
+
+	quantize(data, q);
+
+	keyframe = m_forceKeyframe || m_sinceKeyframe >= DELTA_KEYFRAME_INTERVAL || data.serial != m_serial;
+
+	*ptr++ = DELTA_MAGIC;
+	*ptr++ = DELTA_VERSION << 4 | (keyframe ? DELTA_TYPE_KEYFRAME : DELTA_TYPE_DELTA);
+	ptr = put_varint(ptr, m_streamId);
+	ptr = put_varint(ptr, ++m_seq);
+
+	/* A keyframe is a delta against an all-zero state, with every field present */
+	if (keyframe) {
+		for (int i=0; i<DELTA_FIELD_COUNT; i++) m_state[i] = 0;
+		m_serial = data.serial;
+		m_aux = "";
+		ptr = put_string(ptr, serial_name(m_serial).c_str());
+		m_sinceKeyframe = 0;
+		m_forceKeyframe = false;
+	}
+
+	mask = 0;
+	for (int i=0; i<DELTA_FIELD_COUNT; i++) {
+		if (keyframe || q[i] != m_state[i]) mask |= 1ULL << i;
+	}
+	if (keyframe || data.auxData != m_aux) mask |= 1ULL << DELTA_AUX;
+	ptr = put_varint(ptr, mask);
+
+	for (int i=0; i<DELTA_FIELD_COUNT; i++) {
+		if (!(mask & (1ULL << i))) continue;
+
+		/* Wrapping difference, so that the NaN marker round-trips */
+		ptr = put_varint(ptr, zigzag((int64_t)((uint64_t)q[i] - (uint64_t)m_state[i])));
+		m_state[i] = q[i];
+	}
+	if (mask & (1ULL << DELTA_AUX)) {
+		m_aux = data.auxData.substr(0, DELTA_MAX_STRING);
+		ptr = put_string(ptr, m_aux);
+	}
+
+	m_sinceKeyframe++;
+	return ptr - buf;
+}
+/* }}} */
+
+/* DeltaDecoder {{{ */
+DeltaDecoder::DeltaDecoder()
+{
+	m_valid = false;
+	m_streamId = 0;
+	m_seq = 0;
+	m_serial = 0;
+	for (int i=0; i<DELTA_FIELD_COUNT; i++) m_state[i] = 0;
+}
+
+DeltaDecoder::Result
+DeltaDecoder::decode(const uint8_t *buf, size_t len, SondeFullData *data)
+{
+	const uint8_t *ptr = buf + 2, *end = buf + len;
+	int64_t q[DELTA_FIELD_COUNT];
+	std::string serial, aux;
+	uint64_t streamId, seq, mask, value;
+	bool keyframe;
+
+	if (len < 2 || buf[0] != DELTA_MAGIC || buf[1] >> 4 != DELTA_VERSION) return DELTA_INVALID;
+	if ((buf[1] & 0xF) != DELTA_TYPE_KEYFRAME && (buf[1] & 0xF) != DELTA_TYPE_DELTA) return DELTA_INVALID;
+	keyframe = (buf[1] & 0xF) == DELTA_TYPE_KEYFRAME;
+
+	if (!get_varint(&ptr, end, &streamId) || !get_varint(&ptr, end, &seq)) return DELTA_INVALID;
+	m_streamId = streamId;
+
+	/* Sequence numbers wrap around, compare them as signed differences */
+	if (m_valid && (int32_t)((uint32_t)seq - m_seq) <= 0) return DELTA_STALE;
+	if (!keyframe && (!m_valid || (uint32_t)seq != m_seq + 1)) {
+		m_valid = false;
+		return DELTA_NEED_KEYFRAME;
+	}
+
+	/* Work on a copy, so that a malformed packet leaves the state untouched */
+	if (keyframe) {
+		for (int i=0; i<DELTA_FIELD_COUNT; i++) q[i] = 0;
+		if (!get_string(&ptr, end, &serial)) return DELTA_INVALID;
+	} else {
+		memcpy(q, m_state, sizeof(q));
+	}
+	aux = m_aux;
+
+	if (!get_varint(&ptr, end, &mask)) return DELTA_INVALID;
+	for (int i=0; i<DELTA_FIELD_COUNT; i++) {
+		if (!(mask & (1ULL << i))) continue;
+		if (!get_varint(&ptr, end, &value)) return DELTA_INVALID;
+		q[i] = (int64_t)((uint64_t)q[i] + (uint64_t)unzigzag(value));
+	}
+	if ((mask & (1ULL << DELTA_AUX)) && !get_string(&ptr, end, &aux)) return DELTA_INVALID;
+
+	memcpy(m_state, q, sizeof(q));
+	if (keyframe) m_serial = SerialTable::shared().intern(serial.c_str(), m_serial);
+	m_aux = aux;
+	m_seq = seq;
+	m_valid = true;
+
+	dequantize(m_state, data);
+	data->serial = m_serial;
+	data->auxData = m_aux;
+	return DELTA_OK;
+}
+
+int
+DeltaDecoder::nack(uint8_t *buf)
+{
+	uint8_t *ptr = buf;
+
+	*ptr++ = DELTA_MAGIC;
+	*ptr++ = DELTA_VERSION << 4 | DELTA_TYPE_NACK;
+	ptr = put_varint(ptr, m_streamId);
+	ptr = put_varint(ptr, m_seq);
+	return ptr - buf;
+}
+/* }}} */
+
+bool
+delta_peek(const uint8_t *buf, size_t len, uint32_t *streamId, bool *nack)
+{
+	const uint8_t *ptr = buf + 2;
+	uint64_t id;
+
+	if (len < 2 || buf[0] != DELTA_MAGIC || buf[1] >> 4 != DELTA_VERSION) return false;
+	if (!get_varint(&ptr, buf + len, &id)) return false;
+
+	*streamId = id;
+	*nack = (buf[1] & 0xF) == DELTA_TYPE_NACK;
+	return true;
+}
+
+/* DeltaSender {{{ */
+DeltaSender::DeltaSender() : m_encoder(std::random_device()())
+{
+	m_bytes = m_frames = 0;
+}
+
+bool
+DeltaSender::init(const char *dest)
+{
+	std::string host;
+	int port;
+
+	if (!split_host_port(dest, &host, &port)) return false;
+	return m_socket.connect(host.c_str(), port);
+}
+
+void
+DeltaSender::send(const SondeFullData &data)
+{
+	uint8_t buf[DELTA_MAX_PACKET];
+	uint32_t streamId;
+	bool nack;
+	int len;
+
+	/* Drain NACKs, any of them means the collector lost track of the stream */
+	while ((len = m_socket.recv(buf, sizeof(buf), NULL, 0)) > 0) {
+		if (delta_peek(buf, len, &streamId, &nack) && nack && streamId == m_encoder.streamId()) {
+			m_encoder.requestKeyframe();
+		}
+	}
+
+	len = m_encoder.encode(data, buf);
+	if (m_socket.send(buf, len) == len) {
+		m_bytes += len;
+		m_frames++;
+	} else {
+		/* The packet never left, so the collector will see a gap: resync right away */
+		m_encoder.requestKeyframe();
+	}
+}
+/* }}} */
+
+/* DeltaReceiver {{{ */
+bool
+DeltaReceiver::init(int port)
+{
+	return m_socket.bind(port);
+}
+
+bool
+DeltaReceiver::receive(SondeFullData *data, UdpAddress *from, int timeoutMs)
+{
+	typedef std::chrono::steady_clock clock;
+	const clock::time_point deadline = clock::now() + std::chrono::milliseconds(timeoutMs);
+	uint8_t buf[DELTA_MAX_PACKET];
+	UdpAddress addr;
+	uint32_t streamId;
+	bool nack;
+	int len, remaining;
+
+	for (;;) {
+		remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+		if (remaining <= 0) return false;
+		if ((len = m_socket.recv(buf, sizeof(buf), &addr, remaining)) <= 0) {
+			if (len < 0) return false;
+			continue;
+		}
+
+		if (!delta_peek(buf, len, &streamId, &nack) || nack) continue;
+
+		DeltaDecoder &decoder = m_streams[std::make_pair(addr.toString(), streamId)];
+		switch (decoder.decode(buf, len, data)) {
+		case DeltaDecoder::DELTA_OK:
+			if (from) *from = addr;
+			return true;
+		case DeltaDecoder::DELTA_NEED_KEYFRAME:
+			len = decoder.nack(buf);
+			m_socket.sendTo(buf, len, addr);
+			break;
+		default:
+			break;
+		}
+	}
+}
+/* }}} */
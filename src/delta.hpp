@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "decode/common.hpp"
+#include "udp.hpp"
+
+#define DELTA_MAX_PACKET 512        /* Upper bound on the size of an encoded frame */
+#define DELTA_KEYFRAME_INTERVAL 30  /* Frames between two unsolicited keyframes */
+
+/*
+ * Compact binary encoding of decoded frames, for low-bandwidth links.
+ *
+ * Every packet starts with a magic byte, a type byte, and the stream ID and
+ * sequence number as varints. Keyframes carry all the fields of the frame;
+ * delta frames only carry the fields that changed since the previous packet,
+ * as zigzag varints of the difference between the quantized values. A receiver
+ * that misses a packet ignores deltas until the next keyframe, and asks for one
+ * by replying with a NACK packet.
+ */
+
+enum DeltaField {
+	DELTA_SEQ, DELTA_TIME, DELTA_BURSTKILL,
+	DELTA_LAT, DELTA_LON, DELTA_ALT,
+	DELTA_SPD, DELTA_HDG, DELTA_CLIMB,
+	DELTA_TEMP, DELTA_RH, DELTA_DEWPT, DELTA_PRESSURE,
+	DELTA_CALIB,
+	DELTA_FIELD_COUNT,
+	DELTA_AUX = DELTA_FIELD_COUNT   /* Not quantized, sent verbatim when it changes */
+};
+
+class DeltaEncoder {
+public:
+	DeltaEncoder(uint32_t streamId);
+
+	/**
+	 * Encode a frame.
+	 *
+	 * @param data frame to encode
+	 * @param buf destination buffer, at least DELTA_MAX_PACKET bytes long
+	 * @return length of the packet
+	 */
+	int encode(const SondeFullData &data, uint8_t *buf);
+
+	/**
+	 * Make the next packet a keyframe, e.g. after a NACK from the receiver.
+	 */
+	void requestKeyframe() { m_forceKeyframe = true; }
+
+	uint32_t streamId() const { return m_streamId; }
+
+private:
+	uint32_t m_streamId;
+	uint32_t m_seq;
+	int m_sinceKeyframe;
+	bool m_forceKeyframe;
+
+	SerialRef m_serial;
+	std::string m_aux;
+	int64_t m_state[DELTA_FIELD_COUNT];
+};
+
+class DeltaDecoder {
+public:
+	enum Result {
+		DELTA_OK,               /* New frame decoded */
+		DELTA_STALE,            /* Duplicate or reordered packet, ignored */
+		DELTA_NEED_KEYFRAME,    /* Packets were lost, a keyframe is needed to resume */
+		DELTA_INVALID,          /* Not a frame packet, or malformed */
+	};
+
+	DeltaDecoder();
+
+	/**
+	 * Decode a packet belonging to this decoder's stream.
+	 *
+	 * @param buf packet contents
+	 * @param len length of the packet
+	 * @param data destination for the decoded frame, valid if DELTA_OK is returned
+	 * @return decoding status
+	 */
+	Result decode(const uint8_t *buf, size_t len, SondeFullData *data);
+
+	/**
+	 * Build a NACK packet for this decoder's stream.
+	 *
+	 * @param buf destination buffer, at least DELTA_MAX_PACKET bytes long
+	 * @return length of the packet
+	 */
+	int nack(uint8_t *buf);
+
+private:
+	bool m_valid;
+	uint32_t m_streamId;
+	uint32_t m_seq;
+
+	SerialRef m_serial;         /* Interned when a keyframe carries it, not on every frame */
+	std::string m_aux;
+	int64_t m_state[DELTA_FIELD_COUNT];
+};
+
+/**
+ * Read the stream ID of a packet.
+ *
+ * @param buf packet contents
+ * @param len length of the packet
+ * @param streamId destination for the stream ID
+ * @param nack set to true if the packet is a NACK
+ * @return true if the packet is valid, false otherwise
+ */
+bool delta_peek(const uint8_t *buf, size_t len, uint32_t *streamId, bool *nack);
+
+/**
+ * Station side of the link: encodes frames, sends them to the collector, and
+ * reacts to NACKs. All methods are non-blocking except init().
+ */
+class DeltaSender {
+public:
+	DeltaSender();
+
+	/**
+	 * Open the link to the collector.
+	 *
+	 * @param dest collector address, as host:port
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *dest);
+
+	/**
+	 * Send a frame.
+	 *
+	 * @param data frame to send
+	 */
+	void send(const SondeFullData &data);
+
+	/* Statistics */
+	uint64_t bytesSent() const { return m_bytes; }
+	uint64_t framesSent() const { return m_frames; }
+
+private:
+	UdpSocket m_socket;
+	DeltaEncoder m_encoder;
+	std::atomic<uint64_t> m_bytes, m_frames;
+};
+
+/**
+ * Collector side of the link: keeps one decoder per remote stream, and replies
+ * with NACKs when packets are lost.
+ */
+class DeltaReceiver {
+public:
+	/**
+	 * Start listening.
+	 *
+	 * @param port local UDP port
+	 * @return true on success, false otherwise
+	 */
+	bool init(int port);
+
+	/**
+	 * Wait for the next frame.
+	 *
+	 * @param data destination for the decoded frame
+	 * @param from destination for the address of the station, or NULL
+	 * @param timeoutMs maximum time to wait
+	 * @return true if a frame was received, false on timeout or error
+	 */
+	bool receive(SondeFullData *data, UdpAddress *from, int timeoutMs);
+
+private:
+	UdpSocket m_socket;
+	std::map<std::pair<std::string, uint32_t>, DeltaDecoder> m_streams;
+};
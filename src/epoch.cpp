@@ -0,0 +1,101 @@
+#include <thread>
+#include "epoch.hpp"
+
+using namespace radiosonde;
+
+EpochDomain::EpochDomain()
+{
+	m_epoch = 0;
+	m_readers[0] = m_readers[1] = 0;
+}
+
+EpochDomain::~EpochDomain()
+{
+	synchronize();
+}
+
+unsigned
+EpochDomain::enter()
+{
+	unsigned epoch;
+
+	for (;;) {
+		epoch = m_epoch.load();
+		m_readers[epoch & 1].fetch_add(1);
+
+		/* If a writer advanced the epoch in the meantime, we might have been
+		 * counted in a generation it has already checked: try again */
+		if (m_epoch.load() == epoch) return epoch;
+		m_readers[epoch & 1].fetch_sub(1);
+	}
+}
+
+void
+EpochDomain::leave(unsigned epoch)
+{
+	m_readers[epoch & 1].fetch_sub(1);
+}
+
+void
+EpochDomain::retire(void *ptr, void (*deleter)(void*))
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_retired.push_back(Retired{ptr, deleter, m_epoch.load()});
+}
+
+void
+EpochDomain::reclaim()
+{
+	std::vector<Retired> expired;
+	unsigned epoch;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		if (m_retired.empty()) return;
+
+		/* Advance at most twice: an object retired in epoch e can be destroyed
+		 * once the epoch reaches e+2, since no reader from e or before remains */
+		tryAdvance();
+		tryAdvance();
+		epoch = m_epoch.load();
+
+		for (auto it = m_retired.begin(); it != m_retired.end(); ) {
+			if (epoch - it->epoch >= 2) {
+				expired.push_back(*it);
+				it = m_retired.erase(it);
+			} else {
+				it++;
+			}
+		}
+	}
+
+	/* Run deleters outside the lock, they might be slow (e.g. closing files) */
+	for (Retired &r : expired) {
+		r.deleter(r.ptr);
+	}
+}
+
+void
+EpochDomain::synchronize()
+{
+	for (;;) {
+		reclaim();
+		{
+			std::lock_guard<std::mutex> lck(m_mtx);
+			if (m_retired.empty()) return;
+		}
+		std::this_thread::yield();
+	}
+}
+
+/* Must be called with m_mtx held */
+bool
+EpochDomain::tryAdvance()
+{
+	unsigned epoch = m_epoch.load();
+
+	/* Readers of the previous epoch share the counter with the next one */
+	if (m_readers[(epoch + 1) & 1].load() != 0) return false;
+	m_epoch.store(epoch + 1);
+	return true;
+}
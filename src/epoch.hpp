@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace radiosonde {
+	/**
+	 * Epoch-based reclamation domain. Readers bracket their accesses to shared
+	 * objects with enter()/leave(); writers retire objects they unpublished, which
+	 * are only destroyed once every reader that might still see them has left.
+	 *
+	 * Readers never block nor take locks: enter() only retries if it races with a
+	 * writer advancing the epoch.
+	 */
+	class EpochDomain {
+	public:
+		EpochDomain();
+		~EpochDomain();
+
+		/**
+		 * Enter a read-side critical section.
+		 *
+		 * @return epoch to be passed to the matching leave()
+		 */
+		unsigned enter();
+
+		/**
+		 * Leave a read-side critical section.
+		 *
+		 * @param epoch value returned by the matching enter()
+		 */
+		void leave(unsigned epoch);
+
+		/**
+		 * Schedule an object for destruction once no reader can reference it.
+		 *
+		 * @param ptr object to destroy
+		 * @param deleter function used to destroy the object
+		 */
+		void retire(void *ptr, void (*deleter)(void*));
+
+		/**
+		 * Destroy all retired objects that are no longer reachable by readers.
+		 * Never blocks on readers.
+		 */
+		void reclaim();
+
+		/**
+		 * Wait until all readers active at the time of the call have left, then
+		 * destroy every retired object.
+		 */
+		void synchronize();
+
+		/* RAII helper for read-side critical sections */
+		class Guard {
+		public:
+			Guard(EpochDomain &domain) : m_domain(domain) { m_epoch = domain.enter(); }
+			~Guard() { m_domain.leave(m_epoch); }
+		private:
+			EpochDomain &m_domain;
+			unsigned m_epoch;
+		};
+
+	private:
+		struct Retired {
+			void *ptr;
+			void (*deleter)(void*);
+			unsigned epoch;
+		};
+
+		bool tryAdvance();
+
+		std::atomic<unsigned> m_epoch;
+		std::atomic<int> m_readers[2];
+		std::mutex m_mtx;
+		std::vector<Retired> m_retired;
+	};
+
+	/**
+	 * Pointer to an object shared between a writer thread and any number of
+	 * reader threads. Readers must hold an EpochDomain::Guard while using the
+	 * object returned by get(); the previous object is destroyed by the domain
+	 * once all those readers are done with it.
+	 */
+	template<typename T>
+	class Published {
+	public:
+		Published(EpochDomain &domain) : m_domain(domain) { m_ptr = NULL; }
+		~Published() { publish(NULL); }
+
+		/**
+		 * Get the currently published object.
+		 *
+		 * @return object, or NULL if none is published
+		 */
+		T *get() const { return m_ptr.load(std::memory_order_acquire); }
+
+		/**
+		 * Replace the currently published object. The old one is retired.
+		 *
+		 * @param value new object, ownership is transferred. May be NULL
+		 */
+		void publish(T *value) {
+			T *old = m_ptr.exchange(value, std::memory_order_acq_rel);
+			if (old) m_domain.retire(old, destroy);
+			m_domain.reclaim();
+		}
+
+	private:
+		static void destroy(void *ptr) { delete (T*)ptr; }
+
+		EpochDomain &m_domain;
+		std::atomic<T*> m_ptr;
+	};
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <dsp/block.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <string.h>
+
+#define FANOUT_DEFAULT_DEPTH 4
+
+namespace radiosonde {
+	/* What to do with a reader whose queue is full when a new buffer arrives */
+	enum LagPolicy {
+		LAG_BLOCK,      /* Stall the writer until the reader catches up */
+		LAG_DROP,       /* Discard the new buffer for this reader only */
+		LAG_SKIP,       /* Discard the oldest queued buffer to make room */
+	};
+
+	/**
+	 * One-to-many stream splitter. Each input buffer is copied exactly once into
+	 * a reference-counted slot, which is then handed to every bound reader. Readers
+	 * see the slot contents through their readBuf pointer, and release it on
+	 * flush(). Memory traffic is therefore independent of the number of readers.
+	 */
+	template<typename T>
+	class FanOut : public dsp::block {
+	private:
+		struct Slot {
+			T *data;
+			int capacity;
+			int size;
+			std::atomic<int> refs;
+		};
+
+		static void release(Slot *slot) {
+			slot->refs.fetch_sub(1, std::memory_order_acq_rel);
+		}
+
+	public:
+		/**
+		 * Reader end of the fan-out. Behaves like a regular dsp::stream from the
+		 * consumer's point of view, so it can be passed to any block expecting one.
+		 */
+		class Reader : public dsp::stream<T> {
+		public:
+			Reader() {
+				/* Buffers are borrowed from the fan-out, drop the ones we were given */
+				dsp::stream<T>::free();
+				m_policy = LAG_BLOCK;
+				m_depth = FANOUT_DEFAULT_DEPTH;
+				m_head = m_count = 0;
+				m_current = NULL;
+				m_readerStop = m_writerStop = false;
+				m_dropped = 0;
+			}
+			~Reader() {
+				clear();
+				flush();
+				this->readBuf = NULL;
+			}
+
+			int read() override {
+				std::unique_lock<std::mutex> lck(m_mtx);
+				m_cv.wait(lck, [this]{ return m_count > 0 || m_readerStop; });
+				if (m_readerStop) return -1;
+
+				m_current = m_queue[m_head];
+				m_head = (m_head + 1) % m_depth;
+				m_count--;
+				lck.unlock();
+				m_cv.notify_all();
+
+				this->readBuf = m_current->data;
+				return m_current->size;
+			}
+
+			void flush() override {
+				if (!m_current) return;
+				release(m_current);
+				m_current = NULL;
+			}
+
+			bool swap(int size) override { return false; }
+
+			void stopReader() override {
+				{
+					std::lock_guard<std::mutex> lck(m_mtx);
+					m_readerStop = true;
+				}
+				m_cv.notify_all();
+			}
+			void clearReadStop() override { m_readerStop = false; }
+
+			void stopWriter() override {
+				{
+					std::lock_guard<std::mutex> lck(m_mtx);
+					m_writerStop = true;
+				}
+				m_cv.notify_all();
+			}
+			void clearWriteStop() override { m_writerStop = false; }
+
+			/**
+			 * Get the number of buffers this reader lost because it was lagging.
+			 *
+			 * @return number of dropped or skipped buffers since binding
+			 */
+			unsigned long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+		private:
+			friend class FanOut;
+
+			void configure(LagPolicy policy, int depth) {
+				clear();
+				m_policy = policy;
+				m_depth = depth;
+				m_queue.assign(depth, NULL);
+				m_dropped = 0;
+			}
+
+			/* Writer side: queue a reference to the slot according to the lag policy */
+			bool push(Slot *slot) {
+				std::unique_lock<std::mutex> lck(m_mtx);
+
+				if (m_count == m_depth) {
+					switch (m_policy) {
+					case LAG_BLOCK:
+						m_cv.wait(lck, [this]{ return m_count < m_depth || m_writerStop; });
+						if (m_writerStop) return false;
+						break;
+					case LAG_DROP:
+						m_dropped++;
+						return true;
+					case LAG_SKIP:
+						release(m_queue[m_head]);
+						m_head = (m_head + 1) % m_depth;
+						m_count--;
+						m_dropped++;
+						break;
+					}
+				}
+
+				slot->refs.fetch_add(1, std::memory_order_relaxed);
+				m_queue[(m_head + m_count) % m_depth] = slot;
+				m_count++;
+				lck.unlock();
+				m_cv.notify_all();
+				return true;
+			}
+
+			/* Release all queued buffers. The one being read is released by flush() */
+			void clear() {
+				std::lock_guard<std::mutex> lck(m_mtx);
+				for (; m_count > 0; m_count--) {
+					release(m_queue[m_head]);
+					m_head = (m_head + 1) % m_depth;
+				}
+				m_head = 0;
+			}
+
+			LagPolicy m_policy;
+			int m_depth;
+			std::vector<Slot*> m_queue;
+			int m_head, m_count;
+			Slot *m_current;
+			std::atomic<unsigned long> m_dropped;
+
+			std::mutex m_mtx;
+			std::condition_variable m_cv;
+			bool m_readerStop, m_writerStop;
+		};
+
+		FanOut() {}
+		~FanOut() {
+			if (!dsp::block::_block_init) return;
+			dsp::block::stop();
+			for (Reader *reader : m_readers) {
+				dsp::block::unregisterOutput(reader);
+				reader->clear();
+			}
+			dsp::block::unregisterInput(m_in);
+			dsp::block::_block_init = false;
+
+			for (Slot *slot : m_slots) {
+				dsp::buffer::free(slot->data);
+				delete slot;
+			}
+		}
+
+		/**
+		 * Initialize the fan-out.
+		 *
+		 * @param in stream to read from
+		 * @param depth maximum number of buffers queued for each reader
+		 */
+		void init(dsp::stream<T> *in, int depth = FANOUT_DEFAULT_DEPTH) {
+			m_in = in;
+			m_depth = depth;
+
+			dsp::block::registerInput(m_in);
+			dsp::block::_block_init = true;
+		}
+
+		/**
+		 * Attach a reader to the fan-out. Safe to call while running.
+		 *
+		 * @param reader reader to attach
+		 * @param policy behaviour when the reader falls more than `depth` buffers behind
+		 */
+		void bindReader(Reader *reader, LagPolicy policy) {
+			assert(dsp::block::_block_init);
+			std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+			dsp::block::tempStop();
+			reader->configure(policy, m_depth);
+			dsp::block::registerOutput(reader);
+			m_readers.push_back(reader);
+			dsp::block::tempStart();
+		}
+
+		/**
+		 * Detach a reader from the fan-out, releasing any buffer still queued for it.
+		 *
+		 * @param reader reader to detach
+		 */
+		void unbindReader(Reader *reader) {
+			assert(dsp::block::_block_init);
+			std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+			dsp::block::tempStop();
+			for (auto it = m_readers.begin(); it != m_readers.end(); it++) {
+				if (*it == reader) {
+					dsp::block::unregisterOutput(reader);
+					m_readers.erase(it);
+					reader->clear();
+					break;
+				}
+			}
+			dsp::block::tempStart();
+		}
+
+		/**
+		 * Bytes held by the slots, which are only released with the fan-out.
+		 */
+		size_t memoryUsage() const { return m_bytes.load(std::memory_order_relaxed); }
+
+		int run() {
+			Slot *slot;
+			int count;
+
+			assert(dsp::block::_block_init);
+
+			if ((count = m_in->read()) < 0) return -1;
+
+			slot = acquireSlot(count);
+			memcpy(slot->data, m_in->readBuf, count * sizeof(T));
+			slot->size = count;
+			m_in->flush();
+
+			for (Reader *reader : m_readers) {
+				if (!reader->push(slot)) {
+					release(slot);
+					return -1;
+				}
+			}
+
+			/* Drop the writer's own reference: the slot is free once all readers flush */
+			release(slot);
+			return count;
+		}
+
+	private:
+		/* Find a slot nobody references anymore, growing the pool if necessary */
+		Slot *acquireSlot(int size) {
+			Slot *slot = NULL;
+
+			for (Slot *candidate : m_slots) {
+				if (candidate->refs.load(std::memory_order_acquire) == 0) {
+					slot = candidate;
+					break;
+				}
+			}
+
+			if (!slot) {
+				slot = new Slot;
+				slot->data = NULL;
+				slot->capacity = 0;
+				m_slots.push_back(slot);
+				m_bytes.fetch_add(sizeof(Slot), std::memory_order_relaxed);
+			}
+
+			if (slot->capacity < size) {
+				if (slot->data) dsp::buffer::free(slot->data);
+				m_bytes.fetch_add((size - slot->capacity) * sizeof(T), std::memory_order_relaxed);
+				slot->data = dsp::buffer::alloc<T>(size);
+				slot->capacity = size;
+			}
+
+			slot->refs.store(1, std::memory_order_relaxed);
+			return slot;
+		}
+
+		dsp::stream<T> *m_in;
+		int m_depth;
+		std::vector<Reader*> m_readers;
+		std::vector<Slot*> m_slots;
+		std::atomic<size_t> m_bytes{0};
+	};
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <string.h>
+#include "fir.hpp"
+
+#define FIR_MIN_FFT 256
+
+namespace radiosonde {
+	/* FftPlanCache {{{ */
+	FftPlanCache::~FftPlanCache()
+	{
+		for (auto &entry : m_plans) {
+			fftwf_destroy_plan(entry.second.forward);
+			fftwf_destroy_plan(entry.second.inverse);
+		}
+	}
+
+	const FftPlanCache::Plans*
+	FftPlanCache::get(int size)
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		auto it = m_plans.find(size);
+		float *time;
+		fftwf_complex *freq;
+		Plans plans;
+
+		if (it != m_plans.end()) return &it->second;
+
+		/* Measuring overwrites the arrays, so plan on scratch buffers with the same alignment as the filters' */
+		time = (float*)fftwf_malloc(sizeof(float) * size);
+		freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (size/2 + 1));
+		plans.forward = fftwf_plan_dft_r2c_1d(size, time, freq, FFTW_MEASURE);
+		plans.inverse = fftwf_plan_dft_c2r_1d(size, freq, time, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+		fftwf_free(time);
+		fftwf_free(freq);
+
+		return &m_plans.emplace(size, plans).first->second;
+	}
+
+	FftPlanCache&
+	FftPlanCache::shared()
+	{
+		static FftPlanCache cache;
+		return cache;
+	}
+	/* }}} */
+
+	/* FirFilter {{{ */
+	FirFilter::FirFilter()
+	{
+		m_plans = NULL;
+		m_fftSize = m_block = m_fill = 0;
+		m_time = m_result = NULL;
+		m_response = m_freq = NULL;
+	}
+
+	FirFilter::~FirFilter()
+	{
+		freeBuffers();
+	}
+
+	void
+	FirFilter::setTaps(const float *taps, int count, Method method)
+	{
+		freeBuffers();
+		m_taps.assign(taps, taps + count);
+		std::reverse(m_taps.begin(), m_taps.end());
+
+		if (method == FIR_DIRECT || (method == FIR_AUTO && count <= FIR_FFT_THRESHOLD)) {
+			reset();
+			return;
+		}
+
+		/* 4x the filter length keeps the per-sample cost close to its minimum */
+		for (m_fftSize = FIR_MIN_FFT; m_fftSize < 4 * count; m_fftSize <<= 1);
+		m_block = m_fftSize - count + 1;
+		m_plans = FftPlanCache::shared().get(m_fftSize);
+
+		m_time = (float*)fftwf_malloc(sizeof(float) * m_fftSize);
+		m_result = (float*)fftwf_malloc(sizeof(float) * m_fftSize);
+		m_response = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (m_fftSize/2 + 1));
+		m_freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (m_fftSize/2 + 1));
+
+		/* Transform of the zero-padded response, with the inverse transform scaling folded in */
+		memset(m_time, 0, sizeof(float) * m_fftSize);
+		for (int i=0; i<count; i++) m_time[i] = taps[i] / m_fftSize;
+		fftwf_execute_dft_r2c(m_plans->forward, m_time, m_response);
+
+		reset();
+	}
+
+	void
+	FirFilter::reset()
+	{
+		m_history.assign(m_taps.empty() ? 0 : m_taps.size() - 1, 0.0f);
+		m_fill = 0;
+		if (m_fftSize) {
+			memset(m_time, 0, sizeof(float) * m_fftSize);
+			memset(m_result, 0, sizeof(float) * m_fftSize);
+		}
+	}
+
+	void
+	FirFilter::process(const float *in, float *out, int count)
+	{
+		if (m_taps.empty()) {
+			memcpy(out, in, sizeof(float) * count);
+		} else if (m_fftSize) {
+			processFft(in, out, count);
+		} else {
+			processDirect(in, out, count);
+		}
+	}
+
+	/* Private methods {{{ */
+	void
+	FirFilter::processDirect(const float *in, float *out, int count)
+	{
+		const int ntaps = m_taps.size();
+		const float *taps = m_taps.data();
+		const float *window;
+
+		/* Append the new samples to the history, so that every output is a single dot product */
+		m_history.insert(m_history.end(), in, in + count);
+		window = m_history.data();
+
+		/* Independent partial sums, so that the compiler can vectorize without reassociating */
+		for (int i=0; i<count; i++) {
+			const float *x = window + i;
+			float acc[4] = {0, 0, 0, 0};
+			int k;
+
+			for (k=0; k+4<=ntaps; k+=4) {
+				acc[0] += taps[k] * x[k];
+				acc[1] += taps[k+1] * x[k+1];
+				acc[2] += taps[k+2] * x[k+2];
+				acc[3] += taps[k+3] * x[k+3];
+			}
+			for (; k<ntaps; k++) acc[0] += taps[k] * x[k];
+			out[i] = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+		}
+
+		m_history.erase(m_history.begin(), m_history.begin() + count);
+	}
+
+	void
+	FirFilter::processFft(const float *in, float *out, int count)
+	{
+		const int overlap = m_taps.size() - 1;
+		int len;
+
+		/* Outputs come from the previous block, while the current one fills up */
+		while (count > 0) {
+			len = std::min(count, m_block - m_fill);
+			memcpy(m_time + overlap + m_fill, in, sizeof(float) * len);
+			memcpy(out, m_result + overlap + m_fill, sizeof(float) * len);
+
+			m_fill += len;
+			in += len;
+			out += len;
+			count -= len;
+
+			if (m_fill == m_block) {
+				runBlock();
+				m_fill = 0;
+			}
+		}
+	}
+
+	void
+	FirFilter::runBlock()
+	{
+		const int overlap = m_taps.size() - 1;
+		const int bins = m_fftSize/2 + 1;
+
+		fftwf_execute_dft_r2c(m_plans->forward, m_time, m_freq);
+		for (int i=0; i<bins; i++) {
+			const float re = m_freq[i][0] * m_response[i][0] - m_freq[i][1] * m_response[i][1];
+			const float im = m_freq[i][0] * m_response[i][1] + m_freq[i][1] * m_response[i][0];
+			m_freq[i][0] = re;
+			m_freq[i][1] = im;
+		}
+		fftwf_execute_dft_c2r(m_plans->inverse, m_freq, m_result);
+
+		/* The first taps-1 outputs are aliased; the last taps-1 inputs become the next block's history */
+		memmove(m_time, m_time + m_block, sizeof(float) * overlap);
+	}
+
+	void
+	FirFilter::freeBuffers()
+	{
+		if (m_time) fftwf_free(m_time);
+		if (m_result) fftwf_free(m_result);
+		if (m_response) fftwf_free(m_response);
+		if (m_freq) fftwf_free(m_freq);
+		m_time = m_result = NULL;
+		m_response = m_freq = NULL;
+		m_plans = NULL;
+		m_fftSize = m_block = m_fill = 0;
+	}
+	/* }}} */
+	/* }}} */
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#define FIR_FFT_THRESHOLD 32        /* Filters longer than this use fast convolution (see radiosonde_bench -F) */
+
+namespace radiosonde {
+	/**
+	 * Real-to-complex and complex-to-real FFTW plans, shared by every filter using
+	 * the same transform size. Planning is slow and not thread-safe, but executing
+	 * an existing plan on new arrays is both fast and thread-safe, as long as the
+	 * arrays come from fftwf_malloc().
+	 */
+	class FftPlanCache {
+	public:
+		struct Plans {
+			fftwf_plan forward;         /* Real to complex, size/2+1 bins */
+			fftwf_plan inverse;         /* Complex to real, unnormalized */
+		};
+
+		~FftPlanCache();
+
+		/**
+		 * Get the plans for a transform size, creating them on first use.
+		 *
+		 * @param size transform size
+		 * @return plans, valid for the lifetime of the cache
+		 */
+		const Plans *get(int size);
+
+		static FftPlanCache &shared();
+
+	private:
+		std::mutex m_mtx;
+		std::map<int, Plans> m_plans;
+	};
+
+	/**
+	 * Streaming real FIR filter. Short filters are applied in the time domain;
+	 * longer ones use overlap-save fast convolution, whose cost per sample grows
+	 * with the logarithm of the tap count rather than linearly. Fast convolution
+	 * works on whole blocks, so it delays the output by latency() samples.
+	 */
+	class FirFilter {
+	public:
+		enum Method {
+			FIR_AUTO,                   /* Overlap-save above FIR_FFT_THRESHOLD taps */
+			FIR_DIRECT,
+			FIR_OVERLAP_SAVE,
+		};
+
+		FirFilter();
+		~FirFilter();
+		FirFilter(const FirFilter&) = delete;
+		FirFilter &operator=(const FirFilter&) = delete;
+
+		/**
+		 * Set the impulse response. Resets the filter state.
+		 *
+		 * @param taps filter coefficients
+		 * @param count number of coefficients
+		 * @param method filtering method
+		 */
+		void setTaps(const float *taps, int count, Method method = FIR_AUTO);
+
+		/**
+		 * Clear the filter history.
+		 */
+		void reset();
+
+		/**
+		 * Filter a buffer. Input and output may not overlap.
+		 *
+		 * @param in input samples
+		 * @param out output samples, as many as input samples
+		 * @param count number of samples
+		 */
+		void process(const float *in, float *out, int count);
+
+		bool usesFft() const { return m_fftSize > 0; }
+		int taps() const { return m_taps.size(); }
+		int latency() const { return m_fftSize ? m_block : 0; }
+
+	private:
+		void processDirect(const float *in, float *out, int count);
+		void processFft(const float *in, float *out, int count);
+		void runBlock();
+		void freeBuffers();
+
+		std::vector<float> m_taps;      /* Reversed, for a forward dot product */
+		std::vector<float> m_history;   /* Last taps-1 inputs, followed by the current buffer */
+
+		/* Overlap-save state */
+		const FftPlanCache::Plans *m_plans;
+		int m_fftSize, m_block, m_fill;
+		float *m_time, *m_result;
+		fftwf_complex *m_response, *m_freq;
+	};
+}
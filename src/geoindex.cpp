@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <filesystem>
+#include <math.h>
+#include <string.h>
+#include "geoindex.hpp"
+#include "mmap.hpp"
+
+#define CELLS_MAGIC "RSGEO001"
+#define LON_BITS ((GEOINDEX_CELL_BITS + 1) / 2)
+#define LAT_BITS (GEOINDEX_CELL_BITS / 2)
+#define MAX_QUERY_CELLS 256         /* Query cells before falling back to coarser geohash prefixes */
+#define ENTRY_LANDING 1
+#define EARTH_RADIUS_KM 6371.0
+
+namespace fs = std::filesystem;
+
+/* Geohash helpers {{{ */
+static uint32_t
+cellIndex(double value, double min, double span, int bits)
+{
+	const double idx = floor((value - min) / span * (1u << bits));
+	return (uint32_t)std::max(0.0, std::min(idx, (double)((1u << bits) - 1)));
+}
+
+/* Interleave the longitude and latitude indices, longitude first, into a geohash */
+static uint32_t
+interleave(uint32_t lonIdx, int lonBits, uint32_t latIdx, int latBits)
+{
+	uint32_t hash = 0;
+
+	for (int i=0; i<lonBits+latBits; i++) {
+		hash = (hash << 1) | ((i % 2 == 0 ? lonIdx >> (lonBits - 1 - i/2) : latIdx >> (latBits - 1 - i/2)) & 1);
+	}
+	return hash;
+}
+
+static uint32_t
+geohash(double lat, double lon)
+{
+	return interleave(cellIndex(lon, -180, 360, LON_BITS), LON_BITS, cellIndex(lat, -90, 180, LAT_BITS), LAT_BITS);
+}
+
+static double
+distance(double lat1, double lon1, double lat2, double lon2)
+{
+	const double dlat = (lat2 - lat1) * M_PI / 180;
+	const double dlon = (lon2 - lon1) * M_PI / 180;
+	const double a = sin(dlat/2) * sin(dlat/2) + cos(lat1 * M_PI / 180) * cos(lat2 * M_PI / 180) * sin(dlon/2) * sin(dlon/2);
+	return 2 * EARTH_RADIUS_KM * asin(std::min(1.0, sqrt(a)));
+}
+/* }}} */
+
+GeoIndex::GeoIndex()
+{
+	m_flightsFd = m_pointsFd = m_cellsFd = NULL;
+	m_flights = 0;
+	m_points = m_entries = m_sorted = 0;
+}
+
+GeoIndex::~GeoIndex()
+{
+	close();
+}
+
+bool
+GeoIndex::open(const char *dir)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	std::error_code err;
+
+	if (m_flightsFd) {
+		fclose(m_flightsFd);
+		fclose(m_pointsFd);
+		fclose(m_cellsFd);
+		m_flightsFd = m_pointsFd = m_cellsFd = NULL;
+	}
+
+	m_dir = dir;
+	fs::create_directories(m_dir, err);
+	if (!recover()) return false;
+
+	m_flightsFd = fopen(path("flights.idx").c_str(), "ab");
+	m_pointsFd = fopen(path("points.idx").c_str(), "ab");
+	m_cellsFd = fopen(path("cells.idx").c_str(), "ab");
+	if (!m_flightsFd || !m_pointsFd || !m_cellsFd) {
+		if (m_flightsFd) fclose(m_flightsFd);
+		if (m_pointsFd) fclose(m_pointsFd);
+		if (m_cellsFd) fclose(m_cellsFd);
+		m_flightsFd = m_pointsFd = m_cellsFd = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool
+GeoIndex::isOpen() const
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_flightsFd != NULL;
+}
+
+void
+GeoIndex::close()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+
+	if (!m_flightsFd) return;
+	fclose(m_flightsFd);
+	fclose(m_pointsFd);
+	fclose(m_cellsFd);
+	m_flightsFd = m_pointsFd = m_cellsFd = NULL;
+}
+
+bool
+GeoIndex::addFlight(const char *serial, const std::vector<Point> &points)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const uint32_t id = m_flights;
+	std::vector<uint32_t> cells(points.size());
+	std::vector<uint32_t> order(points.size());
+	std::vector<Entry> entries;
+	FlightRecord flight;
+	size_t landing = 0;
+
+	if (!m_flightsFd || points.empty()) return false;
+
+	/* Points are stored grouped by cell, in chronological order within each cell */
+	for (size_t i=0; i<points.size(); i++) {
+		cells[i] = geohash(points[i].lat, points[i].lon);
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return cells[a] < cells[b]; });
+
+	for (size_t i=0; i<order.size(); i++) {
+		const Point &point = points[order[i]];
+		const PointRecord record = {point.time, point.lat, point.lon, point.alt, id};
+
+		if (fwrite(&record, sizeof(record), 1, m_pointsFd) != 1) return rollback();
+		if (order[i] == points.size() - 1) landing = i;
+
+		if (i == 0 || cells[order[i]] != cells[order[i-1]]) {
+			entries.push_back({(uint64_t)cells[order[i]] << 32 | id, point.time, point.time, m_points + i, 0, 0});
+		}
+		entries.back().tmin = std::min(entries.back().tmin, point.time);
+		entries.back().tmax = std::max(entries.back().tmax, point.time);
+		entries.back().count++;
+	}
+	entries.push_back({(uint64_t)cells[points.size() - 1] << 32 | id, points.back().time, points.back().time,
+	                   m_points + landing, 1, ENTRY_LANDING});
+
+	if (fflush(m_pointsFd)) return rollback();
+	if (fwrite(entries.data(), sizeof(Entry), entries.size(), m_cellsFd) != entries.size() || fflush(m_cellsFd)) {
+		return rollback();
+	}
+
+	/* The flight record goes last: it is what makes the flight part of the index */
+	memset(&flight, 0, sizeof(flight));
+	strncpy(flight.serial, serial, sizeof(flight.serial)-1);
+	flight.start = points.front().time;
+	flight.end = points.back().time;
+	flight.launchLat = points.front().lat;
+	flight.launchLon = points.front().lon;
+	flight.landingLat = points.back().lat;
+	flight.landingLon = points.back().lon;
+	flight.landingAlt = points.back().alt;
+	flight.maxAlt = points.front().alt;
+	for (const Point &point : points) flight.maxAlt = std::max(flight.maxAlt, point.alt);
+	flight.firstPoint = m_points;
+	flight.pointCount = points.size();
+	if (fwrite(&flight, sizeof(flight), 1, m_flightsFd) != 1 || fflush(m_flightsFd)) return rollback();
+
+	m_flights++;
+	m_points += points.size();
+	m_entries += entries.size();
+
+	if (m_entries - m_sorted > GEOINDEX_MAX_TAIL) compact();
+	return true;
+}
+
+bool
+GeoIndex::query(const Query &query, std::vector<Match> *dst)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	std::vector<std::pair<uint32_t, uint32_t>> ranges;
+	std::vector<int> best;
+	double minLat = query.minLat, maxLat = query.maxLat, minLon = query.minLon, maxLon = query.maxLon;
+	MappedFile cellsFile, pointsFile, flightsFile;
+	const Entry *entries;
+	const PointRecord *points;
+	const FlightRecord *flights;
+	int bits;
+
+	dst->clear();
+	if (!m_flightsFd) return false;
+	if (!m_flights) return true;
+
+	/* Bounding box of the search circle */
+	if (query.radius > 0) {
+		const double dlat = query.radius / (EARTH_RADIUS_KM * M_PI / 180);
+		const double coslat = cos(query.lat * M_PI / 180);
+
+		minLat = std::max(-90.0, query.lat - dlat);
+		maxLat = std::min(90.0, query.lat + dlat);
+		if (coslat > 1e-6 && dlat / coslat < 180 && maxLat < 90 && minLat > -90) {
+			minLon = std::max(-180.0, query.lon - dlat / coslat);
+			maxLon = std::min(180.0, query.lon + dlat / coslat);
+		} else {
+			minLon = -180;
+			maxLon = 180;
+		}
+	}
+
+	/* Cells covering the box, at the finest precision that keeps them few enough */
+	for (bits = GEOINDEX_CELL_BITS; bits > 0; bits--) {
+		const int lonBits = (bits + 1) / 2, latBits = bits / 2;
+		const uint64_t lonCells = cellIndex(maxLon, -180, 360, lonBits) - cellIndex(minLon, -180, 360, lonBits) + 1;
+		const uint64_t latCells = cellIndex(maxLat, -90, 180, latBits) - cellIndex(minLat, -90, 180, latBits) + 1;
+		if (lonCells * latCells <= MAX_QUERY_CELLS) break;
+	}
+	{
+		const int lonBits = (bits + 1) / 2, latBits = bits / 2;
+		for (uint32_t y = cellIndex(minLat, -90, 180, latBits); y <= cellIndex(maxLat, -90, 180, latBits); y++) {
+			for (uint32_t x = cellIndex(minLon, -180, 360, lonBits); x <= cellIndex(maxLon, -180, 360, lonBits); x++) {
+				const uint32_t prefix = interleave(x, lonBits, y, latBits);
+				ranges.push_back({prefix << (GEOINDEX_CELL_BITS - bits), (prefix + 1) << (GEOINDEX_CELL_BITS - bits)});
+			}
+		}
+	}
+
+	/* Coalesce adjacent cells into single ranges */
+	std::sort(ranges.begin(), ranges.end());
+	size_t n = 0;
+	for (size_t i=1; i<ranges.size(); i++) {
+		if (ranges[i].first <= ranges[n].second) {
+			ranges[n].second = std::max(ranges[n].second, ranges[i].second);
+		} else {
+			ranges[++n] = ranges[i];
+		}
+	}
+	ranges.resize(n + 1);
+
+	if (!cellsFile.open(path("cells.idx").c_str()) || !pointsFile.open(path("points.idx").c_str())
+	    || !flightsFile.open(path("flights.idx").c_str())) {
+		return true;
+	}
+	entries = (const Entry*)((const char*)cellsFile.data() + sizeof(CellsHeader));
+	points = (const PointRecord*)pointsFile.data();
+	flights = (const FlightRecord*)flightsFile.data();
+	if (cellsFile.size() < sizeof(CellsHeader) + m_entries * sizeof(Entry)
+	    || pointsFile.size() < m_points * sizeof(PointRecord)
+	    || flightsFile.size() < m_flights * sizeof(FlightRecord)) {
+		return false;
+	}
+
+	best.assign(m_flights, -1);
+	auto visit = [&](const Entry &entry) {
+		const uint32_t flight = entry.key & 0xFFFFFFFF;
+
+		if (flight >= m_flights || query.landings != !!(entry.flags & ENTRY_LANDING)) return;
+		if (entry.tmax < query.from || entry.tmin > query.to) return;
+		if (entry.first + entry.count > m_points) return;
+
+		for (uint64_t i = entry.first; i < entry.first + entry.count; i++) {
+			const PointRecord &point = points[i];
+			double dist = 0;
+
+			if (point.time < query.from || point.time > query.to) continue;
+			if (query.radius > 0) {
+				if ((dist = distance(query.lat, query.lon, point.lat, point.lon)) > query.radius) continue;
+			} else if (point.lat < minLat || point.lat > maxLat || point.lon < minLon || point.lon > maxLon) {
+				continue;
+			}
+
+			if (best[flight] < 0) {
+				best[flight] = dst->size();
+				dst->push_back({flight, "", flights[flight].start, flights[flight].end,
+				                {point.time, point.lat, point.lon, point.alt}, dist});
+				memcpy(dst->back().serial, flights[flight].serial, sizeof(dst->back().serial));
+			} else {
+				Match &match = (*dst)[best[flight]];
+				if (dist < match.distance || (dist == match.distance && point.time < match.point.time)) {
+					match.point = {point.time, point.lat, point.lon, point.alt};
+					match.distance = dist;
+				}
+			}
+		}
+	};
+
+	/* Sorted entries: one binary search per range */
+	for (const auto &range : ranges) {
+		const Entry *it = std::lower_bound(entries, entries + m_sorted, (uint64_t)range.first << 32,
+		                                   [](const Entry &entry, uint64_t key) { return entry.key < key; });
+		for (; it < entries + m_sorted && it->key < (uint64_t)range.second << 32; it++) visit(*it);
+	}
+
+	/* Recent flights, not merged yet */
+	for (const Entry *it = entries + m_sorted; it < entries + m_entries; it++) {
+		const uint32_t cell = it->key >> 32;
+		auto range = std::upper_bound(ranges.begin(), ranges.end(), cell,
+		                              [](uint32_t value, const std::pair<uint32_t, uint32_t> &r) { return value < r.first; });
+		if (range != ranges.begin() && cell < (--range)->second) visit(*it);
+	}
+
+	std::sort(dst->begin(), dst->end(), [](const Match &a, const Match &b) { return a.point.time < b.point.time; });
+	return true;
+}
+
+GeoIndex::Stats
+GeoIndex::stats()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Stats stats;
+
+	stats.flights = m_flights;
+	stats.points = m_points;
+	stats.entries = m_entries;
+	return stats;
+}
+
+/* Private methods {{{ */
+/* Drop whatever a crash left of an incomplete flight, and load the counts */
+bool
+GeoIndex::recover()
+{
+	const std::string flightsPath = path("flights.idx"), pointsPath = path("points.idx"), cellsPath = path("cells.idx");
+	std::error_code err;
+	CellsHeader header;
+	FlightRecord last;
+	Entry entry;
+	uint64_t size;
+	FILE *fd;
+
+	/* Flights */
+	size = fs::exists(flightsPath, err) ? fs::file_size(flightsPath, err) : 0;
+	m_flights = size / sizeof(FlightRecord);
+	m_points = 0;
+	if (m_flights) {
+		if (!(fd = fopen(flightsPath.c_str(), "rb"))) return false;
+		fseek(fd, (long)(m_flights - 1) * sizeof(FlightRecord), SEEK_SET);
+		if (fread(&last, sizeof(last), 1, fd) != 1) {
+			fclose(fd);
+			return false;
+		}
+		fclose(fd);
+		m_points = last.firstPoint + last.pointCount;
+	}
+	if (size != m_flights * sizeof(FlightRecord)) fs::resize_file(flightsPath, m_flights * sizeof(FlightRecord), err);
+
+	/* Points */
+	size = fs::exists(pointsPath, err) ? fs::file_size(pointsPath, err) : 0;
+	if (size < m_points * sizeof(PointRecord)) return false;
+	if (size != m_points * sizeof(PointRecord)) fs::resize_file(pointsPath, m_points * sizeof(PointRecord), err);
+
+	/* Cells: create the file if needed, then drop trailing entries of uncommitted flights */
+	if (!fs::exists(cellsPath, err) || fs::file_size(cellsPath, err) < sizeof(CellsHeader)) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CELLS_MAGIC, sizeof(header.magic));
+		header.entrySize = sizeof(Entry);
+		if (!(fd = fopen(cellsPath.c_str(), "wb"))) return false;
+		fwrite(&header, sizeof(header), 1, fd);
+		fclose(fd);
+	}
+
+	if (!(fd = fopen(cellsPath.c_str(), "rb"))) return false;
+	if (fread(&header, sizeof(header), 1, fd) != 1 || memcmp(header.magic, CELLS_MAGIC, sizeof(header.magic))
+	    || header.entrySize != sizeof(Entry)) {
+		fclose(fd);
+		return false;
+	}
+	m_entries = (fs::file_size(cellsPath, err) - sizeof(header)) / sizeof(Entry);
+	m_sorted = std::min(header.sorted, m_entries);
+	while (m_entries > m_sorted) {
+		fseek(fd, (long)(sizeof(header) + (m_entries - 1) * sizeof(Entry)), SEEK_SET);
+		if (fread(&entry, sizeof(entry), 1, fd) != 1 || (entry.key & 0xFFFFFFFF) < m_flights) break;
+		m_entries--;
+	}
+	fclose(fd);
+
+	if (fs::file_size(cellsPath, err) != sizeof(header) + m_entries * sizeof(Entry)) {
+		fs::resize_file(cellsPath, sizeof(header) + m_entries * sizeof(Entry), err);
+	}
+	return true;
+}
+
+/* Drop whatever part of a flight made it to the files, so that the next one
+ * does not land after a partial record; the index is closed if the files
+ * cannot be reopened. Always returns false, for the caller to pass on */
+bool
+GeoIndex::rollback()
+{
+	const std::string flightsPath = path("flights.idx"), pointsPath = path("points.idx"), cellsPath = path("cells.idx");
+	std::error_code err;
+
+	fclose(m_flightsFd);
+	fclose(m_pointsFd);
+	fclose(m_cellsFd);
+	m_flightsFd = m_pointsFd = m_cellsFd = NULL;
+
+	fs::resize_file(flightsPath, m_flights * sizeof(FlightRecord), err);
+	fs::resize_file(pointsPath, m_points * sizeof(PointRecord), err);
+	fs::resize_file(cellsPath, sizeof(CellsHeader) + m_entries * sizeof(Entry), err);
+
+	m_flightsFd = fopen(flightsPath.c_str(), "ab");
+	m_pointsFd = fopen(pointsPath.c_str(), "ab");
+	m_cellsFd = fopen(cellsPath.c_str(), "ab");
+	if (!m_flightsFd || !m_pointsFd || !m_cellsFd) {
+		if (m_flightsFd) fclose(m_flightsFd);
+		if (m_pointsFd) fclose(m_pointsFd);
+		if (m_cellsFd) fclose(m_cellsFd);
+		m_flightsFd = m_pointsFd = m_cellsFd = NULL;
+	}
+	return false;
+}
+
+/* Sort the whole cell index into a new file, and swap it in; the index is
+ * closed if the cell file cannot be reopened */
+bool
+GeoIndex::compact()
+{
+	const std::string cellsPath = path("cells.idx"), tmpPath = path("cells.idx.tmp");
+	std::vector<Entry> entries(m_entries);
+	std::error_code err;
+	CellsHeader header;
+	bool renamed;
+	FILE *fd;
+
+	if (!(fd = fopen(cellsPath.c_str(), "rb"))) return false;
+	if (fread(&header, sizeof(header), 1, fd) != 1 || fread(entries.data(), sizeof(Entry), m_entries, fd) != m_entries) {
+		fclose(fd);
+		return false;
+	}
+	fclose(fd);
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.key < b.key; });
+	header.sorted = m_entries;
+
+	if (!(fd = fopen(tmpPath.c_str(), "wb"))) return false;
+	if (fwrite(&header, sizeof(header), 1, fd) != 1 || fwrite(entries.data(), sizeof(Entry), m_entries, fd) != m_entries) {
+		fclose(fd);
+		fs::remove(tmpPath, err);
+		return false;
+	}
+	fclose(fd);
+
+	/* On failure, the old file is still in place and is reopened as it was */
+	fclose(m_cellsFd);
+	fs::rename(tmpPath, cellsPath, err);
+	renamed = !err;
+	if (renamed) m_sorted = m_entries;
+	else fs::remove(tmpPath, err);
+
+	if (!(m_cellsFd = fopen(cellsPath.c_str(), "ab"))) {
+		fclose(m_flightsFd);
+		fclose(m_pointsFd);
+		m_flightsFd = m_pointsFd = NULL;
+		return false;
+	}
+	return renamed;
+}
+
+std::string
+GeoIndex::path(const char *name) const
+{
+	return (fs::path(m_dir) / name).string();
+}
+/* }}} */
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define GEOINDEX_CELL_BITS 25       /* Geohash precision: 5 characters, about 4.9 x 4.9 km at the equator */
+#define GEOINDEX_MAX_TAIL 8192      /* Unsorted entries tolerated before the cell index is rewritten */
+
+/**
+ * Spatial and temporal index over the track points of archived flights. Every
+ * flight is stored in three append-only files in the archive directory:
+ *
+ * - points.idx: the track points, grouped by geohash cell;
+ * - cells.idx: one entry per flight and cell crossed, with the time span and
+ *   the range of points in that cell, plus one for the landing position. The
+ *   entries are kept sorted by (cell, flight), save for a short tail of recent
+ *   flights, so that a query only does one binary search per cell it covers;
+ * - flights.idx: serial number, time span, launch and landing positions.
+ *
+ * Flights are added in one go once complete, and only become visible to
+ * queries once their flights.idx record is written: a flight interrupted by a
+ * crash is discarded the next time the index is opened.
+ */
+class GeoIndex {
+public:
+	struct Point {
+		int64_t time;               /* UTC, seconds since the Unix epoch */
+		float lat, lon, alt;
+	};
+
+	/* Spatial and time window of a query. The default matches everything */
+	struct Query {
+		double minLat = -90, maxLat = 90;
+		double minLon = -180, maxLon = 180;
+		double lat = 0, lon = 0;    /* Center of the search circle, degrees */
+		double radius = 0;          /* Radius of the search circle, km, 0 to only use the box */
+		int64_t from = 0, to = INT64_MAX;
+		bool landings = false;      /* Only look at landing positions */
+	};
+
+	/* Flight matching a query, with its point closest to the center of the search circle */
+	struct Match {
+		uint32_t flight;
+		char serial[32];
+		int64_t start, end;
+		Point point;
+		double distance;            /* km from the center of the search circle, 0 for box queries */
+	};
+
+	struct Stats {
+		uint32_t flights;
+		uint64_t points, entries;
+	};
+
+	GeoIndex();
+	~GeoIndex();
+	GeoIndex(const GeoIndex&) = delete;
+	GeoIndex &operator=(const GeoIndex&) = delete;
+
+	/**
+	 * Open the index in a directory, creating it if necessary.
+	 *
+	 * @param dir path to the archive directory
+	 * @return true on success, false otherwise
+	 */
+	bool open(const char *dir);
+	void close();
+	bool isOpen() const;
+
+	/**
+	 * Add a complete flight.
+	 *
+	 * @param serial serial number of the sonde
+	 * @param points track points, in chronological order
+	 * @return true on success, false on I/O error or if points is empty
+	 */
+	bool addFlight(const char *serial, const std::vector<Point> &points);
+
+	/**
+	 * Find the flights with points inside a spatial and time window.
+	 *
+	 * @param query window
+	 * @param dst destination for the matches, one per flight, in chronological order
+	 * @return true on success, false if the index is not open
+	 */
+	bool query(const Query &query, std::vector<Match> *dst);
+
+	Stats stats();
+
+private:
+	struct Entry {
+		uint64_t key;               /* Geohash cell << 32 | flight */
+		int64_t tmin, tmax;
+		uint64_t first;             /* Index of the first point in points.idx */
+		uint32_t count;
+		uint32_t flags;
+	};
+	struct PointRecord {
+		int64_t time;
+		float lat, lon, alt;
+		uint32_t flight;
+	};
+	struct FlightRecord {
+		char serial[32];
+		int64_t start, end;
+		float launchLat, launchLon;
+		float landingLat, landingLon, landingAlt;
+		float maxAlt;
+		uint64_t firstPoint;
+		uint32_t pointCount;
+		uint32_t reserved;
+	};
+	struct CellsHeader {
+		char magic[8];
+		uint32_t entrySize;
+		uint32_t reserved;
+		uint64_t sorted;            /* Entries sorted by key, the rest are in insertion order */
+	};
+
+	bool recover();
+	bool rollback();
+	bool compact();
+	std::string path(const char *name) const;
+
+	mutable std::mutex m_mtx;
+	std::string m_dir;
+	FILE *m_flightsFd, *m_pointsFd, *m_cellsFd;
+	uint32_t m_flights;
+	uint64_t m_points, m_entries, m_sorted;
+};
@@ -1,10 +1,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
-#include <ctype.h>
+#include <algorithm>
+#include <string>
 #include "gpx.hpp"
+#include "utils.hpp"
 
 #define GPX_TIME_FORMAT "%Y-%m-%dT%H:%M:%SZ"
+#define GPX_RESUME_WINDOW 65536  /* Bytes from the end of the file searched for the trailer */
 
 bool
 GPXWriter::init(const char *fname)
@@ -26,6 +29,75 @@ GPXWriter::init(const char *fname)
 	return true;
 }
 
+bool
+GPXWriter::resume(const char *fname, const State &state)
+{
+	const char *marker = state.trackActive ? "</trkseg>" : "</gpx>";
+	std::string tail;
+	size_t pos, trkpt;
+	long size, start;
+	int year, month, day, hour, min, sec;
+	float lat, lon, alt;
+
+	if (m_fd) deinit();
+
+	m_fd = fopen(fname, "r+b");
+	if (!m_fd) return false;
+
+	/* Points are flushed as they come, so the file is usually ahead of the
+	 * checkpoint; the trailer is always at the end though. Look for the last
+	 * one past the saved offset, and pick up from there */
+	if (fseek(m_fd, 0, SEEK_END) || (size = ftell(m_fd)) < 0 || (uint64_t)size < state.offset) {
+		fclose(m_fd);
+		m_fd = NULL;
+		return false;
+	}
+	start = std::max((long)state.offset, size - GPX_RESUME_WINDOW);
+	tail.resize(size - start);
+	if (fseek(m_fd, start, SEEK_SET) || fread(&tail[0], 1, tail.size(), m_fd) != tail.size()
+	    || (pos = tail.rfind(marker)) == std::string::npos) {
+		fclose(m_fd);
+		m_fd = NULL;
+		return false;
+	}
+
+	m_offset = start + pos;
+	m_trackActive = state.trackActive;
+	m_serial = SerialTable::shared().intern(std::string(state.serial, strnlen(state.serial, sizeof(state.serial))).c_str());
+	m_lat = state.lat;
+	m_lon = state.lon;
+	m_alt = state.alt;
+	m_time = state.time;
+
+	/* Points written after the checkpoint: the last one is the reference for
+	 * the duplicate check, not the one saved in the state */
+	trkpt = tail.rfind("<trkpt ", pos);
+	if (trkpt != std::string::npos
+	    && sscanf(tail.c_str() + trkpt, "<trkpt lat=\"%f\" lon=\"%f\">\n<time>%d-%d-%dT%d:%d:%dZ</time>\n<ele>%f</ele>",
+	              &lat, &lon, &year, &month, &day, &hour, &min, &sec, &alt) == 9) {
+		m_lat = lat;
+		m_lon = lon;
+		m_alt = alt;
+		m_time = utc_time(year, month, day, hour, min, sec);
+	}
+
+	terminateFile();
+	return true;
+}
+
+void
+GPXWriter::getState(State *dst) const
+{
+	dst->offset = m_offset;
+	dst->trackActive = m_trackActive;
+	strncpy(dst->serial, serial_name(m_serial).c_str(), sizeof(dst->serial)-1);
+	dst->serial[sizeof(dst->serial)-1] = '\0';
+	dst->lat = m_lat;
+	dst->lon = m_lon;
+	dst->alt = m_alt;
+	dst->time = m_time;
+}
+
 void
 GPXWriter::deinit()
 {
@@ -36,20 +108,19 @@ GPXWriter::deinit()
 }
 
 void
-GPXWriter::startTrack(const char *name)
+GPXWriter::startTrack(SerialId serial)
 {
-	if (!m_fd) return;
-	if (m_trackActive && !strcmp(name, sondeSerial)) return;
-	for (int i=0; name[i] != '\0'; i++) if (!isgraph(name[i])) return;
+	if (!m_fd || !serial) return;
+	if (m_trackActive && serial == m_serial) return;
 
 	if (m_trackActive) {
 		stopTrack();
 	}
 
-	strncpy(sondeSerial, name, sizeof(sondeSerial)-1);
+	m_serial = serial;
 
 	fseek(m_fd, m_offset, SEEK_SET);
-	fprintf(m_fd, "<trk>\n<name>%s</name>\n<trkseg>\n", name);
+	fprintf(m_fd, "<trk>\n<name>%s</name>\n<trkseg>\n", serial_name(serial).c_str());
 	m_offset = ftell(m_fd);
 	m_trackActive = true;
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
+#include "serials.hpp"
 
 /**
  * Wrapper around a GPX file. Will take care of terminating the file properly
@@ -10,20 +12,45 @@
 
 class GPXWriter {
 public:
-	GPXWriter() { m_fd = NULL; };
+	/* Position within the file, enough to pick up where a previous writer left */
+	struct State {
+		uint64_t offset;
+		uint8_t trackActive;
+		char serial[64];
+		float lat, lon, alt;
+		int64_t time;
+	};
+
+	GPXWriter() { m_fd = NULL; m_serial = 0; };
 	~GPXWriter() { deinit(); };
 
 	bool init(const char *fname);
 	void deinit();
 
 	/**
-	 * Start a new GPX track with a given name. If a track with the same name
+	 * Reopen a file previously written by another writer, and keep appending to
+	 * it as if it never was closed.
+	 *
+	 * @param fname path to the file
+	 * @param state state of the previous writer, as returned by getState()
+	 * @return true on success, false if the file does not match the state
+	 */
+	bool resume(const char *fname, const State &state);
+	void getState(State *dst) const;
+
+	/**
+	 * Start a new GPX track named after a sonde. If the track of the same sonde
 	 * is already being updated, this method has no effect. On the other hand,
-	 * if a track is being updated but has a different name, it will be terminated
+	 * if a track is being updated for a different sonde, it will be terminated
 	 * 
-	 * @param name name of the new track.
+	 * @param serial serial number of the sonde, already validated by the table
+	 */
+	void startTrack(SerialId serial);
+
+	/**
+	 * @return true if the track of a sonde is being updated
 	 */
-	void startTrack(const char *name);
+	bool isTracking(SerialId serial) const { return m_trackActive && m_serial == serial; }
 
 	/**
 	 * Terminate a track. If no track is being recorded, this method has no effect
@@ -49,7 +76,7 @@ private:
 	FILE *m_fd;
 	unsigned long m_offset;
 	bool m_trackActive;
-	char sondeSerial[64];
+	SerialRef m_serial;
 
 	float m_lat, m_lon, m_alt;
 	time_t m_time;
@@ -0,0 +1,233 @@
+#include <math.h>
+#include <string.h>
+#include "grib2.hpp"
+#include "utils.hpp"
+
+#define GRIB_SEC0_LEN 16
+#define GRIB_MISSING32 0xFFFFFFFF
+
+static uint16_t be16(const uint8_t *p) { return p[0] << 8 | p[1]; }
+static uint32_t be32(const uint8_t *p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static uint64_t be64(const uint8_t *p) { return (uint64_t)be32(p) << 32 | be32(p + 4); }
+
+/* GRIB2 signed integers are sign-magnitude, not two's complement */
+static int8_t sm8(const uint8_t *p) { return (p[0] & 0x80) ? -(p[0] & 0x7F) : p[0]; }
+static int16_t sm16(const uint8_t *p) { const uint16_t v = be16(p); return (v & 0x8000) ? -(int16_t)(v & 0x7FFF) : v; }
+static int32_t sm32(const uint8_t *p) { const uint32_t v = be32(p); return (v & 0x80000000) ? -(int32_t)(v & 0x7FFFFFFF) : v; }
+
+static float
+ieee32(const uint8_t *p)
+{
+	const uint32_t v = be32(p);
+	float f;
+	memcpy(&f, &v, sizeof(f));
+	return f;
+}
+
+static int
+time_unit_seconds(int unit)
+{
+	switch (unit) {
+	case 0: return 60;
+	case 1: return 3600;
+	case 2: return 86400;
+	case 10: return 3 * 3600;
+	case 11: return 6 * 3600;
+	case 12: return 12 * 3600;
+	case 13: return 1;
+	default: return 0;
+	}
+}
+
+static bool
+parse_grid(const uint8_t *sec, uint32_t len, GribGrid *grid)
+{
+	uint32_t basicAngle, subdivisions, di, dj;
+	double unit;
+	int scan;
+
+	/* Template 3.0: regular latitude/longitude grid */
+	if (len < 72 || be16(sec + 12) != 0) return false;
+
+	grid->ni = be32(sec + 30);
+	grid->nj = be32(sec + 34);
+	basicAngle = be32(sec + 38);
+	subdivisions = be32(sec + 42);
+	unit = (basicAngle == 0 || basicAngle == GRIB_MISSING32 || !subdivisions) ? 1e-6 : (double)basicAngle / subdivisions;
+
+	grid->lat0 = sm32(sec + 46) * unit;
+	grid->lon0 = sm32(sec + 50) * unit;
+	di = be32(sec + 63);
+	dj = be32(sec + 67);
+	scan = sec[71];
+
+	/* Column-major and boustrophedonic layouts are not supported */
+	if (di == GRIB_MISSING32 || dj == GRIB_MISSING32 || (scan & 0x30)) return false;
+	if (grid->ni <= 0 || grid->nj <= 0) return false;
+
+	grid->dlon = di * unit * ((scan & 0x80) ? -1 : 1);
+	grid->dlat = dj * unit * ((scan & 0x40) ? 1 : -1);
+	return true;
+}
+
+static bool
+parse_product(const uint8_t *sec, uint32_t len, time_t refTime, GribField *field)
+{
+	int unitSeconds;
+
+	/* Template 4.0: analysis or forecast at a horizontal level, at a point in time */
+	if (len < 34 || be16(sec + 7) != 0) return false;
+
+	field->category = sec[9];
+	field->number = sec[10];
+	if (!(unitSeconds = time_unit_seconds(sec[17]))) return false;
+	field->refTime = refTime;
+	field->validTime = refTime + (time_t)be32(sec + 18) * unitSeconds;
+	field->levelType = sec[22];
+	field->level = be32(sec + 24) * pow(10, -sm8(sec + 23));
+	return true;
+}
+
+static bool
+unpack_simple(const uint8_t *data, size_t len, const uint8_t *bitmap, float ref, int binScale, int decScale,
+              int nbits, size_t npoints, std::vector<float> *dst)
+{
+	const double binFactor = ldexp(1.0, binScale);
+	const double decFactor = pow(10, -decScale);
+	uint64_t acc = 0;
+	int accBits = 0;
+	size_t offset = 0;
+
+	if (nbits > 32) return false;
+	dst->resize(npoints);
+
+	for (size_t i=0; i<npoints; i++) {
+		uint32_t x = 0;
+
+		if (bitmap && !(bitmap[i >> 3] & (0x80 >> (i & 7)))) {
+			(*dst)[i] = NAN;
+			continue;
+		}
+
+		if (nbits) {
+			while (accBits < nbits) {
+				if (offset >= len) return false;
+				acc = acc << 8 | data[offset++];
+				accBits += 8;
+			}
+			x = (acc >> (accBits - nbits)) & (((uint64_t)1 << nbits) - 1);
+			accBits -= nbits;
+		}
+
+		(*dst)[i] = (ref + x * binFactor) * decFactor;
+	}
+
+	return true;
+}
+
+int
+grib2_decode(const uint8_t *data, size_t len, bool (*wanted)(const GribField &field), std::vector<GribField> *dst)
+{
+	size_t pos = 0;
+	int count = 0;
+
+	while (pos + GRIB_SEC0_LEN <= len) {
+		const uint8_t *msg = data + pos;
+		const uint8_t *sec, *end, *bitmap = NULL;
+		uint64_t msgLen;
+		GribField field;
+		time_t refTime = 0;
+		bool gridOk = false, productOk = false, packingOk = false, bitmapOk = true;
+		float ref = 0;
+		int binScale = 0, decScale = 0, nbits = 0;
+
+		if (memcmp(msg, "GRIB", 4)) {
+			pos++;
+			continue;
+		}
+
+		msgLen = be64(msg + 8);
+		if (msg[7] != 2 || msgLen < GRIB_SEC0_LEN || msgLen > len - pos) {
+			pos += 4;
+			continue;
+		}
+
+		field.discipline = msg[6];
+		end = msg + msgLen;
+
+		/* Sections 2 to 7 may repeat within a message, one field per section 7 */
+		for (sec = msg + GRIB_SEC0_LEN; sec + 5 <= end && memcmp(sec, "7777", 4); ) {
+			const uint32_t secLen = be32(sec);
+			if (secLen < 5 || secLen > (size_t)(end - sec)) break;
+
+			switch (sec[4]) {
+			case 1:
+				if (secLen >= 19) {
+					refTime = utc_time(be16(sec + 12), sec[14], sec[15], sec[16], sec[17], sec[18]);
+				}
+				break;
+			case 3:
+				gridOk = parse_grid(sec, secLen, &field.grid);
+				break;
+			case 4:
+				productOk = parse_product(sec, secLen, refTime, &field);
+				break;
+			case 5:
+				/* Template 5.0: simple packing */
+				packingOk = secLen >= 21 && be16(sec + 9) == 0;
+				if (packingOk) {
+					ref = ieee32(sec + 11);
+					binScale = sm16(sec + 15);
+					decScale = sm16(sec + 17);
+					nbits = sec[19];
+				}
+				break;
+			case 6:
+				switch (sec[5]) {
+				case 0:
+					bitmap = sec + 6;
+					bitmapOk = true;
+					break;
+				case 254:
+					/* Reuse the previous bitmap */
+					break;
+				case 255:
+					bitmap = NULL;
+					bitmapOk = true;
+					break;
+				default:
+					bitmapOk = false;
+					break;
+				}
+				break;
+			case 7:
+				if (!gridOk || !productOk || !packingOk || !bitmapOk) break;
+				if (wanted && !wanted(field)) break;
+				if (bitmap && (size_t)(end - bitmap) * 8 < (size_t)field.grid.ni * field.grid.nj) break;
+
+				if (unpack_simple(sec + 5, secLen - 5, bitmap, ref, binScale, decScale, nbits,
+				                  (size_t)field.grid.ni * field.grid.nj, &field.values)) {
+					dst->push_back(field);
+					count++;
+				}
+				break;
+			default:
+				break;
+			}
+
+			sec += secLen;
+		}
+
+		pos += msgLen;
+	}
+
+	return count;
+}
+
+bool
+GribGrid::operator==(const GribGrid &other) const
+{
+	return ni == other.ni && nj == other.nj
+	    && fabs(lat0 - other.lat0) < 1e-6 && fabs(lon0 - other.lon0) < 1e-6
+	    && fabs(dlat - other.dlat) < 1e-6 && fabs(dlon - other.dlon) < 1e-6;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#define GRIB_DISCIPLINE_METEO 0
+#define GRIB_CATEGORY_MOMENTUM 2
+#define GRIB_PARAM_UGRD 2
+#define GRIB_PARAM_VGRD 3
+#define GRIB_LEVEL_ISOBARIC 100
+
+/* Regular latitude/longitude grid, normalized so that i varies fastest */
+struct GribGrid {
+	int ni, nj;
+	double lat0, lon0;          /* First grid point, degrees */
+	double dlat, dlon;          /* Signed increments, degrees */
+
+	bool operator==(const GribGrid &other) const;
+};
+
+struct GribField {
+	int discipline, category, number;
+	int levelType;
+	double level;               /* In the level type's units (Pa for isobaric surfaces) */
+	time_t refTime, validTime;
+	GribGrid grid;
+	std::vector<float> values;  /* NaN where the bitmap says no data */
+};
+
+/**
+ * Minimal GRIB2 decoder. Only regular lat/lon grids (template 3.0), instantaneous
+ * products (template 4.0) and simple packing (template 5.0) are supported: other
+ * fields are silently skipped.
+ *
+ * @param data GRIB2 file contents
+ * @param len length of the data, in bytes
+ * @param wanted predicate called on each field before unpacking its values; only
+ *        fields for which it returns true are decoded and appended to dst
+ * @param dst vector to append decoded fields to
+ * @return number of decoded fields
+ */
+int grib2_decode(const uint8_t *data, size_t len, bool (*wanted)(const GribField &field), std::vector<GribField> *dst);
@@ -0,0 +1,216 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http.hpp"
+#include "udp.hpp"
+
+#ifdef _WIN32
+#define INVALID_FD INVALID_SOCKET
+#define close_socket closesocket
+#define poll WSAPoll
+typedef WSAPOLLFD pollfd_t;
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#define INVALID_FD -1
+#define close_socket ::close
+typedef struct pollfd pollfd_t;
+#endif
+
+/* Never raise SIGPIPE if the server closes the connection early */
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#define HTTP_DEFAULT_PORT 80
+#define HTTP_MAX_HEADER 1024
+
+static bool
+wait_socket(udp_socket_t fd, short events, int timeoutMs)
+{
+	pollfd_t pfd;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	return poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & events);
+}
+
+static bool
+set_nonblocking(udp_socket_t fd)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	return !ioctlsocket(fd, FIONBIO, &mode);
+#else
+	const int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && !fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static bool
+in_progress()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EINPROGRESS || errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* Open a TCP connection, giving up after timeoutMs */
+static udp_socket_t
+tcp_connect(const char *host, int port, int timeoutMs)
+{
+	struct addrinfo hints, *res, *ai;
+	udp_socket_t fd = INVALID_FD;
+	char service[8];
+	int err;
+	socklen_t errlen;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%d", port);
+	if (getaddrinfo(host, service, &hints, &res)) return INVALID_FD;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == INVALID_FD) continue;
+#ifdef SO_NOSIGPIPE
+		const int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+		if (set_nonblocking(fd)) {
+			if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+
+			errlen = sizeof(err);
+			if (in_progress() && wait_socket(fd, POLLOUT, timeoutMs)
+			    && !getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&err, &errlen) && !err) {
+				break;
+			}
+		}
+
+		close_socket(fd);
+		fd = INVALID_FD;
+	}
+
+	freeaddrinfo(res);
+	return fd;
+}
+
+static bool
+send_all(udp_socket_t fd, const char *buf, size_t len, int timeoutMs)
+{
+	int ret;
+
+	while (len > 0) {
+		if (!wait_socket(fd, POLLOUT, timeoutMs)) return false;
+		if ((ret = ::send(fd, buf, len, SEND_FLAGS)) < 0) {
+			if (in_progress()) continue;
+			return false;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return true;
+}
+
+HttpClient::HttpClient()
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	m_port = HTTP_DEFAULT_PORT;
+}
+
+HttpClient::~HttpClient()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+bool
+HttpClient::setUrl(const char *url)
+{
+	const char *authority, *path;
+	std::string hostPort;
+
+	if (strncmp(url, "http://", 7)) return false;
+	authority = url + 7;
+	path = strchr(authority, '/');
+	if (!path) path = authority + strcspn(authority, "?");
+
+	hostPort = std::string(authority, path - authority);
+	if (hostPort.empty()) return false;
+
+	/* The port is optional, and IPv6 literals are enclosed in brackets */
+	m_port = HTTP_DEFAULT_PORT;
+	if (hostPort.front() == '[') {
+		const size_t end = hostPort.find(']');
+		if (end == std::string::npos) return false;
+		m_host = hostPort.substr(1, end - 1);
+		if (end + 1 < hostPort.size()) {
+			if (hostPort[end + 1] != ':') return false;
+			m_port = atoi(hostPort.c_str() + end + 2);
+		}
+	} else {
+		const size_t colon = hostPort.find(':');
+		m_host = hostPort.substr(0, colon);
+		if (colon != std::string::npos) m_port = atoi(hostPort.c_str() + colon + 1);
+	}
+	if (m_port <= 0 || m_port > 65535) return false;
+
+	m_path = *path == '/' ? path : std::string("/") + path;
+	return !m_host.empty();
+}
+
+int
+HttpClient::post(const char *body, size_t len, const char *contentType, int timeoutMs)
+{
+	char header[HTTP_MAX_HEADER], response[128];
+	size_t received = 0;
+	const bool ipv6 = m_host.find(':') != std::string::npos;
+	int headerLen, ret, status = -1;
+	udp_socket_t fd;
+
+	if (m_host.empty()) return -1;
+
+	headerLen = snprintf(header, sizeof(header),
+	                     "POST %s HTTP/1.1\r\n"
+	                     "Host: %s%s%s:%d\r\n"
+	                     "Content-Type: %s\r\n"
+	                     "Content-Length: %zu\r\n"
+	                     "%s%s%s"
+	                     "Connection: close\r\n"
+	                     "\r\n",
+	                     m_path.c_str(), ipv6 ? "[" : "", m_host.c_str(), ipv6 ? "]" : "", m_port, contentType, len,
+	                     m_auth.empty() ? "" : "Authorization: ", m_auth.c_str(), m_auth.empty() ? "" : "\r\n");
+	if (headerLen < 0 || headerLen >= (int)sizeof(header)) return -1;
+
+	if ((fd = tcp_connect(m_host.c_str(), m_port, timeoutMs)) == INVALID_FD) return -1;
+
+	if (send_all(fd, header, headerLen, timeoutMs) && send_all(fd, body, len, timeoutMs)) {
+		/* Only the status line matters */
+		while (received < sizeof(response) - 1 && wait_socket(fd, POLLIN, timeoutMs)) {
+			ret = ::recv(fd, response + received, sizeof(response) - 1 - received, 0);
+			if (ret < 0 && in_progress()) continue;
+			if (ret <= 0) break;
+			received += ret;
+			response[received] = '\0';
+			if (strstr(response, "\r\n")) break;
+		}
+		response[received] = '\0';
+		if (!strncmp(response, "HTTP/1.", 7) && strlen(response) >= 12) status = atoi(response + 9);
+	}
+
+	close_socket(fd);
+	return status;
+}
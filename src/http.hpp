@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * Minimal blocking HTTP/1.1 client, enough to POST to a service on the local
+ * network. Plain HTTP only; one connection per request.
+ */
+class HttpClient {
+public:
+	HttpClient();
+	~HttpClient();
+
+	/**
+	 * Set the target of the requests.
+	 *
+	 * @param url target, as http://host[:port][/path][?query]
+	 * @return true on success, false if the URL is malformed
+	 */
+	bool setUrl(const char *url);
+
+	/**
+	 * Set the value of the Authorization header.
+	 *
+	 * @param value header value, or an empty string to omit the header
+	 */
+	void setAuthorization(const char *value) { m_auth = value; }
+
+	/**
+	 * Send a POST request.
+	 *
+	 * @param body request body
+	 * @param len length of the body
+	 * @param contentType MIME type of the body
+	 * @param timeoutMs maximum time to wait for each step of the exchange
+	 * @return HTTP status code, or -1 if no response was received
+	 */
+	int post(const char *body, size_t len, const char *contentType, int timeoutMs);
+
+private:
+	std::string m_host, m_path, m_auth;
+	int m_port;
+};
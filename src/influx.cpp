@@ -0,0 +1,560 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+#include "influx.hpp"
+#include "memory.hpp"
+
+#define POINT_QUEUE_SIZE 256
+#define IDLE_TIMEOUT_MS 200
+#define INFLUX_MAX_LINE 1024        /* Longest line rendered, bytes */
+#define INFLUX_UDP_PAYLOAD 1400     /* Largest datagram that avoids fragmentation on most links */
+#define INFLUX_TIMEOUT_MS 1000      /* Timeout for each step of an HTTP exchange */
+#define INFLUX_REPLAY_CHUNKS 64     /* Spilled batches replayed per flush, at most */
+#define INFLUX_SPILL_COMPACT_RATIO 4  /* Compact once 1/N of the spill limit was delivered */
+
+namespace fs = std::filesystem;
+
+/* Fixed-size buffer holding a single line of line protocol {{{ */
+namespace {
+	struct Line {
+		char *buf;
+		int size, len;
+		bool hasFields;
+
+		Line(char *dst, size_t avail) {
+			buf = dst;
+			size = std::min(avail, (size_t)INFLUX_MAX_LINE);
+			len = 0;
+			hasFields = false;
+		}
+
+		void raw(const char *fmt, ...);
+
+		/* Tag keys and values: escape the characters that delimit them */
+		void tag(const char *key, const char *value) {
+			raw(",%s=", key);
+			for (; *value && len < size; value++) {
+				if (*value == ',' || *value == '=' || *value == ' ') raw("\\");
+				raw("%c", *value);
+			}
+		}
+
+		void field(const char *key, double value, int decimals) {
+			if (!isfinite(value)) return;
+			raw("%c%s=%.*f", hasFields ? ',' : ' ', key, decimals, value);
+			hasFields = true;
+		}
+
+		void field(const char *key, int64_t value) {
+			raw("%c%s=%lldi", hasFields ? ',' : ' ', key, (long long)value);
+			hasFields = true;
+		}
+
+		void field(const char *key, bool value) {
+			raw("%c%s=%c", hasFields ? ',' : ' ', key, value ? 't' : 'f');
+			hasFields = true;
+		}
+
+		/* Terminate the line. Returns its length, or 0 if it did not fit */
+		int end(int64_t timestamp) {
+			if (!hasFields) return 0;
+			raw(" %lld000000000\n", (long long)timestamp);
+			return len < size ? len : 0;
+		}
+	};
+
+	void
+	Line::raw(const char *fmt, ...)
+	{
+		va_list ap;
+
+		if (len >= size) return;
+		va_start(ap, fmt);
+		len += vsnprintf(buf + len, size - len, fmt, ap);
+		va_end(ap);
+	}
+}
+/* }}} */
+
+static size_t
+count_lines(const char *buf, size_t len)
+{
+	return std::count(buf, buf + len, '\n');
+}
+
+/* Length of the data up to and including the last complete line, 0 if there is none */
+static size_t
+whole_lines(const char *buf, size_t len)
+{
+	while (len > 0 && buf[len - 1] != '\n') len--;
+	return len;
+}
+
+InfluxSink::InfluxSink() : m_points(POINT_QUEUE_SIZE)
+{
+	m_running = false;
+	m_useUdp = false;
+	m_batchLen = 0;
+	m_spill = NULL;
+	m_spillRead = 0;
+	m_memory = NULL;
+	m_linesSent = m_bytesSent = m_framesDropped = m_linesDropped = m_spillBytes = 0;
+	m_lastStatus = 0;
+	m_config = defaultConfig();
+}
+
+InfluxSink::~InfluxSink()
+{
+	stop();
+}
+
+InfluxSink::Config
+InfluxSink::defaultConfig()
+{
+	Config config;
+
+	config.url = "http://localhost:8086/write?db=radiosonde";
+	config.batchBytes = 16 << 10;
+	config.flushIntervalMs = 10000;
+	config.spillLimit = 16 << 20;
+	return config;
+}
+
+bool
+InfluxSink::start(const Config &config)
+{
+	std::string host;
+	int port;
+
+	if (m_running) return true;
+
+	m_config = config;
+	m_config.batchBytes = std::max(m_config.batchBytes, (size_t)INFLUX_MAX_LINE);
+	m_config.flushIntervalMs = std::max(m_config.flushIntervalMs, IDLE_TIMEOUT_MS);
+
+	m_useUdp = !m_config.url.compare(0, 6, "udp://");
+	if (m_useUdp) {
+		if (!split_host_port(m_config.url.c_str() + 6, &host, &port) || !m_udp.connect(host.c_str(), port)) return false;
+	} else {
+		if (!m_http.setUrl(m_config.url.c_str())) return false;
+		m_http.setAuthorization(m_config.token.c_str());
+	}
+
+	/* Room for a full batch, plus the lines rendered before noticing it is full */
+	m_batch.resize(m_config.batchBytes + (m_stages.size() + 3) * INFLUX_MAX_LINE);
+	m_replay.resize(m_batch.size());
+	m_batchLen = 0;
+
+	openSpill(false);
+
+	m_running = true;
+	m_thread = std::thread(&InfluxSink::worker, this);
+	return true;
+}
+
+void
+InfluxSink::stop()
+{
+	if (!m_running) return;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+
+	if (m_spill) fclose(m_spill);
+	m_spill = NULL;
+	m_udp.close();
+}
+
+void
+InfluxSink::addStage(const radiosonde::PerfStage *stage)
+{
+	if (m_running) return;
+	m_stages.push_back(stage);
+}
+
+void
+InfluxSink::setMemoryAccount(const MemoryAccount *account)
+{
+	if (m_running) return;
+	m_memory = account;
+}
+
+void
+InfluxSink::addFrame(const SondeFullData &data)
+{
+	Point point;
+
+	strncpy(point.serial, serial_name(data.serial).c_str(), sizeof(point.serial)-1);
+	point.serial[sizeof(point.serial)-1] = '\0';
+	point.seq = data.seq;
+	point.time = data.time;
+	point.burstkill = data.burstkill;
+	point.lat = data.lat;
+	point.lon = data.lon;
+	point.alt = data.alt;
+	point.spd = data.spd;
+	point.hdg = data.hdg;
+	point.climb = data.climb;
+	point.temp = data.temp;
+	point.rh = data.rh;
+	point.dewpt = data.dewpt;
+	point.pressure = data.pressure;
+	point.calibrated = data.calibrated;
+
+	/* No lock here: the worker polls the queue if it misses the notification */
+	if (m_points.push(point)) {
+		m_cv.notify_one();
+	} else {
+		m_framesDropped++;
+	}
+}
+
+InfluxSink::Stats
+InfluxSink::stats() const
+{
+	Stats stats;
+
+	stats.linesSent = m_linesSent;
+	stats.bytesSent = m_bytesSent;
+	stats.framesDropped = m_framesDropped;
+	stats.linesDropped = m_linesDropped;
+	stats.spillBytes = m_spillBytes;
+	stats.lastStatus = m_lastStatus;
+	return stats;
+}
+
+size_t
+InfluxSink::memoryUsage() const
+{
+	/* The batches are only resized by start() */
+	return m_points.capacity() * sizeof(Point) + m_batch.capacity() + m_replay.capacity();
+}
+
+/* Private methods {{{ */
+void
+InfluxSink::worker()
+{
+	std::chrono::steady_clock::time_point nextFlush;
+	Point point;
+
+	nextFlush = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config.flushIntervalMs);
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lck(m_mtx);
+			m_cv.wait_for(lck, std::chrono::milliseconds(IDLE_TIMEOUT_MS),
+			              [this]{ return !m_running || m_points.size() > 0; });
+			if (!m_running) break;
+		}
+
+		while (m_points.pop(&point)) {
+			render(point);
+			if (m_batchLen >= m_config.batchBytes) flush();
+		}
+
+		if (std::chrono::steady_clock::now() >= nextFlush) {
+			renderMetrics();
+			flush();
+			nextFlush = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config.flushIntervalMs);
+		}
+	}
+
+	/* Keep whatever is left for the next run, without waiting for the network */
+	while (m_points.pop(&point)) {
+		render(point);
+		if (m_batchLen >= m_config.batchBytes) {
+			spill(m_batch.data(), m_batchLen);
+			m_batchLen = 0;
+		}
+	}
+	spill(m_batch.data(), m_batchLen);
+	m_batchLen = 0;
+}
+
+void
+InfluxSink::render(const Point &point)
+{
+	Line line(m_batch.data() + m_batchLen, m_batch.size() - m_batchLen);
+	const int64_t now = time(NULL);
+
+	line.raw("radiosonde");
+	if (!m_config.station.empty()) line.tag("station", m_config.station.c_str());
+	if (point.serial[0]) line.tag("serial", point.serial);
+
+	line.field("seq", (int64_t)point.seq);
+	line.field("lat", point.lat, 6);
+	line.field("lon", point.lon, 6);
+	line.field("alt", point.alt, 1);
+	line.field("spd", point.spd, 2);
+	line.field("hdg", point.hdg, 1);
+	line.field("climb", point.climb, 2);
+	line.field("temp", point.temp, 2);
+	line.field("rh", point.rh, 1);
+	line.field("dewpt", point.dewpt, 2);
+	line.field("pressure", point.pressure, 2);
+	line.field("burstkill", (int64_t)point.burstkill);
+	line.field("calibrated", point.calibrated);
+
+	/* Fall back to the time of reception if the sonde does not know the time yet */
+	m_batchLen += line.end(point.time > 0 ? (int64_t)point.time : now);
+}
+
+void
+InfluxSink::renderMetrics()
+{
+	const int64_t now = time(NULL);
+
+	{
+		Line line(m_batch.data() + m_batchLen, m_batch.size() - m_batchLen);
+		line.raw("radiosonde_sink");
+		if (!m_config.station.empty()) line.tag("station", m_config.station.c_str());
+		line.field("lines_sent", (int64_t)m_linesSent.load());
+		line.field("frames_dropped", (int64_t)m_framesDropped.load());
+		line.field("lines_dropped", (int64_t)m_linesDropped.load());
+		line.field("spill_bytes", (int64_t)m_spillBytes.load());
+		m_batchLen += line.end(now);
+	}
+
+	for (const radiosonde::PerfStage *stage : m_stages) {
+		if (!stage->enabled || !stage->available()) continue;
+
+		const radiosonde::PerfStage::Snapshot snap = stage->snapshot();
+		Line line(m_batch.data() + m_batchLen, m_batch.size() - m_batchLen);
+		line.raw("radiosonde_stage");
+		if (!m_config.station.empty()) line.tag("station", m_config.station.c_str());
+		line.tag("stage", stage->name);
+		line.field("samples", (int64_t)snap.samples);
+		line.field("buffers", (int64_t)snap.buffers);
+		line.field("cycles_per_sample", snap.perSample(radiosonde::PERF_CYCLES), 2);
+		line.field("ipc", snap.ipc(), 3);
+		line.field("max_cycles_per_sample", snap.maxCyclesPerSample, 2);
+		m_batchLen += line.end(now);
+	}
+
+	if (m_memory) {
+		const MemoryAccount::Snapshot snap = m_memory->snapshot();
+		Line line(m_batch.data() + m_batchLen, m_batch.size() - m_batchLen);
+		line.raw("radiosonde_memory");
+		if (!m_config.station.empty()) line.tag("station", m_config.station.c_str());
+		for (int i=0; i<MemoryAccount::MEM_COMPONENTS; i++) {
+			if (!MemoryAccount::measurable((MemoryAccount::Component)i)) continue;
+			line.field(MemoryAccount::componentKey((MemoryAccount::Component)i), (int64_t)snap.bytes[i]);
+		}
+		line.field("total", (int64_t)snap.total);
+		line.field("budget", (int64_t)snap.budget);
+		line.field("trims", (int64_t)snap.trims);
+		line.field("trimmed", (int64_t)snap.trimmed);
+		m_batchLen += line.end(now);
+	}
+}
+
+void
+InfluxSink::flush()
+{
+	if (!m_batchLen) return;
+
+	if (deliver(m_batch.data(), m_batchLen)) {
+		replay();
+	} else {
+		spill(m_batch.data(), m_batchLen);
+	}
+	m_batchLen = 0;
+}
+
+/* Returns false if the data should be retried later */
+bool
+InfluxSink::deliver(const char *buf, size_t len)
+{
+	const size_t lines = count_lines(buf, len);
+	size_t chunk;
+	int status;
+
+	if (m_useUdp) {
+		/* Split at line boundaries so that the listener never sees a partial line */
+		for (size_t offset = 0; offset < len; offset += chunk) {
+			chunk = std::min(len - offset, (size_t)INFLUX_UDP_PAYLOAD);
+			if (offset + chunk < len && whole_lines(buf + offset, chunk)) chunk = whole_lines(buf + offset, chunk);
+			if (m_udp.send((const uint8_t*)buf + offset, chunk) != (int)chunk) {
+				m_lastStatus = -1;
+				return false;
+			}
+		}
+		status = 0;
+	} else {
+		status = m_http.post(buf, len, "text/plain; charset=utf-8", INFLUX_TIMEOUT_MS);
+		m_lastStatus = status;
+
+		/* Unreachable, overloaded or failing server: try again later */
+		if (status < 0 || status == 408 || status == 429 || status >= 500) return false;
+
+		/* Rejected: retrying would not help */
+		if (status >= 300) {
+			m_linesDropped += lines;
+			return true;
+		}
+	}
+
+	m_linesSent += lines;
+	m_bytesSent += len;
+	return true;
+}
+
+void
+InfluxSink::spill(const char *buf, size_t len)
+{
+	if (!len) return;
+
+	/* Make room by dropping the part that was already delivered first */
+	if (m_spill && m_spillRead + m_spillBytes + len > m_config.spillLimit && m_spillRead > 0) compactSpill();
+
+	if (!m_spill || m_spillRead + m_spillBytes + len > m_config.spillLimit) {
+		m_linesDropped += count_lines(buf, len);
+		return;
+	}
+
+	fseek(m_spill, 0, SEEK_END);
+	if (fwrite(buf, 1, len, m_spill) != len || fflush(m_spill)) {
+		m_linesDropped += count_lines(buf, len);
+		return;
+	}
+	m_spillBytes += len;
+}
+
+void
+InfluxSink::replay()
+{
+	const size_t read = m_spillRead;
+	const char *newline;
+	size_t len, skip;
+
+	for (int i=0; i<INFLUX_REPLAY_CHUNKS && m_spill && m_spillBytes > 0; i++) {
+		fseek(m_spill, m_spillRead, SEEK_SET);
+		len = fread(m_replay.data(), 1, std::min(m_replay.size(), (size_t)m_spillBytes), m_spill);
+		if (!len) break;
+
+		/* Only send whole lines; a line longer than the buffer cannot be valid,
+		 * skip it up to the next newline */
+		if (whole_lines(m_replay.data(), len)) {
+			len = whole_lines(m_replay.data(), len);
+			if (!deliver(m_replay.data(), len)) break;
+		} else {
+			for (skip = len; skip < m_spillBytes; skip += len) {
+				len = fread(m_replay.data(), 1, std::min(m_replay.size(), (size_t)m_spillBytes - skip), m_spill);
+				if (!len) break;
+				if ((newline = (const char*)memchr(m_replay.data(), '\n', len))) {
+					skip += newline - m_replay.data() + 1;
+					break;
+				}
+			}
+			len = std::min(skip, (size_t)m_spillBytes);
+			m_linesDropped++;
+		}
+
+		m_spillRead += len;
+		m_spillBytes -= len;
+	}
+
+	if (!m_spill || m_spillRead == read) return;
+
+	/* Everything was delivered, start over with an empty file; otherwise
+	 * drop the delivered part once it is a good share of the file */
+	if (m_spillBytes == 0) {
+		openSpill(true);
+	} else if (m_spillRead >= m_config.spillLimit / INFLUX_SPILL_COMPACT_RATIO) {
+		compactSpill();
+	} else {
+		saveSpillRead();
+	}
+}
+
+void
+InfluxSink::openSpill(bool truncate)
+{
+	uint64_t read = 0;
+	FILE *fd;
+
+	if (m_spill) fclose(m_spill);
+	m_spill = NULL;
+	m_spillRead = 0;
+	m_spillBytes = 0;
+
+	if (m_config.spillPath.empty()) return;
+	if (!(m_spill = fopen(m_config.spillPath.c_str(), truncate ? "w+b" : "a+b"))) return;
+
+	/* Resume replaying where the previous run stopped, so that lines already
+	 * delivered are not sent twice */
+	if (!truncate && (fd = fopen(spillReadPath().c_str(), "rb"))) {
+		if (fscanf(fd, "%" SCNu64, &read) != 1) read = 0;
+		fclose(fd);
+	}
+
+	fseek(m_spill, 0, SEEK_END);
+	m_spillBytes = ftell(m_spill);
+	if (read <= m_spillBytes) {
+		m_spillRead = read;
+		m_spillBytes -= read;
+	}
+	if (truncate) saveSpillRead();
+}
+
+void
+InfluxSink::compactSpill()
+{
+	const std::string tmpPath = m_config.spillPath + ".tmp";
+	std::error_code err;
+	size_t left, len;
+	FILE *fd;
+
+	/* The position is saved on every path, replay() relies on it */
+	if (!(fd = fopen(tmpPath.c_str(), "wb"))) {
+		saveSpillRead();
+		return;
+	}
+
+	fseek(m_spill, m_spillRead, SEEK_SET);
+	for (left = m_spillBytes; left > 0; left -= len) {
+		len = fread(m_replay.data(), 1, std::min(m_replay.size(), left), m_spill);
+		if (!len || fwrite(m_replay.data(), 1, len, fd) != len) break;
+	}
+	if (fclose(fd) || left > 0) {
+		fs::remove(tmpPath, err);
+		saveSpillRead();
+		return;
+	}
+
+	/* Without a saved position, a crash past this point replays the whole file
+	 * again, which is better than skipping the lines that were not delivered
+	 * yet; if the rename fails, the old file and position are kept */
+	fs::remove(spillReadPath(), err);
+	fclose(m_spill);
+	fs::rename(tmpPath, m_config.spillPath, err);
+	if (err) fs::remove(tmpPath, err);
+	else m_spillRead = 0;
+
+	m_spill = fopen(m_config.spillPath.c_str(), "a+b");
+	saveSpillRead();
+}
+
+void
+InfluxSink::saveSpillRead()
+{
+	FILE *fd;
+
+	if (!(fd = fopen(spillReadPath().c_str(), "wb"))) return;
+	fprintf(fd, "%" PRIu64 "\n", (uint64_t)m_spillRead);
+	fclose(fd);
+}
+
+std::string
+InfluxSink::spillReadPath() const
+{
+	return m_config.spillPath + ".pos";
+}
+/* }}} */
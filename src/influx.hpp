@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "decode/common.hpp"
+#include "http.hpp"
+#include "perf.hpp"
+#include "spsc.hpp"
+#include "udp.hpp"
+
+class MemoryAccount;
+
+/**
+ * Time-series database sink. Frames and pipeline metrics are rendered to
+ * InfluxDB line protocol in a preallocated buffer, which is flushed over HTTP
+ * or UDP when it grows past a threshold or after a fixed interval. Batches that
+ * cannot be delivered are appended to a bounded spill file, and replayed once
+ * the endpoint is reachable again. The replay position is saved next to the
+ * spill file, so that a restart does not send delivered lines twice.
+ *
+ * addFrame() is meant to be called from the DSP thread and never blocks; all
+ * the rendering and I/O happens in a background thread.
+ */
+class InfluxSink {
+public:
+	struct Config {
+		std::string url;            /* http://host:port/path?query, or udp://host:port */
+		std::string token;          /* Authorization header for HTTP, empty for none */
+		std::string station;        /* Value of the station tag */
+		std::string spillPath;      /* Spill file, empty to drop undelivered batches */
+		size_t batchBytes;          /* Flush when the batch grows past this size */
+		int flushIntervalMs;        /* Flush at least this often */
+		size_t spillLimit;          /* Maximum size of the spill file, bytes */
+	};
+
+	struct Stats {
+		uint64_t linesSent, bytesSent;
+		uint64_t framesDropped;     /* Frames lost because the sink was lagging behind */
+		uint64_t linesDropped;      /* Lines lost because the spill file was full */
+		uint64_t spillBytes;        /* Data waiting in the spill file */
+		int lastStatus;             /* Last HTTP status, 0 for UDP, -1 if unreachable */
+	};
+
+	InfluxSink();
+	~InfluxSink();
+
+	/**
+	 * Get the default configuration: 16 kB batches, flushed every 10 s, and a
+	 * 16 MB spill file.
+	 */
+	static Config defaultConfig();
+
+	/**
+	 * Start the sink.
+	 *
+	 * @param config endpoint and batching parameters
+	 * @return true on success, false if the URL is invalid
+	 */
+	bool start(const Config &config);
+
+	/**
+	 * Stop the sink. The pending batch is spilled rather than sent, so that this
+	 * never waits for the network.
+	 */
+	void stop();
+
+	/**
+	 * Report the counters of a pipeline stage along with the frames. Must be
+	 * called before start(), and the stage must outlive the sink.
+	 *
+	 * @param stage pipeline stage
+	 */
+	void addStage(const radiosonde::PerfStage *stage);
+
+	/**
+	 * Report the memory footprint of the instance along with the frames. Must
+	 * be called before start(), and the account must outlive the sink.
+	 *
+	 * @param account memory account of the instance
+	 */
+	void setMemoryAccount(const MemoryAccount *account);
+
+	/**
+	 * Queue a frame. Never blocks; if the sink is lagging behind, the frame is
+	 * dropped.
+	 *
+	 * @param data decoded frame
+	 */
+	void addFrame(const SondeFullData &data);
+
+	Stats stats() const;
+
+	/**
+	 * Bytes held by the frame queue and the batch buffers. The spill file is
+	 * on disk and not included.
+	 */
+	size_t memoryUsage() const;
+
+private:
+	struct Point {
+		char serial[32];
+		int seq;
+		time_t time;
+		int burstkill;
+		float lat, lon, alt;
+		float spd, hdg, climb;
+		float temp, rh, dewpt, pressure;
+		bool calibrated;
+	};
+
+	void worker();
+	void render(const Point &point);
+	void renderMetrics();
+	void flush();
+	bool deliver(const char *buf, size_t len);
+	void spill(const char *buf, size_t len);
+	void replay();
+	void openSpill(bool truncate);
+	void compactSpill();
+	void saveSpillRead();
+	std::string spillReadPath() const;
+
+	std::thread m_thread;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	bool m_running;
+
+	Config m_config;
+	radiosonde::SpscQueue<Point> m_points;
+	std::vector<const radiosonde::PerfStage*> m_stages;
+	const MemoryAccount *m_memory;
+
+	/* Only touched by the worker thread */
+	HttpClient m_http;
+	UdpSocket m_udp;
+	bool m_useUdp;
+	std::vector<char> m_batch, m_replay;
+	size_t m_batchLen;
+	FILE *m_spill;
+	size_t m_spillRead;
+
+	std::atomic<uint64_t> m_linesSent, m_bytesSent, m_framesDropped, m_linesDropped, m_spillBytes;
+	std::atomic<int> m_lastStatus;
+};
@@ -5,6 +5,7 @@
 #include <imgui.h>
 #include <module.h>
 #include <signal_path/signal_path.h>
+#include <chrono>
 #include <time.h>
 #include "main.hpp"
 #include "utils.hpp"
@@ -14,6 +15,7 @@
 #define SNAP_INTERVAL 1000
 #define UNCAL_COLOR IM_COL32(255,234,0,255)
 #define OUT_SAMPLE_RATE 48000
+#define MAX_ENSEMBLE_SIZE 4096
 
 SDRPP_MOD_INFO {
     /* Name:            */ "radiosonde_decoder",
@@ -24,13 +26,19 @@ SDRPP_MOD_INFO {
 };
 
 ConfigManager config;
+char RadiosondeDecoderModule::stationLogPath[2048];
+char RadiosondeDecoderModule::mapTileDir[2048];
+int RadiosondeDecoderModule::mapCacheSize;
 
 RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 {
 	float bw;
 	bool created = false;
 	int typeToSelect;
-	std::string gpxPath, ptuPath;
+	std::string gpxPath, ptuPath, collectorPath, windPath, demPath, stationLogPathStr, archivePath, mapTilePath;
+	LandingPredictor::Config predictorConfig;
+	TrackDecimator::Config gpxRate;
+	FlightState flight;
 
 	this->name = name;
 	selectedType = -1;
@@ -43,13 +51,124 @@ RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 		config.conf[name]["sondeType"] = 0;
 		created = true;
 	}
+	if (!config.conf[name].contains("collectorAddr")) {
+		config.conf[name]["collectorAddr"] = "localhost:5005";
+		created = true;
+	}
+	influxConfig = InfluxSink::defaultConfig();
+	if (!config.conf[name].contains("influx")) {
+		config.conf[name]["influx"]["url"] = influxConfig.url;
+		config.conf[name]["influx"]["token"] = "";
+		config.conf[name]["influx"]["station"] = name;
+		config.conf[name]["influx"]["batchBytes"] = influxConfig.batchBytes;
+		config.conf[name]["influx"]["flushInterval"] = influxConfig.flushIntervalMs;
+		config.conf[name]["influx"]["spillLimit"] = influxConfig.spillLimit;
+		created = true;
+	}
+	if (!config.conf[name].contains("memoryBudget")) {
+		config.conf[name]["memoryBudget"] = 0;
+		created = true;
+	}
+	if (!config.conf[name].contains("gpxRate")) {
+		config.conf[name]["gpxRate"]["mode"] = TrackDecimator::DECIMATE_NONE;
+		config.conf[name]["gpxRate"]["interval"] = 10;
+		config.conf[name]["gpxRate"]["distance"] = 100;
+		created = true;
+	}
+	if (!config.conf[name].contains("channels")) {
+		config.conf[name]["channels"] = json::array();
+		created = true;
+	}
+	if (!config.conf[name].contains("archiveDir")) {
+		config.conf[name]["archiveDir"] = getTempFile("radiosonde_" + name + "_archive");
+		created = true;
+	}
+	if (!config.conf.contains("stationLog")) {
+		config.conf["stationLog"] = getTempFile("radiosonde_station.csv");
+		created = true;
+	}
+	if (!config.conf.contains("map")) {
+		config.conf["map"]["tileDir"] = "";
+		config.conf["map"]["cacheSize"] = TILECACHE_DEFAULT_BUDGET >> 20;
+		created = true;
+	}
+	predictorConfig = predictor.getConfig();
+	if (!config.conf[name].contains("prediction")) {
+		config.conf[name]["prediction"]["enabled"] = false;
+		config.conf[name]["prediction"]["burstAlt"] = predictorConfig.burstAlt;
+		config.conf[name]["prediction"]["members"] = predictorConfig.members;
+		created = true;
+	}
+	if (!config.conf[name]["prediction"].contains("windDir")) {
+		config.conf[name]["prediction"]["windDir"] = "";
+		created = true;
+	}
+	if (!config.conf[name]["prediction"].contains("demDir")) {
+		config.conf[name]["prediction"]["demDir"] = "";
+		created = true;
+	}
 	gpxPath = config.conf[name]["gpxPath"];
 	ptuPath = config.conf[name]["ptuPath"];
+	collectorPath = config.conf[name]["collectorAddr"];
+	influxConfig.url = config.conf[name]["influx"]["url"];
+	influxConfig.token = config.conf[name]["influx"]["token"];
+	influxConfig.station = config.conf[name]["influx"]["station"];
+	influxConfig.batchBytes = config.conf[name]["influx"]["batchBytes"];
+	influxConfig.flushIntervalMs = config.conf[name]["influx"]["flushInterval"];
+	influxConfig.spillLimit = config.conf[name]["influx"]["spillLimit"];
+	influxConfig.spillPath = getTempFile("radiosonde_" + name + ".influx");
 	typeToSelect = config.conf[name]["sondeType"];
+	gpxRate.mode = (TrackDecimator::Mode)std::min(std::max((int)config.conf[name]["gpxRate"]["mode"], 0), (int)TrackDecimator::DECIMATE_VERTICAL);
+	gpxRate.interval = config.conf[name]["gpxRate"]["interval"];
+	memory.setBudget((size_t)std::max((int)config.conf[name]["memoryBudget"], 0) << 20);
+	gpxRate.distance = config.conf[name]["gpxRate"]["distance"];
+	predictionEnabled = config.conf[name]["prediction"]["enabled"];
+	predictorConfig.burstAlt = config.conf[name]["prediction"]["burstAlt"];
+	predictorConfig.members = config.conf[name]["prediction"]["members"];
+	windPath = config.conf[name]["prediction"]["windDir"];
+	demPath = config.conf[name]["prediction"]["demDir"];
+	stationLogPathStr = config.conf["stationLog"];
+	archivePath = config.conf[name]["archiveDir"];
+	mapTilePath = config.conf["map"]["tileDir"];
+	mapCacheSize = config.conf["map"]["cacheSize"];
+	channels = new ChannelSet(name, channelDataHandler, this);
+	for (size_t i=0; i<config.conf[name]["channels"].size(); i++) {
+		json &entry = config.conf[name]["channels"][i];
+		const std::string key = entry["type"];
+		const SondeType *type = findSondeType(key.c_str());
+
+		if (key != "auto" && !type) continue;
+		channels->add({entry["frequency"].get<double>(), type ? (int)(type - sondeTypes) : CHANNEL_AUTO, entry["priority"].get<int>()});
+	}
 	config.release(created);
 
+	strncpy(windDir, windPath.c_str(), sizeof(windDir)-1);
+	windDir[sizeof(windDir)-1] = '\0';
+	if (windDir[0]) windField.setDirectory(windDir);
+	strncpy(demDir, demPath.c_str(), sizeof(demDir)-1);
+	demDir[sizeof(demDir)-1] = '\0';
+	terrain.setDirectory(demDir);
+
+	predictor.setConfig(predictorConfig);
+	gpxDecimator.setConfig(gpxRate);
+	predictor.setWindField(&windField);
+	predictor.setTerrain(&terrain);
+
 	strncpy(gpxFilename, gpxPath.c_str(), sizeof(gpxFilename)-1);
 	strncpy(ptuFilename, ptuPath.c_str(), sizeof(ptuFilename)-1);
+	strncpy(collectorAddr, collectorPath.c_str(), sizeof(collectorAddr)-1);
+	collectorAddr[sizeof(collectorAddr)-1] = '\0';
+	strncpy(influxUrl, influxConfig.url.c_str(), sizeof(influxUrl)-1);
+	influxUrl[sizeof(influxUrl)-1] = '\0';
+	strncpy(stationLogPath, stationLogPathStr.c_str(), sizeof(stationLogPath)-1);
+	stationLogPath[sizeof(stationLogPath)-1] = '\0';
+	StationLog::shared().setPath(stationLogPath);
+	stationSource = StationLog::shared().addSource(name.c_str());
+	strncpy(archiveDir, archivePath.c_str(), sizeof(archiveDir)-1);
+	archiveDir[sizeof(archiveDir)-1] = '\0';
+	archive.open(archiveDir);
+	strncpy(mapTileDir, mapTilePath.c_str(), sizeof(mapTileDir)-1);
+	mapTileDir[sizeof(mapTileDir)-1] = '\0';
 
 	bw = std::get<1>(supportedTypes[typeToSelect]);
 	vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
@@ -59,25 +178,88 @@ RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 	/* Resampler to 48kHz */
 	resampler.init(&fmDemod.out, bw, OUT_SAMPLE_RATE);
 
-	dfm09decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	c50decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	imet4decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	ims100decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	m10decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	mrzn1decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	rs41decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	/* Shared-buffer splitter, so that more consumers can tap the audio without copies.
+	 * The decoder must never lose samples, so it blocks the fan-out if lagging */
+	fanout.init(&resampler.out);
+	fanout.bindReader(&decoderTap, radiosonde::LAG_BLOCK);
+
+	dfm09decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	c50decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	imet4decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	ims100decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	m10decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	mrzn1decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+	rs41decoder.init(&decoderTap, OUT_SAMPLE_RATE, sondeDataHandler, this);
+
+	fmDemod.setStage(&demodStage);
+	resampler.setStage(&resamplerStage);
+	fanout.setStage(&fanoutStage);
+	dfm09decoder.setStage(&decoderStage);
+	c50decoder.setStage(&decoderStage);
+	imet4decoder.setStage(&decoderStage);
+	ims100decoder.setStage(&decoderStage);
+	m10decoder.setStage(&decoderStage);
+	mrzn1decoder.setStage(&decoderStage);
+	rs41decoder.setStage(&decoderStage);
 
 	fmDemod.start();
 	resampler.start();
+	fanout.start();
 	onTypeSelected(this, typeToSelect);
+	channels->start();
 	enabled = true;
 
+	/* Resume the flight that was being tracked before a restart, if any */
+	if (checkpoint.open(getTempFile("radiosonde_" + name + ".state").c_str()) && checkpoint.restore(&flight)) {
+		flight.getData(&lastData);
+		predictor.setState(flight.predictor);
+
+		if (flight.gpxPath[0]) {
+			GPXWriter *writer = new GPXWriter();
+			gpxOutput = writer->resume(flight.gpxPath, flight.gpx);
+			if (gpxOutput) {
+				strncpy(gpxFilename, flight.gpxPath, sizeof(gpxFilename)-1);
+				gpxWriter.publish(writer);
+			} else {
+				delete writer;
+			}
+		}
+		if (flight.ptuPath[0]) {
+			PTUWriter *writer = new PTUWriter();
+			ptuOutput = writer->init(flight.ptuPath, true);
+			if (ptuOutput) {
+				strncpy(ptuFilename, flight.ptuPath, sizeof(ptuFilename)-1);
+				ptuWriter.publish(writer);
+			} else {
+				delete writer;
+			}
+		}
+	}
+	checkpoint.setOutputs(gpxOutput ? gpxFilename : NULL, ptuOutput ? ptuFilename : NULL);
+	checkpoint.start(&predictor);
+	outputWriter.start(writeFrame, this);
+	if (predictionEnabled) predictor.start();
+
 	gui::menu.registerEntry(name, menuHandler, this, this);
 }
 
 RadiosondeDecoderModule::~RadiosondeDecoderModule()
 {
 	if (isEnabled()) disable();
+
+	/* The writer thread measures the channels, stop it first */
+	outputWriter.stop();
+	delete channels;
+	archiveFlight(this);
+
+	/* Keep the last fix in the file and in the final checkpoint */
+	{
+		std::lock_guard<std::mutex> lck(gpxMtx);
+		flushTrack(this, gpxWriter.get());
+		checkpoint.setGPXState(gpxWriter.get());
+	}
+	checkpoint.stop();
+	StationLog::shared().removeSource(stationSource);
 	if (vfo) {
 		sigpath::vfoManager.deleteVFO(vfo);
 		vfo = NULL;
@@ -92,6 +274,8 @@ RadiosondeDecoderModule::enable() {
 
 	fmDemod.start();
 	resampler.start();
+	fanout.start();
+	channels->start();
 	enabled = true;
 }
 
@@ -102,11 +286,21 @@ RadiosondeDecoderModule::disable() {
 
 	fmDemod.stop();
 	resampler.stop();
+	fanout.stop();
+	channels->stop();
 
 	if (vfo) sigpath::vfoManager.deleteVFO(vfo);
 	vfo = NULL;
+	dspBytes.store(2 * streamBytes<float>(), std::memory_order_relaxed);
 
-	gpxWriter.stopTrack();
+	/* Frames still queued may be written after this, into a new track */
+	{
+		std::lock_guard<std::mutex> lck(gpxMtx);
+		GPXWriter *gpx = gpxWriter.get();
+		flushTrack(this, gpx);
+		if (gpx) gpx->stopTrack();
+		checkpoint.setGPXState(gpx);
+	}
 	lastData.init();
 	enabled = false;
 }
@@ -128,7 +322,20 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 	const ImVec2 wh = ImGui::GetContentRegionAvail();
 	const float width = wh.x;
 	char time[64];
-	bool gpxStatusChanged, ptuStatusChanged;
+	bool gpxStatusChanged, ptuStatusChanged, collectorStatusChanged, influxStatusChanged, stationLogStatusChanged;
+
+	/* Destroy writers retired by previous output changes, if no longer in use */
+	_this->epoch.reclaim();
+
+	/* Channel VFOs are placed relative to the center frequency, which is only followed while the menu is drawn */
+	_this->channels->update();
+	checkMemory(ctx);
+
+	/* The VFO manager is only safe to query from this thread, where VFOs are created and deleted */
+	if (_this->vfo) {
+		_this->tunedFrequency.store(gui::waterfall.getCenterFrequency() + sigpath::vfoManager.getOffset(_this->name),
+		                            std::memory_order_relaxed);
+	}
 
 	if (!_this->enabled) style::beginDisabled();
 
@@ -157,7 +364,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Serial no.");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%s", _this->lastData.serial.c_str());
+			ImGui::Text("%s", serial_name(_this->lastData.serial).c_str());
 		}
 
 		ImGui::TableNextRow();
@@ -304,6 +511,40 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 	gpxStatusChanged |= ImGui::InputText(CONCAT("##_gpx_fname_", _this->name), _this->gpxFilename, sizeof(gpxFilename)-1,
 	                                     ImGuiInputTextFlags_EnterReturnsTrue);
 	if (gpxStatusChanged) onGPXOutputChanged(ctx);
+
+	TrackDecimator::Config gpxRate = _this->gpxDecimator.getConfig();
+	bool gpxRateChanged = false;
+
+	ImGui::LeftLabel("GPX rate");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::BeginCombo(CONCAT("##_gpx_rate_", _this->name), TrackDecimator::modeName(gpxRate.mode))) {
+		for (int i=TrackDecimator::DECIMATE_NONE; i<=TrackDecimator::DECIMATE_VERTICAL; i++) {
+			if (ImGui::Selectable(TrackDecimator::modeName((TrackDecimator::Mode)i), gpxRate.mode == i)) {
+				gpxRate.mode = (TrackDecimator::Mode)i;
+				gpxRateChanged = true;
+			}
+		}
+		ImGui::EndCombo();
+	}
+	if (ImGui::IsItemHovered()) {
+		const TrackDecimator::Stats stats = _this->gpxDecimator.stats();
+		ImGui::SetTooltip("Points written to the GPX track, the logs get every frame\n%llu of %llu fixes written",
+		                  (unsigned long long)stats.kept, (unsigned long long)stats.seen);
+	}
+	if (gpxRate.mode == TrackDecimator::DECIMATE_INTERVAL || gpxRate.mode == TrackDecimator::DECIMATE_VERTICAL) {
+		ImGui::LeftLabel(gpxRate.mode == TrackDecimator::DECIMATE_VERTICAL ? "Max. interval (s)" : "Interval (s)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		gpxRateChanged |= ImGui::InputFloat(CONCAT("##_gpx_rate_interval_", _this->name), &gpxRate.interval, 1, 10, "%.0f");
+	}
+	if (gpxRate.mode == TrackDecimator::DECIMATE_DISTANCE || gpxRate.mode == TrackDecimator::DECIMATE_VERTICAL) {
+		ImGui::LeftLabel(gpxRate.mode == TrackDecimator::DECIMATE_VERTICAL ? "Vertical step (m)" : "Distance (m)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		gpxRateChanged |= ImGui::InputFloat(CONCAT("##_gpx_rate_distance_", _this->name), &gpxRate.distance, 10, 100, "%.0f");
+	}
+	if (gpxRateChanged) {
+		_this->gpxDecimator.setConfig(gpxRate);
+		onGPXRateChanged(ctx);
+	}
 	/* }}} */
 	/* Log output file {{{ */
 	ptuStatusChanged = ImGui::Checkbox(CONCAT("Log data##_ptu_log_", _this->name), &_this->ptuOutput);
@@ -313,6 +554,490 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 	                                     ImGuiInputTextFlags_EnterReturnsTrue);
 	if (ptuStatusChanged) onPTUOutputChanged(ctx);
 	/* }}} */
+	/* Collector link {{{ */
+	collectorStatusChanged = ImGui::Checkbox(CONCAT("Collector##_collector_", _this->name), &_this->collectorOutput);
+	if (ImGui::IsItemHovered()) {
+		radiosonde::EpochDomain::Guard guard(_this->epoch);
+		const DeltaSender *sender = _this->deltaSender.get();
+		if (sender && sender->framesSent()) {
+			ImGui::SetTooltip("%llu frames sent, %.1f bytes/frame", (unsigned long long)sender->framesSent(),
+			                  (double)sender->bytesSent() / sender->framesSent());
+		} else {
+			ImGui::SetTooltip("Stream decoded frames to a radiosonde_collector (host:port)");
+		}
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	collectorStatusChanged |= ImGui::InputText(CONCAT("##_collector_addr_", _this->name), _this->collectorAddr, sizeof(collectorAddr)-1,
+	                                           ImGuiInputTextFlags_EnterReturnsTrue);
+	if (collectorStatusChanged) onCollectorChanged(ctx);
+	/* }}} */
+	/* Time-series database {{{ */
+	influxStatusChanged = ImGui::Checkbox(CONCAT("InfluxDB##_influx_", _this->name), &_this->influxOutput);
+	if (ImGui::IsItemHovered()) {
+		radiosonde::EpochDomain::Guard guard(_this->epoch);
+		const InfluxSink *sink = _this->influxSink.get();
+		if (sink) {
+			const InfluxSink::Stats stats = sink->stats();
+			ImGui::SetTooltip("%llu lines sent, %llu dropped, %llu bytes spilled (last status: %d)",
+			                  (unsigned long long)stats.linesSent, (unsigned long long)(stats.linesDropped + stats.framesDropped),
+			                  (unsigned long long)stats.spillBytes, stats.lastStatus);
+		} else {
+			ImGui::SetTooltip("Write frames and metrics to a time-series database (http:// or udp:// URL)");
+		}
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	influxStatusChanged |= ImGui::InputText(CONCAT("##_influx_url_", _this->name), _this->influxUrl, sizeof(influxUrl)-1,
+	                                        ImGuiInputTextFlags_EnterReturnsTrue);
+	if (influxStatusChanged) onInfluxChanged(ctx);
+	/* }}} */
+	/* Station log {{{ */
+	stationLogStatusChanged = ImGui::Checkbox(CONCAT("Station log##_station_", _this->name), &_this->stationLogOutput);
+	if (ImGui::IsItemHovered()) {
+		const StationLog::Stats stats = StationLog::shared().stats();
+		if (stats.open) {
+			ImGui::SetTooltip("%llu frames from %d instances, %llu dropped here",
+			                  (unsigned long long)stats.written, stats.activeSources,
+			                  (unsigned long long)_this->stationSource->dropped());
+		} else {
+			ImGui::SetTooltip("Merge the frames of all instances into one file (.csv, or .bin for binary records)");
+		}
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	stationLogStatusChanged |= ImGui::InputText(CONCAT("##_station_path_", _this->name), stationLogPath, sizeof(stationLogPath)-1,
+	                                            ImGuiInputTextFlags_EnterReturnsTrue);
+	if (stationLogStatusChanged) onStationLogChanged(ctx);
+	/* }}} */
+	/* Channels {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Channels##_radiosonde_channels_", _this->name))) {
+		const time_t now = ::time(NULL);
+		double totalLoad = 0;
+		int removed = -1;
+
+		if (_this->channels->size()
+		    && ImGui::BeginTable(CONCAT("##radiosonde_channels_", _this->name), 7, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableNextColumn();
+			ImGui::Text("MHz");
+			ImGui::TableNextColumn();
+			ImGui::Text("Type");
+			ImGui::TableNextColumn();
+			ImGui::Text("Priority");
+			ImGui::TableNextColumn();
+			ImGui::Text("Serial");
+			ImGui::TableNextColumn();
+			ImGui::Text("Last");
+			ImGui::TableNextColumn();
+			ImGui::Text("CPU");
+			ImGui::TableNextColumn();
+
+			for (int i=0; i<_this->channels->size(); i++) {
+				const ChannelSet::Status status = _this->channels->status(i);
+				ChannelSet::Config channelConfig = status.config;
+				double mhz = channelConfig.frequency / 1e6;
+				bool changed = false;
+
+				totalLoad += status.load;
+				ImGui::PushID(i);
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::SetNextItemWidth(80);
+				if (ImGui::InputDouble("##_freq", &mhz, 0, 0, "%.3f", ImGuiInputTextFlags_EnterReturnsTrue)) {
+					channelConfig.frequency = mhz * 1e6;
+					changed = true;
+				}
+
+				ImGui::TableNextColumn();
+				ImGui::SetNextItemWidth(110);
+				if (ImGui::BeginCombo("##_type", channelConfig.type == CHANNEL_AUTO ? "Auto" : sondeTypes[channelConfig.type].name)) {
+					for (int type=CHANNEL_AUTO; type<(int)IM_ARRAYSIZE(sondeTypes); type++) {
+						if (ImGui::Selectable(type == CHANNEL_AUTO ? "Auto" : sondeTypes[type].name, channelConfig.type == type)) {
+							channelConfig.type = type;
+							changed = true;
+						}
+					}
+					ImGui::EndCombo();
+				}
+				if (ImGui::IsItemHovered() && channelConfig.type == CHANNEL_AUTO) {
+					ImGui::SetTooltip("%s", status.type == CHANNEL_AUTO ? "Searching" : sondeTypes[status.type].name);
+				}
+
+				ImGui::TableNextColumn();
+				ImGui::SetNextItemWidth(80);
+				changed |= ImGui::InputInt("##_priority", &channelConfig.priority);
+				if (ImGui::IsItemHovered()) {
+					ImGui::SetTooltip("Channels with a higher priority are decoded first when the CPU cannot keep up");
+				}
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", serial_name(status.last.serial).c_str());
+				if (ImGui::IsItemHovered() && status.lastFrame) {
+					ImGui::SetTooltip("%8.5f%c %8.5f%c, %.0fm",
+					                  fabs(status.last.lat), (status.last.lat >= 0 ? 'N' : 'S'),
+					                  fabs(status.last.lon), (status.last.lon >= 0 ? 'E' : 'W'), status.last.alt);
+				}
+
+				ImGui::TableNextColumn();
+				if (status.lastFrame) {
+					ImGui::Text("%llds", (long long)(now - status.lastFrame));
+				} else {
+					ImGui::TextDisabled("-");
+				}
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f%%", 100 * status.load);
+				if (ImGui::IsItemHovered()) {
+					ImGui::SetTooltip("%llu chunks decoded, %llu dropped", (unsigned long long)status.chunks,
+					                  (unsigned long long)status.dropped);
+				}
+
+				ImGui::TableNextColumn();
+				if (ImGui::Button("Remove")) removed = i;
+				ImGui::PopID();
+
+				if (changed && _this->channels->set(i, channelConfig)) onChannelsChanged(ctx);
+			}
+
+			ImGui::EndTable();
+		}
+		if (removed >= 0) {
+			_this->channels->remove(removed);
+			onChannelsChanged(ctx);
+		}
+
+		if (ImGui::Button(CONCAT("Add##_radiosonde_channels_add_", _this->name))) {
+			if (_this->channels->add({_this->newChannelFreq * 1e6, CHANNEL_AUTO, 0}) >= 0) onChannelsChanged(ctx);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Decode another frequency (MHz) along with this one, detecting the sonde type");
+		}
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		ImGui::InputDouble(CONCAT("##_radiosonde_channels_freq_", _this->name), &_this->newChannelFreq, 0.01, 0.1, "%.3f");
+		if (_this->channels->size()) {
+			ImGui::TextDisabled("%.1f%% of a core on %d workers", 100 * totalLoad, radiosonde::ThreadPool::shared().size());
+		}
+	}
+	/* }}} */
+	/* Landing prediction {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Landing prediction##_radiosonde_pred_", _this->name))) {
+		LandingPredictor::Config predictorConfig = _this->predictor.getConfig();
+		bool predictorChanged;
+
+		predictorChanged = ImGui::Checkbox(CONCAT("Enabled##_radiosonde_pred_en_", _this->name), &_this->predictionEnabled);
+
+		ImGui::LeftLabel("Burst altitude (m)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputFloat(CONCAT("##_radiosonde_pred_burst_", _this->name), &predictorConfig.burstAlt, 500, 1000, "%.0f")) {
+			predictorConfig.burstAlt = std::max(predictorConfig.burstAlt, 0.0f);
+			predictorChanged = true;
+		}
+
+		ImGui::LeftLabel("Ensemble size");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputInt(CONCAT("##_radiosonde_pred_members_", _this->name), &predictorConfig.members, 16, 128)) {
+			predictorConfig.members = std::min(std::max(predictorConfig.members, 1), MAX_ENSEMBLE_SIZE);
+			predictorChanged = true;
+		}
+
+		if (predictorChanged) {
+			_this->predictor.setConfig(predictorConfig);
+			onPredictionChanged(ctx);
+		}
+
+		ImGui::LeftLabel("Wind forecasts");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputText(CONCAT("##_radiosonde_pred_wind_", _this->name), _this->windDir, sizeof(_this->windDir)-1,
+		                     ImGuiInputTextFlags_EnterReturnsTrue)) {
+			onWindDirChanged(ctx);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Directory containing GRIB2 files with U/V winds on pressure levels");
+		}
+		if (_this->windDir[0]) {
+			if (ImGui::Button(CONCAT("Reload##_radiosonde_pred_wind_reload_", _this->name))) {
+				_this->windField.reload();
+			}
+			ImGui::SameLine();
+			ImGui::TextDisabled("%s", _this->windField.status().c_str());
+		}
+
+		ImGui::LeftLabel("Terrain tiles");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputText(CONCAT("##_radiosonde_pred_dem_", _this->name), _this->demDir, sizeof(_this->demDir)-1,
+		                     ImGuiInputTextFlags_EnterReturnsTrue)) {
+			onDemDirChanged(ctx);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Directory containing SRTM .hgt elevation tiles");
+		}
+		if (_this->demDir[0]) {
+			ImGui::TextDisabled("%d tiles mapped (%.0fMB)", _this->terrain.tiles(), _this->terrain.usage() / 1048576.0);
+		}
+
+		const LandingPrediction prediction = _this->predictor.getPrediction();
+		if (_this->predictionEnabled && prediction.valid
+		    && ImGui::BeginTable(CONCAT("##radiosonde_pred_", _this->name), 2, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableNextColumn();
+			ImGui::Text("Landing");
+			ImGui::TableNextColumn();
+			ImGui::Text("%8.5f%c %8.5f%c",
+			            fabs(prediction.lat), (prediction.lat >= 0 ? 'N' : 'S'),
+			            fabs(prediction.lon), (prediction.lon >= 0 ? 'E' : 'W'));
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Elevation");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.0fm", prediction.landingAlt);
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Centroid");
+			ImGui::TableNextColumn();
+			ImGui::Text("%8.5f%c %8.5f%c",
+			            fabs(prediction.meanLat), (prediction.meanLat >= 0 ? 'N' : 'S'),
+			            fabs(prediction.meanLon), (prediction.meanLon >= 0 ? 'E' : 'W'));
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Dispersion");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f x %.1fkm, %.0f°", prediction.semiMajor / 1e3, prediction.semiMinor / 1e3, prediction.orientation);
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("95%% ellipse over %d trajectories (%.0fms)%s", prediction.members, prediction.computeMs,
+				                  prediction.forecast ? ", with forecast winds" : "");
+			}
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Time to landing");
+			ImGui::TableNextColumn();
+			ImGui::Text("%d:%02d", (int)prediction.timeToLanding / 60, (int)prediction.timeToLanding % 60);
+
+			ImGui::EndTable();
+		}
+	}
+	/* }}} */
+	/* Map {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Map##_radiosonde_map_", _this->name))) {
+		const LandingPrediction prediction = _this->predictor.getPrediction();
+		bool mapChanged;
+
+		ImGui::LeftLabel("Tiles");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		mapChanged = ImGui::InputText(CONCAT("##_radiosonde_map_dir_", _this->name), mapTileDir, sizeof(mapTileDir)-1,
+		                              ImGuiInputTextFlags_EnterReturnsTrue);
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Directory containing the map tiles, as {z}/{x}/{y}.png or .jpg");
+		}
+		ImGui::LeftLabel("Cache size (MB)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputInt(CONCAT("##_radiosonde_map_cache_", _this->name), &mapCacheSize, 16, 64)) {
+			mapCacheSize = std::max(mapCacheSize, 4);
+			mapChanged = true;
+		}
+		if (mapChanged) onMapChanged(ctx);
+
+		/* The shared cache is only told about the directory once it is drawn into */
+		TileCache::shared().setDirectory(mapTileDir);
+		TileCache::shared().setBudget((size_t)mapCacheSize << 20);
+
+		ImGui::Checkbox(CONCAT("Follow##_radiosonde_map_follow_", _this->name), &_this->mapView.follow);
+		_this->mapView.draw(CONCAT("##_radiosonde_map_view_", _this->name), width - ImGui::GetCursorPosX(),
+		                    (width - ImGui::GetCursorPosX()) * 0.75f, _this->predictionEnabled ? &prediction : NULL);
+
+		const TileCache::Stats stats = TileCache::shared().stats();
+		ImGui::TextDisabled("%zu tiles (%.1fMB), %zu loading, %.2fms", stats.tiles, stats.usage / 1048576.0,
+		                    stats.pending, _this->mapView.drawMs());
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Tiles on the GPU, tiles being decoded, time spent drawing the map\n"
+			                  "Average tile decoding time: %.1fms", stats.decodeMs);
+		}
+	}
+	/* }}} */
+	/* Flight archive {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Archive##_radiosonde_archive_", _this->name))) {
+		ImGui::LeftLabel("Directory");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputText(CONCAT("##_radiosonde_archive_dir_", _this->name), _this->archiveDir, sizeof(_this->archiveDir)-1,
+		                     ImGuiInputTextFlags_EnterReturnsTrue)) {
+			onArchiveDirChanged(ctx);
+		}
+		if (_this->archive.isOpen()) {
+			const GeoIndex::Stats stats = _this->archive.stats();
+			ImGui::TextDisabled("%u flights, %llu points", stats.flights, (unsigned long long)stats.points);
+		} else {
+			ImGui::TextDisabled("Cannot open the archive");
+		}
+
+		ImGui::LeftLabel("Latitude");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		ImGui::InputFloat(CONCAT("##_radiosonde_archive_lat_", _this->name), &_this->searchLat, 0, 0, "%.5f");
+		ImGui::LeftLabel("Longitude");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		ImGui::InputFloat(CONCAT("##_radiosonde_archive_lon_", _this->name), &_this->searchLon, 0, 0, "%.5f");
+		ImGui::LeftLabel("Radius (km)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		ImGui::InputFloat(CONCAT("##_radiosonde_archive_radius_", _this->name), &_this->searchRadius, 10, 100, "%.1f");
+		ImGui::LeftLabel("Last days");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		ImGui::InputInt(CONCAT("##_radiosonde_archive_days_", _this->name), &_this->searchDays, 1, 30);
+		ImGui::Checkbox(CONCAT("Landings only##_radiosonde_archive_landings_", _this->name), &_this->searchLandings);
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Only match flights that landed in the search area");
+		}
+		ImGui::SameLine();
+		if (ImGui::Button(CONCAT("Search##_radiosonde_archive_search_", _this->name))) onArchiveSearch(ctx);
+		if (_this->searchMs >= 0) {
+			ImGui::SameLine();
+			ImGui::TextDisabled("%zu flights (%.1fms)", _this->searchResults.size(), _this->searchMs);
+		}
+
+		if (!_this->searchResults.empty()
+		    && ImGui::BeginTable(CONCAT("##radiosonde_archive_", _this->name), 4, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_ScrollY,
+		                         ImVec2(0, 200))) {
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableNextColumn();
+			ImGui::Text("Serial");
+			ImGui::TableNextColumn();
+			ImGui::Text("Date");
+			ImGui::TableNextColumn();
+			ImGui::Text("Distance");
+			ImGui::TableNextColumn();
+			ImGui::Text("Altitude");
+
+			for (const GeoIndex::Match &match : _this->searchResults) {
+				const time_t start = match.start;
+				char date[32];
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", match.serial);
+				ImGui::TableNextColumn();
+				if (!strftime(date, sizeof(date), "%Y-%m-%d %H:%M", gmtime(&start))) date[0] = '\0';
+				ImGui::Text("%s", date);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1fkm", match.distance);
+				if (ImGui::IsItemHovered()) {
+					ImGui::SetTooltip("Closest point: %8.5f%c %8.5f%c",
+					                  fabs(match.point.lat), (match.point.lat >= 0 ? 'N' : 'S'),
+					                  fabs(match.point.lon), (match.point.lon >= 0 ? 'E' : 'W'));
+				}
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0fm", match.point.alt);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+	/* }}} */
+	/* Memory {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Memory##_radiosonde_mem_", _this->name))) {
+		const MemoryAccount::Snapshot snap = _this->memory.snapshot();
+		const size_t resident = residentBytes();
+		int budget = snap.budget >> 20;
+
+		if (ImGui::BeginTable(CONCAT("##radiosonde_mem_", _this->name), 2, ImGuiTableFlags_SizingFixedFit)) {
+			for (int i=0; i<MemoryAccount::MEM_COMPONENTS; i++) {
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", MemoryAccount::componentName((MemoryAccount::Component)i));
+				ImGui::TableNextColumn();
+				if (MemoryAccount::measurable((MemoryAccount::Component)i)) {
+					ImGui::Text("%.1fMB", snap.bytes[i] / 1048576.0);
+				} else {
+					ImGui::TextDisabled("n/a");
+					if (ImGui::IsItemHovered()) ImGui::SetTooltip("Opaque to the plugin, only included in the process total");
+				}
+				ImGui::TableNextRow();
+			}
+			ImGui::TableNextColumn();
+			ImGui::Text("Total");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1fMB", snap.total / 1048576.0);
+			ImGui::EndTable();
+		}
+		if (resident) {
+			ImGui::TextDisabled("Process: %.0fMB resident", resident / 1048576.0);
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Every instance and SDR++ itself included, as well as the\n"
+				                  "decoder states, which are not accounted for above");
+			}
+		}
+
+		ImGui::LeftLabel("Budget (MB)");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::InputInt(CONCAT("##_radiosonde_mem_budget_", _this->name), &budget, 16, 128)) {
+			_this->memory.setBudget((size_t)std::max(budget, 0) << 20);
+			onMemoryBudgetChanged(ctx);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Terrain tiles, older tracks and then the details of the current one\n"
+			                  "are released to stay within this size, 0 for no limit");
+		}
+		if (snap.trims) {
+			ImGui::TextDisabled("Trimmed %llu times, %.1fMB released", (unsigned long long)snap.trims, snap.trimmed / 1048576.0);
+		}
+		if (snap.budget && snap.total > snap.budget) {
+			ImGui::TextDisabled("Over budget: the DSP buffers and queues cannot be shrunk");
+		}
+	}
+	/* }}} */
+	/* Performance counters {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Performance##_radiosonde_perf_", _this->name))) {
+		if (ImGui::Checkbox(CONCAT("Hardware counters##_radiosonde_perf_en_", _this->name), &_this->perfEnabled)) {
+			onPerfCountersChanged(ctx);
+		}
+
+		if (_this->perfEnabled && ImGui::BeginTable(CONCAT("##radiosonde_perf_", _this->name), 5, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableNextColumn();
+			ImGui::Text("Stage");
+			ImGui::TableNextColumn();
+			ImGui::Text("IPC");
+			ImGui::TableNextColumn();
+			ImGui::Text("Cyc/smp");
+			ImGui::TableNextColumn();
+			ImGui::Text("Cache/smp");
+			ImGui::TableNextColumn();
+			ImGui::Text("Branch/smp");
+
+			for (radiosonde::PerfStage *stage : _this->perfStages) {
+				const radiosonde::PerfStage::Snapshot snap = stage->snapshot();
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", stage->name);
+				if (!stage->available()) {
+					ImGui::TableNextColumn();
+					ImGui::Text("n/a");
+					continue;
+				}
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2f", snap.ipc());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", snap.perSample(radiosonde::PERF_CYCLES));
+				if (ImGui::IsItemHovered()) {
+					ImGui::SetTooltip("Worst buffer: %.1f cycles/sample", snap.maxCyclesPerSample);
+				}
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", snap.perSample(radiosonde::PERF_CACHE_MISSES));
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", snap.perSample(radiosonde::PERF_BRANCH_MISSES));
+			}
+
+			ImGui::EndTable();
+		}
+
+		const radiosonde::AsyncWriter::Stats writerStats = _this->outputWriter.stats();
+		ImGui::Text("Outputs: %llu frames written, %llu dropped",
+		            (unsigned long long)writerStats.written, (unsigned long long)writerStats.dropped);
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Deepest backlog: %zu/%d frames\nSlowest write: %.1f ms",
+			                  writerStats.maxBacklog, WRITER_QUEUE_SIZE, 1e3 * writerStats.maxWriteSeconds);
+		}
+	}
+	/* }}} */
 
 	if (!_this->enabled) style::endDisabled();
 }
@@ -321,24 +1046,118 @@ void
 RadiosondeDecoderModule::sondeDataHandler(SondeFullData *data, void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
 	_this->lastData = *data;
+	_this->predictor.update(*data);
+	_this->outputWriter.push(*data);
+	if (_this->stationLogOutput) {
+		_this->stationSource->push(*data, _this->tunedFrequency.load(std::memory_order_relaxed));
+	}
+}
+
+/* Called by the channel workers */
+void
+RadiosondeDecoderModule::channelDataHandler(const SondeFullData *data, double frequency, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
 
-	if (data->serial != "") {
-		_this->gpxWriter.startTrack(data->serial.c_str());
+	if (data->serial && (data->lat != 0 || data->lon != 0)) {
+		_this->mapView.addPoint(data->serial, data->lat, data->lon, data->alt);
 	}
-	_this->gpxWriter.addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
-	_this->ptuWriter.addPoint(data);
+	checkMemory(ctx);
+}
+
+void
+RadiosondeDecoderModule::writeFrame(const SondeFullData *data, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	radiosonde::EpochDomain::Guard guard(_this->epoch);
+	PTUWriter *ptu = _this->ptuWriter.get();
+	DeltaSender *sender = _this->deltaSender.get();
+	InfluxSink *influx = _this->influxSink.get();
+
+	/* The GUI thread ends the track under the same lock before swapping or
+	 * stopping the writer, and records the new writer state in the checkpoint */
+	{
+		std::lock_guard<std::mutex> lck(_this->gpxMtx);
+		GPXWriter *gpx = _this->gpxWriter.get();
+
+		if (gpx) {
+			if (data->serial && !gpx->isTracking(data->serial)) {
+				flushTrack(ctx, gpx);
+				gpx->startTrack(data->serial);
+			}
+			if (_this->gpxDecimator.accept(*data)) {
+				gpx->addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
+			}
+		}
+		_this->checkpoint.update(*data, gpx);
+	}
+	if (ptu) ptu->addPoint(data);
+	if (sender) sender->send(*data);
+	if (influx) influx->addFrame(*data);
+
+	/* A new serial number means the previous flight is over */
+	if (data->serial && data->serial != _this->flightSerial) {
+		archiveFlight(ctx);
+		_this->flightSerial = data->serial;
+	}
+	if (_this->flightSerial && (data->lat != 0 || data->lon != 0)) {
+		_this->flightPoints.push_back({(int64_t)data->time, data->lat, data->lon, data->alt});
+		_this->mapView.addPoint(data->serial, data->lat, data->lon, data->alt);
+	}
+	_this->flightBytes.store(_this->flightPoints.capacity() * sizeof(GeoIndex::Point), std::memory_order_relaxed);
+	checkMemory(ctx);
+}
+
+/* End the current track where the sonde was last heard, not at the last point
+ * kept, and start over for the next one. Must be called with gpxMtx held */
+void
+RadiosondeDecoderModule::flushTrack(void *ctx, GPXWriter *gpx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	TrackDecimator::Fix last;
+
+	if (gpx && _this->gpxDecimator.pending(&last)) {
+		gpx->addTrackPoint(last.time, last.lat, last.lon, last.alt, last.spd, last.hdg);
+	}
+	_this->gpxDecimator.reset();
+}
+
+/* Called by the writer thread, or once it is stopped */
+void
+RadiosondeDecoderModule::archiveFlight(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (!_this->flightPoints.empty()) _this->archive.addFlight(serial_name(_this->flightSerial).c_str(), _this->flightPoints);
+	_this->flightPoints.clear();
+	_this->flightSerial = 0;
 }
 
 void
 RadiosondeDecoderModule::onGPXOutputChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	GPXWriter *writer = NULL;
+
+	/* Open the new file before publishing it; the old writer is closed by the
+	 * epoch domain once the frame being processed (if any) is done with it */
 	if (_this->gpxOutput) {
-		_this->gpxOutput = _this->gpxWriter.init(_this->gpxFilename);
-	} else {
-		_this->gpxWriter.deinit();
+		writer = new GPXWriter();
+		_this->gpxOutput = writer->init(_this->gpxFilename);
+		if (!_this->gpxOutput) {
+			delete writer;
+			writer = NULL;
+		}
 	}
+	{
+		std::lock_guard<std::mutex> lck(_this->gpxMtx);
+		flushTrack(ctx, _this->gpxWriter.get());
+		_this->gpxWriter.publish(writer);
+		_this->checkpoint.setGPXState(writer);
+	}
+	_this->checkpoint.setOutputs(_this->gpxOutput ? _this->gpxFilename : NULL, _this->ptuOutput ? _this->ptuFilename : NULL);
 
 	if (_this->gpxOutput) {
 		config.acquire();
@@ -347,15 +1166,36 @@ RadiosondeDecoderModule::onGPXOutputChanged(void *ctx)
 	}
 }
 
+void
+RadiosondeDecoderModule::onGPXRateChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const TrackDecimator::Config gpxRate = _this->gpxDecimator.getConfig();
+
+	config.acquire();
+	config.conf[_this->name]["gpxRate"]["mode"] = gpxRate.mode;
+	config.conf[_this->name]["gpxRate"]["interval"] = gpxRate.interval;
+	config.conf[_this->name]["gpxRate"]["distance"] = gpxRate.distance;
+	config.release(true);
+}
+
 void
 RadiosondeDecoderModule::onPTUOutputChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	PTUWriter *writer = NULL;
+
 	if (_this->ptuOutput) {
-		_this->ptuOutput = _this->ptuWriter.init(_this->ptuFilename);
-	} else {
-		_this->ptuWriter.deinit();
+		writer = new PTUWriter();
+		_this->ptuOutput = writer->init(_this->ptuFilename);
+		if (!_this->ptuOutput) {
+			delete writer;
+			writer = NULL;
+		}
 	}
+	_this->ptuWriter.publish(writer);
+	_this->checkpoint.setOutputs(_this->gpxOutput ? _this->gpxFilename : NULL, _this->ptuOutput ? _this->ptuFilename : NULL);
+
 	if (_this->ptuOutput) {
 		config.acquire();
 		config.conf[_this->name]["ptuPath"] = _this->ptuFilename;
@@ -363,6 +1203,258 @@ RadiosondeDecoderModule::onPTUOutputChanged(void *ctx)
 	}
 }
 
+void
+RadiosondeDecoderModule::onCollectorChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	DeltaSender *sender = NULL;
+
+	if (_this->collectorOutput) {
+		sender = new DeltaSender();
+		_this->collectorOutput = sender->init(_this->collectorAddr);
+		if (!_this->collectorOutput) {
+			delete sender;
+			sender = NULL;
+		}
+	}
+	_this->deltaSender.publish(sender);
+
+	if (_this->collectorOutput) {
+		config.acquire();
+		config.conf[_this->name]["collectorAddr"] = _this->collectorAddr;
+		config.release(true);
+	}
+}
+
+void
+RadiosondeDecoderModule::onInfluxChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	InfluxSink *sink = NULL;
+
+	_this->influxConfig.url = _this->influxUrl;
+	if (_this->influxOutput) {
+		sink = new InfluxSink();
+		for (radiosonde::PerfStage *stage : _this->perfStages) sink->addStage(stage);
+		sink->setMemoryAccount(&_this->memory);
+		_this->influxOutput = sink->start(_this->influxConfig);
+		if (!_this->influxOutput) {
+			delete sink;
+			sink = NULL;
+		}
+	}
+	_this->influxSink.publish(sink);
+
+	if (_this->influxOutput) {
+		config.acquire();
+		config.conf[_this->name]["influx"]["url"] = _this->influxConfig.url;
+		config.release(true);
+	}
+}
+
+void
+RadiosondeDecoderModule::onStationLogChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	StationLog &log = StationLog::shared();
+
+	/* The path is shared: changing it from any instance moves the log for all of them */
+	if (!log.setPath(stationLogPath) || !log.setActive(_this->stationSource, _this->stationLogOutput)) {
+		log.setActive(_this->stationSource, false);
+		_this->stationLogOutput = false;
+	}
+	_this->channels->setStationLog(_this->stationLogOutput);
+
+	config.acquire();
+	config.conf["stationLog"] = stationLogPath;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onMapChanged(void *ctx)
+{
+	/* Both settings are shared, and applied by whichever instance draws the map next */
+	config.acquire();
+	config.conf["map"]["tileDir"] = mapTileDir;
+	config.conf["map"]["cacheSize"] = mapCacheSize;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onChannelsChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	json entries = json::array();
+
+	for (int i=0; i<_this->channels->size(); i++) {
+		const ChannelSet::Config channelConfig = _this->channels->config(i);
+		json entry;
+
+		entry["frequency"] = channelConfig.frequency;
+		entry["type"] = channelConfig.type == CHANNEL_AUTO ? "auto" : sondeTypes[channelConfig.type].key;
+		entry["priority"] = channelConfig.priority;
+		entries.push_back(entry);
+	}
+
+	config.acquire();
+	config.conf[_this->name]["channels"] = entries;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onArchiveDirChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	/* The flight in progress goes to the new directory when it completes */
+	_this->archive.open(_this->archiveDir);
+	_this->searchResults.clear();
+	_this->searchMs = -1;
+
+	config.acquire();
+	config.conf[_this->name]["archiveDir"] = _this->archiveDir;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onArchiveSearch(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	typedef std::chrono::steady_clock clock;
+	GeoIndex::Query query;
+	clock::time_point start;
+
+	query.lat = _this->searchLat;
+	query.lon = _this->searchLon;
+	query.radius = std::max(_this->searchRadius, 0.1f);
+	query.landings = _this->searchLandings;
+	if (_this->searchDays > 0) query.from = time(NULL) - (int64_t)_this->searchDays * 86400;
+
+	start = clock::now();
+	_this->archive.query(query, &_this->searchResults);
+	_this->searchMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+/* Called by the GUI, writer and channel threads, only one of them does the work */
+void
+RadiosondeDecoderModule::checkMemory(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	std::unique_lock<std::mutex> lck(_this->memoryMtx, std::try_to_lock);
+	MemoryAccount &memory = _this->memory;
+	size_t outputs, budget, others, excess, freed, terrainUsage;
+
+	if (!lck.owns_lock() || now < _this->nextMemoryCheck) return;
+	_this->nextMemoryCheck = now + MEMORY_CHECK_INTERVAL;
+
+	outputs = _this->outputWriter.memoryUsage() + _this->stationSource->memoryUsage();
+	{
+		radiosonde::EpochDomain::Guard guard(_this->epoch);
+		const InfluxSink *sink = _this->influxSink.get();
+		if (sink) outputs += sink->memoryUsage();
+	}
+
+	/* The decoder blocks are only wrappers, what they decode into is opaque */
+	memory.set(MemoryAccount::MEM_DSP, _this->dspBytes.load(std::memory_order_relaxed) + _this->fanout.memoryUsage()
+	                                 + sizeof(_this->rs41decoder) + sizeof(_this->dfm09decoder) + sizeof(_this->ims100decoder)
+	                                 + sizeof(_this->m10decoder) + sizeof(_this->imet4decoder) + sizeof(_this->c50decoder)
+	                                 + sizeof(_this->mrzn1decoder));
+	memory.set(MemoryAccount::MEM_CHANNELS, _this->channels->memoryUsage());
+	memory.set(MemoryAccount::MEM_TRACKS, _this->mapView.memoryUsage() + _this->flightBytes.load(std::memory_order_relaxed));
+	memory.set(MemoryAccount::MEM_PREDICTOR, _this->predictor.memoryUsage());
+	memory.set(MemoryAccount::MEM_TERRAIN, _this->terrain.usage());
+	memory.set(MemoryAccount::MEM_OUTPUTS, outputs);
+
+	/* The terrain tiles are a cache, they get whatever the rest leaves */
+	budget = memory.budget();
+	others = memory.total() - memory.get(MemoryAccount::MEM_TERRAIN);
+	terrainUsage = memory.get(MemoryAccount::MEM_TERRAIN);
+	if (!budget) {
+		_this->terrainBudget = TERRAIN_DEFAULT_BUDGET;
+	} else {
+		_this->terrainBudget = budget > others ? std::min(budget - others, TERRAIN_DEFAULT_BUDGET) : 0;
+	}
+	_this->terrain.setBudget(_this->terrainBudget);
+	memory.set(MemoryAccount::MEM_TERRAIN, _this->terrain.usage());
+	freed = terrainUsage - std::min(terrainUsage, memory.get(MemoryAccount::MEM_TERRAIN));
+
+	/* Then the flights before the current one, then the details of the current one.
+	 * The archive points are what the flight will be archived with, they are kept */
+	if ((excess = memory.excess())) {
+		const size_t tracks = _this->mapView.trim(excess, false);
+		const size_t details = tracks < excess ? _this->mapView.trim(excess - tracks, true) : 0;
+
+		memory.set(MemoryAccount::MEM_TRACKS, _this->mapView.memoryUsage() + _this->flightBytes.load(std::memory_order_relaxed));
+		freed += tracks + details;
+	}
+	if (freed) memory.addTrim(freed);
+}
+
+void
+RadiosondeDecoderModule::onMemoryBudgetChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	config.acquire();
+	config.conf[_this->name]["memoryBudget"] = _this->memory.budget() >> 20;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onPerfCountersChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	for (radiosonde::PerfStage *stage : _this->perfStages) {
+		stage->reset();
+		stage->enabled = _this->perfEnabled;
+	}
+}
+
+void
+RadiosondeDecoderModule::onPredictionChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const LandingPredictor::Config predictorConfig = _this->predictor.getConfig();
+
+	if (_this->predictionEnabled) {
+		_this->predictor.start();
+	} else {
+		_this->predictor.stop();
+	}
+
+	config.acquire();
+	config.conf[_this->name]["prediction"]["enabled"] = _this->predictionEnabled;
+	config.conf[_this->name]["prediction"]["burstAlt"] = predictorConfig.burstAlt;
+	config.conf[_this->name]["prediction"]["members"] = predictorConfig.members;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onWindDirChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->windField.setDirectory(_this->windDir);
+
+	config.acquire();
+	config.conf[_this->name]["prediction"]["windDir"] = _this->windDir;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onDemDirChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->terrain.setDirectory(_this->demDir);
+
+	config.acquire();
+	config.conf[_this->name]["prediction"]["demDir"] = _this->demDir;
+	config.release(true);
+}
+
 void
 RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
 {
@@ -372,15 +1464,21 @@ RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
 	/* Ensure that the selection is within bounds */
 	if (selection > sizeof(_this->supportedTypes)/sizeof(_this->supportedTypes[0])) return;
 
-	/* Spin down the currently active decoder */
-	_this->lastData.init();
+	/* Spin down the currently active decoder. stop() joins its thread, so once
+	 * it returns no frame can be in flight and lastData can be safely reset */
 	if (_this->activeDecoder) _this->activeDecoder->stop();
 	_this->activeDecoder = NULL;
+	_this->lastData.init();
 
 	/* If selection is negative, just stop here */
 	if (selection < 0) return;
 	_this->selectedType = selection;
 
+	/* The decoders of the other types will start over anyway, free their state */
+	for (int i=0; i<IM_ARRAYSIZE(_this->supportedTypes); i++) {
+		if (i != selection) std::get<2>(_this->supportedTypes[i])->release();
+	}
+
 	/* Save selection to config */
 	config.acquire();
 	config.conf[_this->name]["sondeType"] = selection;
@@ -394,9 +1492,13 @@ RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
 	if (_this->vfo) sigpath::vfoManager.deleteVFO(_this->vfo);
 	_this->vfo = sigpath::vfoManager.createVFO(_this->name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
 	_this->vfo->setSnapInterval(SNAP_INTERVAL);
+	_this->tunedFrequency.store(gui::waterfall.getCenterFrequency(), std::memory_order_relaxed);
 	_this->fmDemod.setInput(_this->vfo->output);
 	_this->fmDemod.start();
 
+	/* VFO output, then the demodulator and resampler outputs */
+	_this->dspBytes.store(streamBytes<dsp::complex_t>() + 2 * streamBytes<float>(), std::memory_order_relaxed);
+
 	_this->resampler.setInSamplerate(bw);
 
 	/* Spin up the appropriate decoder */
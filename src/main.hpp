@@ -6,12 +6,29 @@
 #include <dsp/demod/fm.h>
 #include <dsp/window/blackman.h>
 #include <signal_path/signal_path.h>
+#include "channels.hpp"
+#include "checkpoint.hpp"
+#include "decimator.hpp"
 #include "decode/decoder.hpp"
+#include "delta.hpp"
+#include "epoch.hpp"
+#include "fanout.hpp"
+#include "geoindex.hpp"
 #include "gpx.hpp"
+#include "influx.hpp"
+#include "mapview.hpp"
+#include "memory.hpp"
+#include "perf.hpp"
+#include "predictor.hpp"
 #include "ptu.hpp"
+#include "stationlog.hpp"
+#include "terrain.hpp"
+#include "tilecache.hpp"
+#include "windfield.hpp"
+#include "writer.hpp"
 
 /* Display name, bandwidth, decoder */
-typedef std::tuple<const char*, float, dsp::block*> sondespec_t;
+typedef std::tuple<const char*, float, radiosonde::DecoderBlock*> sondespec_t;
 
 class RadiosondeDecoderModule : public ModuleManager::Instance {
 public:
@@ -26,20 +43,40 @@ public:
 private:
 	std::string name;
 	bool enabled = true;
-	bool gpxOutput = false, ptuOutput = false;
+	bool gpxOutput = false, ptuOutput = false, collectorOutput = false, influxOutput = false, stationLogOutput = false;
 	char gpxFilename[2048];
 	char ptuFilename[2048];
+	char collectorAddr[256];
+	char influxUrl[1024];
+	static char stationLogPath[2048];   /* Shared by all instances, like the log itself */
+	static char mapTileDir[2048];       /* Shared by all instances, like the tile cache */
+	static int mapCacheSize;            /* MB */
+	InfluxSink::Config influxConfig;
+	TrackDecimator gpxDecimator;        /* GPX points only, the other outputs get every frame */
+	std::mutex gpxMtx;                  /* Protects the decimator and the track of the GPX writer */
 	VFOManager::VFO *vfo;
-	dsp::demod::FM<float> fmDemod;
-	dsp::multirate::RationalResampler<float> resampler;
+	std::atomic<double> tunedFrequency{0};  /* Hz, main VFO, set by the GUI thread for the DSP thread */
 
-	radiosonde::Decoder<RS41Decoder, rs41_decoder_init, rs41_decoder_deinit, rs41_decode> rs41decoder;
-	radiosonde::Decoder<DFM09Decoder, dfm09_decoder_init, dfm09_decoder_deinit, dfm09_decode> dfm09decoder;
-	radiosonde::Decoder<IMS100Decoder, ims100_decoder_init, ims100_decoder_deinit, ims100_decode> ims100decoder;
-	radiosonde::Decoder<M10Decoder, m10_decoder_init, m10_decoder_deinit, m10_decode> m10decoder;
-	radiosonde::Decoder<IMET4Decoder, imet4_decoder_init, imet4_decoder_deinit, imet4_decode> imet4decoder;
-	radiosonde::Decoder<C50Decoder, c50_decoder_init, c50_decoder_deinit, c50_decode> c50decoder;
-	radiosonde::Decoder<MRZN1Decoder, mrzn1_decoder_init, mrzn1_decoder_deinit, mrzn1_decode> mrzn1decoder;
+	/* Hardware counters for each stage of the DSP path */
+	radiosonde::PerfStage demodStage{"Demodulator"};
+	radiosonde::PerfStage resamplerStage{"Resampler"};
+	radiosonde::PerfStage fanoutStage{"Fan-out"};
+	radiosonde::PerfStage decoderStage{"Decoder"};
+	radiosonde::PerfStage *const perfStages[4] = {&demodStage, &resamplerStage, &fanoutStage, &decoderStage};
+	bool perfEnabled = false;
+
+	radiosonde::Instrumented<dsp::demod::FM<float>> fmDemod;
+	radiosonde::Instrumented<dsp::multirate::RationalResampler<float>> resampler;
+	radiosonde::FanOut<float>::Reader decoderTap;
+	radiosonde::Instrumented<radiosonde::FanOut<float>> fanout;
+
+	radiosonde::Instrumented<radiosonde::Decoder<RS41Decoder, rs41_decoder_init, rs41_decoder_deinit, rs41_decode>> rs41decoder;
+	radiosonde::Instrumented<radiosonde::Decoder<DFM09Decoder, dfm09_decoder_init, dfm09_decoder_deinit, dfm09_decode>> dfm09decoder;
+	radiosonde::Instrumented<radiosonde::Decoder<IMS100Decoder, ims100_decoder_init, ims100_decoder_deinit, ims100_decode>> ims100decoder;
+	radiosonde::Instrumented<radiosonde::Decoder<M10Decoder, m10_decoder_init, m10_decoder_deinit, m10_decode>> m10decoder;
+	radiosonde::Instrumented<radiosonde::Decoder<IMET4Decoder, imet4_decoder_init, imet4_decoder_deinit, imet4_decode>> imet4decoder;
+	radiosonde::Instrumented<radiosonde::Decoder<C50Decoder, c50_decoder_init, c50_decoder_deinit, c50_decode>> c50decoder;
+	radiosonde::Instrumented<radiosonde::Decoder<MRZN1Decoder, mrzn1_decoder_init, mrzn1_decoder_deinit, mrzn1_decode>> mrzn1decoder;
 
 	const sondespec_t supportedTypes[7] = {
 		sondespec_t("RS41", 1e4, &rs41decoder),
@@ -51,15 +88,83 @@ private:
 		sondespec_t("MRZ-N1", 2e4, &mrzn1decoder),
 	};
 	int selectedType = -1;
-	dsp::block *activeDecoder;
+	radiosonde::DecoderBlock *activeDecoder;
 
 	SondeFullData lastData;
-	GPXWriter gpxWriter;
-	PTUWriter ptuWriter;
+	WindField windField;
+	char windDir[2048];
+	Terrain terrain;
+	char demDir[2048];
+	LandingPredictor predictor;
+	bool predictionEnabled = false;
+
+	/* Saved periodically, so that a restart resumes the same flight */
+	FlightCheckpoint checkpoint;
+
+	/* Output writers are swapped by the GUI thread while the writer thread uses them */
+	radiosonde::EpochDomain epoch;
+	radiosonde::Published<GPXWriter> gpxWriter{epoch};
+	radiosonde::Published<PTUWriter> ptuWriter{epoch};
+	radiosonde::Published<DeltaSender> deltaSender{epoch};
+	radiosonde::Published<InfluxSink> influxSink{epoch};
+
+	/* Frames are written out on their own thread, so that a slow disk or network cannot cost samples */
+	radiosonde::AsyncWriter outputWriter;
+
+	/* Frames merged with those of the other instances, in receive order */
+	StationLog::Source *stationSource;
+
+	/* Current and recent tracks, fed by the writer thread and the channels */
+	MapView mapView;
+
+	/* Additional frequencies decoded at the same time, on the shared pool */
+	ChannelSet *channels;
+	double newChannelFreq = 403.0;      /* MHz */
+
+	/* Completed flights, indexed by position and time. The track of the current
+	 * flight is only accessed by the writer thread */
+	GeoIndex archive;
+	char archiveDir[2048];
+	SerialRef flightSerial;
+	std::vector<GeoIndex::Point> flightPoints;
+
+	/* Footprint of the instance. Checked against the budget at most every
+	 * MEMORY_CHECK_INTERVAL by whichever thread gets there first */
+	MemoryAccount memory;
+	std::mutex memoryMtx;               /* Held while checking, protects the two below */
+	double nextMemoryCheck = 0;         /* Steady clock seconds */
+	size_t terrainBudget = TERRAIN_DEFAULT_BUDGET;
+	std::atomic<size_t> dspBytes{0};    /* Stream buffers of the main VFO path, set by the GUI thread */
+	std::atomic<size_t> flightBytes{0}; /* Archive points of the current flight, set by the writer thread */
+
+	/* Archive search from the GUI */
+	float searchLat = 0, searchLon = 0, searchRadius = 50;
+	int searchDays = 365;
+	bool searchLandings = false;
+	std::vector<GeoIndex::Match> searchResults;
+	double searchMs = -1;
 
 	static void menuHandler(void *ctx);
 	static void sondeDataHandler(SondeFullData *data, void *ctx);
+	static void writeFrame(const SondeFullData *data, void *ctx);
+	static void channelDataHandler(const SondeFullData *data, double frequency, void *ctx);
 	static void onTypeSelected(void *ctx, int selection);
 	static void onGPXOutputChanged(void *ctx);
+	static void onGPXRateChanged(void *ctx);
 	static void onPTUOutputChanged(void *ctx);
+	static void onCollectorChanged(void *ctx);
+	static void onInfluxChanged(void *ctx);
+	static void onStationLogChanged(void *ctx);
+	static void onMapChanged(void *ctx);
+	static void onChannelsChanged(void *ctx);
+	static void onArchiveDirChanged(void *ctx);
+	static void onArchiveSearch(void *ctx);
+	static void archiveFlight(void *ctx);
+	static void flushTrack(void *ctx, GPXWriter *gpx);
+	static void onPerfCountersChanged(void *ctx);
+	static void checkMemory(void *ctx);
+	static void onMemoryBudgetChanged(void *ctx);
+	static void onPredictionChanged(void *ctx);
+	static void onWindDirChanged(void *ctx);
+	static void onDemDirChanged(void *ctx);
 };
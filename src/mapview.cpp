@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <math.h>
+#include "mapview.hpp"
+#include "tilecache.hpp"
+
+#define MAP_TILE_SIZE 256           /* Pixels per tile side at integer zoom levels */
+#define MAP_ZOOM_STEP 0.25          /* Zoom levels per mouse wheel notch */
+#define MAP_FALLBACK_LEVELS 4       /* Parent levels magnified while a tile loads */
+#define MAX_MERCATOR_LAT 85.05112878
+#define EARTH_CIRCUMFERENCE 40075016.686
+
+#define MAP_BACKGROUND IM_COL32(32,32,36,255)
+#define TRACK_COLOR IM_COL32(255,64,64,255)
+#define OLD_TRACK_COLOR IM_COL32(64,160,255,200)
+#define LANDING_COLOR IM_COL32(255,234,0,255)
+
+MapView::MapView()
+{
+	follow = true;
+	m_center = {0.5, 0.5};
+	m_zoom = 2;
+	m_drawMs = 0;
+}
+
+void
+MapView::addPoint(SerialId serial, double lat, double lon, float alt)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const Vertex vertex = project(lat, lon);
+	auto it = std::find_if(m_tracks.rbegin(), m_tracks.rend(), [&](const Track &track) { return track.serial == serial; });
+
+	if (it == m_tracks.rend()) {
+		if (m_tracks.size() >= MAP_MAX_TRACKS) m_tracks.pop_front();
+		m_tracks.emplace_back();
+		m_tracks.back().serial = serial;
+		m_tracks.back().min = m_tracks.back().max = vertex;
+		it = m_tracks.rbegin();
+	} else if (it != m_tracks.rbegin()) {
+		/* The track being received is always the last one: it is drawn as the
+		 * current flight and trimmed last */
+		Track moved = std::move(*it);
+		m_tracks.erase(std::next(it).base());
+		m_tracks.push_back(std::move(moved));
+		it = m_tracks.rbegin();
+	}
+
+	/* Every level keeps the points at least MAP_LOD_PIXELS away from the previous one it kept */
+	Track &track = *it;
+	for (int z=0; z<=MAP_MAX_ZOOM; z++) {
+		std::vector<Vertex> &level = track.levels[z];
+		const double tolerance = MAP_LOD_PIXELS / (MAP_TILE_SIZE * (double)(1 << z));
+
+		if (level.empty() || hypot(vertex.x - level.back().x, vertex.y - level.back().y) >= tolerance) {
+			level.push_back(vertex);
+		}
+	}
+	track.min = {std::min(track.min.x, vertex.x), std::min(track.min.y, vertex.y)};
+	track.max = {std::max(track.max.x, vertex.x), std::max(track.max.y, vertex.y)};
+	track.last = vertex;
+	track.lastAlt = alt;
+}
+
+size_t
+MapView::memoryUsage()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	size_t bytes = 0;
+
+	for (const Track &track : m_tracks) bytes += trackBytes(track);
+	return bytes;
+}
+
+size_t
+MapView::trim(size_t bytes, bool current)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	size_t freed = 0;
+
+	while (freed < bytes && m_tracks.size() > 1) {
+		freed += trackBytes(m_tracks.front());
+		m_tracks.pop_front();
+	}
+	if (!current || m_tracks.empty()) return freed;
+
+	/* Every other point is what the next level up keeps anyway; the last one stays */
+	Track &track = m_tracks.back();
+	for (int z=MAP_MAX_ZOOM; z>0 && freed < bytes; z--) {
+		std::vector<Vertex> &level = track.levels[z];
+		const size_t capacity = level.capacity();
+		size_t n = 0;
+
+		if (level.size() < 3) continue;
+		for (size_t i=0; i<level.size(); i+=2) level[n++] = level[i];
+		if (level.size() % 2 == 0) level[n++] = level.back();
+		level.resize(n);
+		level.shrink_to_fit();
+		freed += (capacity - level.capacity()) * sizeof(Vertex);
+	}
+	return freed;
+}
+
+void
+MapView::draw(const char *id, float width, float height, const LandingPrediction *prediction)
+{
+	typedef std::chrono::steady_clock clock;
+	const clock::time_point start = clock::now();
+	TileCache &cache = TileCache::shared();
+	ImDrawList *drawList = ImGui::GetWindowDrawList();
+	ImGuiIO &io = ImGui::GetIO();
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	const ImVec2 end(origin.x + width, origin.y + height);
+	const ImVec2 middle(origin.x + width / 2, origin.y + height / 2);
+	double scale;
+	int z, n, level;
+
+	ImGui::InvisibleButton(id, ImVec2(width, height));
+
+	/* Zoom around the mouse cursor, pan by dragging */
+	scale = MAP_TILE_SIZE * pow(2, m_zoom);
+	if (ImGui::IsItemHovered() && io.MouseWheel != 0) {
+		const ImVec2 mouse = ImGui::GetMousePos();
+		const Vertex anchor = {m_center.x + (mouse.x - middle.x) / scale, m_center.y + (mouse.y - middle.y) / scale};
+
+		m_zoom = std::min(std::max(m_zoom + io.MouseWheel * MAP_ZOOM_STEP, 0.0), (double)MAP_MAX_ZOOM);
+		scale = MAP_TILE_SIZE * pow(2, m_zoom);
+		m_center = {anchor.x - (mouse.x - middle.x) / scale, anchor.y - (mouse.y - middle.y) / scale};
+	}
+	if (ImGui::IsItemActive() && (io.MouseDelta.x != 0 || io.MouseDelta.y != 0)) {
+		m_center.x -= io.MouseDelta.x / scale;
+		m_center.y -= io.MouseDelta.y / scale;
+		follow = false;
+	}
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+
+	if (follow && !m_tracks.empty()) m_center = m_tracks.back().last;
+	m_center.x -= floor(m_center.x);
+	m_center.y = std::min(std::max(m_center.y, 0.0), 1.0);
+
+	auto toScreen = [&](const Vertex &v) {
+		return ImVec2(middle.x + (v.x - m_center.x) * scale, middle.y + (v.y - m_center.y) * scale);
+	};
+
+	drawList->PushClipRect(origin, end, true);
+	drawList->AddRectFilled(origin, end, MAP_BACKGROUND);
+
+	/* Tiles from the closest zoom level, scaled to the fractional zoom */
+	z = std::min(std::max((int)lround(m_zoom), 0), MAP_MAX_ZOOM);
+	n = 1 << z;
+	cache.update(ImGui::GetFrameCount());
+
+	const int x0 = (int)floor((m_center.x - width / 2 / scale) * n);
+	const int x1 = (int)floor((m_center.x + width / 2 / scale) * n);
+	const int y0 = std::max((int)floor((m_center.y - height / 2 / scale) * n), 0);
+	const int y1 = std::min((int)floor((m_center.y + height / 2 / scale) * n), n - 1);
+
+	for (int ty=y0; ty<=y1; ty++) {
+		for (int tx=x0; tx<=x1; tx++) {
+			const int wx = (tx % n + n) % n;
+			const ImVec2 p0 = toScreen({(double)tx / n, (double)ty / n});
+			const ImVec2 p1 = toScreen({(double)(tx + 1) / n, (double)(ty + 1) / n});
+			ImVec2 uv0(0, 0), uv1(1, 1);
+			uint32_t texture = cache.get(z, wx, ty);
+
+			/* Until the tile is loaded, magnify the part of a parent that covers it */
+			for (int up=1; !texture && up<=MAP_FALLBACK_LEVELS && up<=z; up++) {
+				if ((texture = cache.peek(z - up, wx >> up, ty >> up))) {
+					const float frac = 1.0f / (1 << up);
+					uv0 = ImVec2((wx & ((1 << up) - 1)) * frac, (ty & ((1 << up) - 1)) * frac);
+					uv1 = ImVec2(uv0.x + frac, uv0.y + frac);
+				}
+			}
+			if (texture) drawList->AddImage((ImTextureID)(uintptr_t)texture, p0, p1, uv0, uv1);
+		}
+	}
+
+	/* Tracks, at the first level whose points are at most MAP_LOD_PIXELS apart on screen */
+	level = std::min(std::max((int)ceil(m_zoom), 0), MAP_MAX_ZOOM);
+	const Vertex viewMin = {m_center.x - width / scale, m_center.y - height / scale};
+	const Vertex viewMax = {m_center.x + width / scale, m_center.y + height / scale};
+
+	for (size_t i=0; i<m_tracks.size(); i++) {
+		const Track &track = m_tracks[i];
+		const bool current = i == m_tracks.size() - 1;
+		const ImU32 color = current ? TRACK_COLOR : OLD_TRACK_COLOR;
+		const float thickness = current ? 2.0f : 1.5f;
+		const Vertex *prev = NULL;
+
+		if (track.max.x < viewMin.x || track.min.x > viewMax.x || track.max.y < viewMin.y || track.min.y > viewMax.y) {
+			continue;
+		}
+
+		/* Only the stretches around the view, with half a view of margin */
+		m_screen.clear();
+		auto visit = [&](const Vertex &v) {
+			const bool inside = v.x >= viewMin.x && v.x <= viewMax.x && v.y >= viewMin.y && v.y <= viewMax.y;
+			const bool prevInside = prev && prev->x >= viewMin.x && prev->x <= viewMax.x && prev->y >= viewMin.y && prev->y <= viewMax.y;
+
+			if (inside || prevInside) {
+				if (m_screen.empty() && prev) m_screen.push_back(toScreen(*prev));
+				m_screen.push_back(toScreen(v));
+			} else if (!m_screen.empty()) {
+				if (m_screen.size() > 1) drawList->AddPolyline(m_screen.data(), m_screen.size(), color, 0, thickness);
+				m_screen.clear();
+			}
+			prev = &v;
+		};
+		for (const Vertex &v : track.levels[level]) visit(v);
+		visit(track.last);
+		if (m_screen.size() > 1) drawList->AddPolyline(m_screen.data(), m_screen.size(), color, 0, thickness);
+
+		const ImVec2 last = toScreen(track.last);
+		drawList->AddCircleFilled(last, current ? 4.0f : 3.0f, color);
+		if (current) drawList->AddText(ImVec2(last.x + 6, last.y - 6), color, serial_name(track.serial).c_str());
+	}
+
+	/* Predicted landing point and dispersion */
+	if (prediction && prediction->valid) {
+		const ImVec2 landing = toScreen(project(prediction->lat, prediction->lon));
+		const double metersPerUnit = EARTH_CIRCUMFERENCE * cos(prediction->lat * M_PI / 180);
+
+		if (!m_tracks.empty()) drawList->AddLine(toScreen(m_tracks.back().last), landing, LANDING_COLOR);
+		drawList->AddCircle(toScreen(project(prediction->meanLat, prediction->meanLon)),
+		                    std::max(prediction->semiMajor / metersPerUnit * scale, 3.0), LANDING_COLOR, 0, 1.5f);
+		drawList->AddCircleFilled(landing, 3.0f, LANDING_COLOR);
+	}
+
+	drawList->PopClipRect();
+	m_drawMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+/* Private methods {{{ */
+MapView::Vertex
+MapView::project(double lat, double lon)
+{
+	const double phi = std::min(std::max(lat, -MAX_MERCATOR_LAT), MAX_MERCATOR_LAT) * M_PI / 180;
+	return {(lon + 180) / 360, (1 - asinh(tan(phi)) / M_PI) / 2};
+}
+
+size_t
+MapView::trackBytes(const Track &track)
+{
+	size_t bytes = sizeof(Track);
+
+	for (const std::vector<Vertex> &level : track.levels) bytes += level.capacity() * sizeof(Vertex);
+	return bytes;
+}
+/* }}} */
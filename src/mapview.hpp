@@ -0,0 +1,92 @@
+#pragma once
+
+#include <deque>
+#include <imgui.h>
+#include <mutex>
+#include <vector>
+#include "predictor.hpp"
+#include "serials.hpp"
+
+#define MAP_MAX_TRACKS 8            /* Recent flights kept on the map, the current one included */
+#define MAP_MAX_ZOOM 18
+#define MAP_LOD_PIXELS 1.5          /* Track points closer than this on screen are merged */
+
+/**
+ * Map of the current and recent flights, drawn in the module's menu over the
+ * tiles of TileCache::shared(). Tracks are stored in Web Mercator coordinates,
+ * already decimated for every zoom level as points arrive: drawing only ever
+ * goes through the points that are at least MAP_LOD_PIXELS apart at the
+ * current zoom, however long the flights.
+ */
+class MapView {
+public:
+	MapView();
+
+	/**
+	 * Add a position to the track of a sonde. Thread-safe, the writer thread
+	 * and the channel workers all call it: a new serial number starts a new
+	 * track, and the track that last received a point is the current flight.
+	 *
+	 * @param serial serial number of the sonde
+	 * @param lat latitude, degrees
+	 * @param lon longitude, degrees
+	 * @param alt altitude, meters
+	 */
+	void addPoint(SerialId serial, double lat, double lon, float alt);
+
+	/**
+	 * Draw the map at the cursor position, and handle panning (drag) and
+	 * zooming (mouse wheel). GUI thread only.
+	 *
+	 * @param id unique ImGui identifier
+	 * @param width width of the map, pixels
+	 * @param height height of the map, pixels
+	 * @param prediction landing prediction to show, or NULL
+	 */
+	void draw(const char *id, float width, float height, const LandingPrediction *prediction);
+
+	/**
+	 * Bytes held by the tracks. Thread-safe.
+	 */
+	size_t memoryUsage();
+
+	/**
+	 * Release track history to save memory. The oldest flights go first, then
+	 * the current one loses its finest details, from the closest zoom level
+	 * up: every other point of the level is dropped. Thread-safe.
+	 *
+	 * @param bytes how much memory to release
+	 * @param current whether to thin out the current flight once the others are gone
+	 * @return bytes actually released
+	 */
+	size_t trim(size_t bytes, bool current);
+
+	/* Keep the latest position of the current flight in the center */
+	bool follow;
+
+	/* Time spent in the last draw(), milliseconds */
+	double drawMs() const { return m_drawMs; }
+
+private:
+	struct Vertex {
+		double x, y;                /* Web Mercator, [0, 1) */
+	};
+	struct Track {
+		SerialRef serial;
+		std::vector<Vertex> levels[MAP_MAX_ZOOM + 1];
+		Vertex min, max, last;
+		float lastAlt;
+	};
+
+	static Vertex project(double lat, double lon);
+	static size_t trackBytes(const Track &track);
+
+	std::mutex m_mtx;               /* Protects the tracks */
+	std::deque<Track> m_tracks;     /* Most recent last */
+
+	/* GUI thread only */
+	Vertex m_center;
+	double m_zoom;
+	double m_drawMs;
+	std::vector<ImVec2> m_screen;
+};
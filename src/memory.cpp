@@ -0,0 +1,95 @@
+#include "memory.hpp"
+
+static const char *componentNames[] = {"DSP", "Decoders", "Channels", "Tracks", "Predictor", "Terrain", "Outputs"};
+static const char *componentKeys[] = {"dsp", "decoders", "channels", "tracks", "predictor", "terrain", "outputs"};
+
+MemoryAccount::MemoryAccount()
+{
+	for (int i=0; i<MEM_COMPONENTS; i++) m_bytes[i] = 0;
+	m_budget = 0;
+	m_trims = 0;
+	m_trimmed = 0;
+}
+
+void
+MemoryAccount::set(Component component, size_t bytes)
+{
+	m_bytes[component].store(bytes, std::memory_order_relaxed);
+}
+
+size_t
+MemoryAccount::get(Component component) const
+{
+	return m_bytes[component].load(std::memory_order_relaxed);
+}
+
+size_t
+MemoryAccount::total() const
+{
+	size_t total = 0;
+
+	for (int i=0; i<MEM_COMPONENTS; i++) total += m_bytes[i].load(std::memory_order_relaxed);
+	return total;
+}
+
+void
+MemoryAccount::setBudget(size_t budget)
+{
+	m_budget.store(budget, std::memory_order_relaxed);
+}
+
+size_t
+MemoryAccount::budget() const
+{
+	return m_budget.load(std::memory_order_relaxed);
+}
+
+size_t
+MemoryAccount::excess() const
+{
+	const size_t budget = m_budget.load(std::memory_order_relaxed);
+	const size_t total = this->total();
+
+	return budget && total > budget ? total - budget : 0;
+}
+
+void
+MemoryAccount::addTrim(size_t bytes)
+{
+	m_trims.fetch_add(1, std::memory_order_relaxed);
+	m_trimmed.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+MemoryAccount::Snapshot
+MemoryAccount::snapshot() const
+{
+	Snapshot snap;
+
+	snap.total = 0;
+	for (int i=0; i<MEM_COMPONENTS; i++) {
+		snap.bytes[i] = m_bytes[i].load(std::memory_order_relaxed);
+		snap.total += snap.bytes[i];
+	}
+	snap.budget = m_budget.load(std::memory_order_relaxed);
+	snap.trims = m_trims.load(std::memory_order_relaxed);
+	snap.trimmed = m_trimmed.load(std::memory_order_relaxed);
+	return snap;
+}
+
+const char*
+MemoryAccount::componentName(Component component)
+{
+	return component >= 0 && component < MEM_COMPONENTS ? componentNames[component] : "";
+}
+
+const char*
+MemoryAccount::componentKey(Component component)
+{
+	return component >= 0 && component < MEM_COMPONENTS ? componentKeys[component] : "";
+}
+
+bool
+MemoryAccount::measurable(Component component)
+{
+	return component != MEM_DECODERS;
+}
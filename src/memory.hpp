@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <dsp/stream.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_CHECK_INTERVAL 1.0   /* Seconds between two budget checks */
+
+/**
+ * Bytes held by a dsp::stream, which double-buffers STREAM_BUFFER_SIZE samples
+ * whatever the block actually writes into it.
+ */
+template<typename T>
+constexpr size_t streamBytes() { return 2 * (size_t)STREAM_BUFFER_SIZE * sizeof(T); }
+
+/**
+ * Memory used by one module instance, broken down by component. Components
+ * report the buffers they allocate themselves rather than what the allocator
+ * hands out, so that instances can be compared and a budget enforced; the
+ * internal state of the sondedump decoders is opaque and only shows in the
+ * process total, its row stays as a reminder that it is not included.
+ *
+ * Set by whichever thread measures the components, read from any.
+ */
+class MemoryAccount {
+public:
+	enum Component {
+		MEM_DSP,            /* VFO, demodulator, resampler, fan-out and decoder blocks */
+		MEM_DECODERS,       /* Decoder states, not measurable: sondedump does not expose their size */
+		MEM_CHANNELS,       /* Additional channels, VFOs and queues included */
+		MEM_TRACKS,         /* Map tracks and archive points of the current flight */
+		MEM_PREDICTOR,      /* Ensemble, wind profile and queued frames */
+		MEM_TERRAIN,        /* Mapped elevation tiles */
+		MEM_OUTPUTS,        /* Writer, station log and InfluxDB queues and batches */
+		MEM_COMPONENTS
+	};
+	struct Snapshot {
+		size_t bytes[MEM_COMPONENTS];
+		size_t total;
+		size_t budget;              /* 0 if unlimited */
+		uint64_t trims;             /* Times history or caches were shrunk to fit the budget */
+		uint64_t trimmed;           /* Bytes released by trimming */
+	};
+
+	MemoryAccount();
+
+	void set(Component component, size_t bytes);
+	size_t get(Component component) const;
+	size_t total() const;
+
+	/**
+	 * @param budget maximum footprint of the instance in bytes, 0 for no limit
+	 */
+	void setBudget(size_t budget);
+	size_t budget() const;
+
+	/**
+	 * @return bytes over budget, 0 if within budget or unlimited
+	 */
+	size_t excess() const;
+
+	/**
+	 * Account for a trim that released some memory.
+	 *
+	 * @param bytes bytes released
+	 */
+	void addTrim(size_t bytes);
+
+	Snapshot snapshot() const;
+
+	/* Display name, and field name in the metrics */
+	static const char *componentName(Component component);
+	static const char *componentKey(Component component);
+
+	/**
+	 * @return false for components that always read 0 because their size is
+	 *         not known, and must be shown as such rather than as empty
+	 */
+	static bool measurable(Component component);
+
+private:
+	std::atomic<size_t> m_bytes[MEM_COMPONENTS];
+	std::atomic<size_t> m_budget;
+	std::atomic<uint64_t> m_trims, m_trimmed;
+};
@@ -0,0 +1,186 @@
+#include "mmap.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	m_data = NULL;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = m_mapping = NULL;
+#else
+	m_fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+bool
+MappedFile::open(const char *fname, bool writable)
+{
+	LARGE_INTEGER size;
+
+	close();
+	m_file = CreateFileA(fname, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+	                     NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size)) {
+		close();
+		return false;
+	}
+	m_size = size.QuadPart;
+	return map(writable);
+}
+
+bool
+MappedFile::create(const char *fname, size_t size)
+{
+	LARGE_INTEGER offset;
+
+	close();
+	m_file = CreateFileA(fname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		close();
+		return false;
+	}
+	offset.QuadPart = size;
+	if (!SetFilePointerEx(m_file, offset, NULL, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+		close();
+		return false;
+	}
+	m_size = size;
+	return map(true);
+}
+
+void
+MappedFile::sync(bool async)
+{
+	if (!m_data) return;
+	FlushViewOfFile(m_data, 0);
+	if (!async) FlushFileBuffers(m_file);
+}
+
+void
+MappedFile::prefetch()
+{
+	WIN32_MEMORY_RANGE_ENTRY range;
+
+	if (!m_data) return;
+	range.VirtualAddress = m_data;
+	range.NumberOfBytes = m_size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void
+MappedFile::close()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file && m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+	m_data = m_mapping = m_file = NULL;
+	m_size = 0;
+}
+
+bool
+MappedFile::map(bool writable)
+{
+	if (!m_size) return false;
+	m_mapping = CreateFileMappingA(m_file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	if (!m_mapping) {
+		close();
+		return false;
+	}
+	m_data = MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	if (!m_data) {
+		close();
+		return false;
+	}
+	return true;
+}
+#else
+bool
+MappedFile::open(const char *fname, bool writable)
+{
+	struct stat st;
+
+	close();
+	if ((m_fd = ::open(fname, writable ? O_RDWR : O_RDONLY)) < 0) return false;
+	if (fstat(m_fd, &st)) {
+		close();
+		return false;
+	}
+	m_size = st.st_size;
+	return map(writable);
+}
+
+bool
+MappedFile::create(const char *fname, size_t size)
+{
+	close();
+	if ((m_fd = ::open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) return false;
+	if (ftruncate(m_fd, size)) {
+		close();
+		return false;
+	}
+	m_size = size;
+	return map(true);
+}
+
+void
+MappedFile::sync(bool async)
+{
+	if (!m_data) return;
+	msync(m_data, m_size, async ? MS_ASYNC : MS_SYNC);
+}
+
+void
+MappedFile::prefetch()
+{
+	if (!m_data) return;
+	madvise(m_data, m_size, MADV_WILLNEED);
+}
+
+void
+MappedFile::close()
+{
+	if (m_data) munmap(m_data, m_size);
+	if (m_fd >= 0) ::close(m_fd);
+	m_data = NULL;
+	m_size = 0;
+	m_fd = -1;
+}
+
+bool
+MappedFile::map(bool writable)
+{
+	void *data;
+
+	if (!m_size) {
+		close();
+		return false;
+	}
+	data = mmap(NULL, m_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	/* The mapping keeps the file referenced, no need for the descriptor anymore */
+	m_data = data;
+	if (!writable) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	return true;
+}
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Read-only or read-write memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	/**
+	 * Map an existing file.
+	 *
+	 * @param fname path to the file
+	 * @param writable if true, map the file read-write, otherwise read-only
+	 * @return true on success, false otherwise
+	 */
+	bool open(const char *fname, bool writable = false);
+
+	/**
+	 * Create (or truncate) a file of the given size and map it read-write.
+	 *
+	 * @param fname path to the file
+	 * @param size size of the file, in bytes
+	 * @return true on success, false otherwise
+	 */
+	bool create(const char *fname, size_t size);
+
+	/**
+	 * Flush pending changes to disk, if the mapping is writable.
+	 *
+	 * @param async if true, only schedule the write
+	 */
+	void sync(bool async);
+
+	/**
+	 * Hint the OS to start reading the whole file in the background, so that
+	 * later accesses do not stall on page faults.
+	 */
+	void prefetch();
+	void close();
+
+	void *data() const { return m_data; };
+	size_t size() const { return m_size; };
+	bool isOpen() const { return m_data != NULL; };
+
+private:
+	bool map(bool writable);
+
+	void *m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void *m_file, *m_mapping;
+#else
+	int m_fd;
+#endif
+};
@@ -0,0 +1,195 @@
+#include <string.h>
+#include "perf.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace radiosonde;
+
+#ifdef __linux__
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} perfEventConfig[PERF_EVENT_COUNT] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int
+perf_event_open(struct perf_event_attr *attr, int group)
+{
+	/* pid = 0, cpu = -1: calling thread, on any CPU */
+	return syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+#endif
+
+/* PerfCounters {{{ */
+PerfCounters::PerfCounters()
+{
+	m_leader = -1;
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		m_fds[i] = -1;
+		m_slot[i] = -1;
+	}
+	m_opened = 0;
+	m_failed = false;
+}
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+bool
+PerfCounters::open()
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+
+	close();
+	m_owner = std::this_thread::get_id();
+
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perfEventConfig[i].type;
+		attr.config = perfEventConfig[i].config;
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.disabled = (m_leader < 0);
+
+		m_fds[i] = perf_event_open(&attr, m_leader);
+		if (m_fds[i] < 0) {
+			/* Without a cycle counter there's nothing meaningful to report */
+			if (i == PERF_CYCLES) {
+				m_failed = true;
+				return false;
+			}
+			continue;
+		}
+
+		if (m_leader < 0) m_leader = m_fds[i];
+		m_slot[i] = m_opened++;
+	}
+
+	ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	m_owner = std::this_thread::get_id();
+	m_failed = true;
+	return false;
+#endif
+}
+
+void
+PerfCounters::close()
+{
+#ifdef __linux__
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		if (m_fds[i] >= 0) ::close(m_fds[i]);
+		m_fds[i] = -1;
+		m_slot[i] = -1;
+	}
+#endif
+	m_leader = -1;
+	m_opened = 0;
+	m_failed = false;
+	m_owner = std::thread::id();
+}
+
+bool
+PerfCounters::isOpenHere() const
+{
+	return m_owner == std::this_thread::get_id();
+}
+
+bool
+PerfCounters::read(PerfSample *dst)
+{
+#ifdef __linux__
+	uint64_t buf[1 + PERF_EVENT_COUNT];
+
+	if (m_failed || m_leader < 0) return false;
+	if (::read(m_leader, buf, sizeof(buf)) < (ssize_t)((1 + m_opened) * sizeof(uint64_t))) return false;
+
+	/* Group read format: number of events, followed by their values */
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		dst->counts[i] = m_slot[i] >= 0 ? buf[1 + m_slot[i]] : 0;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+/* }}} */
+/* PerfStage {{{ */
+PerfStage::PerfStage(const char *name)
+{
+	this->name = name;
+	enabled = false;
+	m_available = false;
+	reset();
+}
+
+void
+PerfStage::add(const PerfSample &delta, int samples)
+{
+	float cyclesPerSample, max;
+
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		m_counts[i].fetch_add(delta.counts[i], std::memory_order_relaxed);
+	}
+	m_samples.fetch_add(samples, std::memory_order_relaxed);
+	m_buffers.fetch_add(1, std::memory_order_relaxed);
+
+	cyclesPerSample = (float)delta.counts[PERF_CYCLES] / samples;
+	max = m_maxCyclesPerSample.load(std::memory_order_relaxed);
+	while (cyclesPerSample > max && !m_maxCyclesPerSample.compare_exchange_weak(max, cyclesPerSample));
+}
+
+void
+PerfStage::reset()
+{
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		m_counts[i] = 0;
+	}
+	m_samples = m_buffers = 0;
+	m_maxCyclesPerSample = 0;
+}
+
+PerfStage::Snapshot
+PerfStage::snapshot() const
+{
+	Snapshot snap;
+
+	for (int i=0; i<PERF_EVENT_COUNT; i++) {
+		snap.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+	}
+	snap.samples = m_samples.load(std::memory_order_relaxed);
+	snap.buffers = m_buffers.load(std::memory_order_relaxed);
+	snap.maxCyclesPerSample = m_maxCyclesPerSample.load(std::memory_order_relaxed);
+	return snap;
+}
+
+double
+PerfStage::Snapshot::ipc() const
+{
+	if (!counts[PERF_CYCLES]) return 0;
+	return (double)counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES];
+}
+
+double
+PerfStage::Snapshot::perSample(enum PerfEvent event) const
+{
+	if (!samples) return 0;
+	return (double)counts[event] / samples;
+}
+/* }}} */
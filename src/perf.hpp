@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+
+namespace radiosonde {
+	enum PerfEvent {
+		PERF_CYCLES,
+		PERF_INSTRUCTIONS,
+		PERF_CACHE_MISSES,
+		PERF_BRANCH_MISSES,
+		PERF_EVENT_COUNT
+	};
+
+	struct PerfSample {
+		uint64_t counts[PERF_EVENT_COUNT];
+	};
+
+	/**
+	 * Hardware performance counters (cycles, instructions, cache and branch misses)
+	 * of a single thread. Only implemented on Linux through perf_event_open; on
+	 * other platforms, or if the kernel denies access, open() fails and the
+	 * counters stay unavailable.
+	 */
+	class PerfCounters {
+	public:
+		PerfCounters();
+		~PerfCounters();
+
+		/**
+		 * Start counting events generated by the calling thread. If the counters
+		 * were attached to a different thread, they are reopened.
+		 *
+		 * @return true on success, false if counters are unavailable
+		 */
+		bool open();
+		void close();
+
+		/**
+		 * Check whether the counters are attached to the calling thread.
+		 */
+		bool isOpenHere() const;
+
+		/**
+		 * Read the current value of the counters. Events that are not supported
+		 * by the hardware read as zero.
+		 *
+		 * @param dst destination sample
+		 * @return true on success, false otherwise
+		 */
+		bool read(PerfSample *dst);
+
+	private:
+		int m_leader;
+		int m_fds[PERF_EVENT_COUNT];
+		int m_slot[PERF_EVENT_COUNT];
+		int m_opened;
+		bool m_failed;
+		std::thread::id m_owner;
+	};
+
+	/**
+	 * Counters accumulated over all the buffers processed by a pipeline stage.
+	 * Updated by the stage's thread, read by any other.
+	 */
+	class PerfStage {
+	public:
+		struct Snapshot {
+			uint64_t counts[PERF_EVENT_COUNT];
+			uint64_t samples, buffers;
+			float maxCyclesPerSample;       /* Worst single buffer */
+
+			double ipc() const;
+			double perSample(enum PerfEvent event) const;
+		};
+
+		PerfStage(const char *name);
+
+		/**
+		 * Account for the counters of one buffer.
+		 *
+		 * @param delta counter increments while processing the buffer
+		 * @param samples number of samples in the buffer
+		 */
+		void add(const PerfSample &delta, int samples);
+		void reset();
+		Snapshot snapshot() const;
+
+		/* Whether counters are available in the stage's thread */
+		bool available() const { return m_available.load(std::memory_order_relaxed); }
+		void setAvailable(bool available) { m_available.store(available, std::memory_order_relaxed); }
+
+		const char *name;
+		std::atomic<bool> enabled;
+
+	private:
+		std::atomic<uint64_t> m_counts[PERF_EVENT_COUNT];
+		std::atomic<uint64_t> m_samples, m_buffers;
+		std::atomic<float> m_maxCyclesPerSample;
+		std::atomic<bool> m_available;
+	};
+
+	/**
+	 * Wrapper around a dsp::block that samples the hardware counters of the
+	 * block's worker thread around every call to run(). Counters are only read
+	 * when the attached stage is enabled.
+	 */
+	template<class B>
+	class Instrumented : public B {
+	public:
+		void setStage(PerfStage *stage) { m_stage = stage; }
+
+		int run() override {
+			PerfSample before, after, delta;
+			int count;
+
+			if (!m_stage || !m_stage->enabled.load(std::memory_order_relaxed)) return B::run();
+
+			/* Worker threads are recreated on every start(), follow them */
+			if (!m_counters.isOpenHere()) m_stage->setAvailable(m_counters.open());
+			if (!m_stage->available() || !m_counters.read(&before)) return B::run();
+
+			count = B::run();
+			if (count > 0 && m_counters.read(&after)) {
+				for (int i=0; i<PERF_EVENT_COUNT; i++) {
+					delta.counts[i] = after.counts[i] - before.counts[i];
+				}
+				m_stage->add(delta, count);
+			}
+			return count;
+		}
+
+	private:
+		PerfStage *m_stage = NULL;
+		PerfCounters m_counters;
+	};
+}
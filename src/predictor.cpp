@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <string.h>
+#include "predictor.hpp"
+
+#define EARTH_RADIUS 6371e3f
+#define SCALE_HEIGHT 7238.3f        /* Atmospheric density scale height, meters */
+#define DEG2RAD (float)(M_PI / 180.0)
+#define RAD2DEG (float)(180.0 / M_PI)
+#define PREDICT_STEP 2.0f           /* Integration step, seconds */
+#define PREDICT_MAX_STEPS 10800     /* Give up after 6 hours of flight */
+#define PREDICT_CHUNK 32            /* Trajectories per thread pool task */
+#define ELLIPSE_SCALE 2.4477f       /* sqrt(chi2(0.95, 2 dof)) */
+#define WIND_SMOOTHING 0.5f
+#define BURST_CLIMB -1.0f           /* Climb rate below which the balloon is considered burst */
+#define POINT_QUEUE_SIZE 64
+#define IDLE_TIMEOUT_MS 200
+#define TERRAIN_CEILING 9000.0f     /* No ground above this altitude */
+#define TERRAIN_PRELOAD 1.0f        /* Map terrain tiles this far from the sonde, degrees */
+
+LandingPredictor::LandingPredictor() : m_points(POINT_QUEUE_SIZE)
+{
+	m_running = false;
+	m_prediction.valid = false;
+	m_serial = 0;
+	m_burst = false;
+	m_windField = NULL;
+	m_terrain = NULL;
+	m_observedMin = INFINITY;
+	m_observedMax = -INFINITY;
+	for (int i=0; i<WIND_BIN_COUNT; i++) {
+		m_windU[i] = m_windV[i] = 0;
+		m_windKnown[i] = false;
+	}
+	saveState();
+
+	m_config.burstAlt = 30000;
+	m_config.burstAltSigma = 2000;
+	m_config.descentRate = 5;
+	m_config.descentRateSigma = 0.1;
+	m_config.windScaleSigma = 0.1;
+	m_config.windOffsetSigma = 1;
+	m_config.groundAlt = 0;
+	m_config.members = 256;
+}
+
+LandingPredictor::~LandingPredictor()
+{
+	stop();
+}
+
+void
+LandingPredictor::start()
+{
+	if (m_running) return;
+	m_running = true;
+	m_thread = std::thread(&LandingPredictor::worker, this);
+}
+
+void
+LandingPredictor::stop()
+{
+	if (!m_running) return;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+void
+LandingPredictor::setConfig(const Config &config)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_config = config;
+	m_config.members = std::max(m_config.members, 1);
+}
+
+LandingPredictor::Config
+LandingPredictor::getConfig()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_config;
+}
+
+size_t
+LandingPredictor::memoryUsage()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const size_t variables = sizeof(Ensemble) / sizeof(std::vector<float>);
+
+	return sizeof(*this) + m_points.capacity() * sizeof(TrackPoint) + variables * m_config.members * sizeof(float);
+}
+
+void
+LandingPredictor::setWindField(WindField *field)
+{
+	m_windField = field;
+}
+
+void
+LandingPredictor::setTerrain(Terrain *terrain)
+{
+	m_terrain = terrain;
+}
+
+void
+LandingPredictor::update(const SondeFullData &data)
+{
+	TrackPoint point;
+
+	point.serial = data.serial;
+	point.time = data.time;
+	point.lat = data.lat;
+	point.lon = data.lon;
+	point.alt = data.alt;
+	point.spd = data.spd;
+	point.hdg = data.hdg;
+	point.climb = data.climb;
+
+	/* No lock here: the worker polls the queue if it misses the notification */
+	if (m_points.push(point)) m_cv.notify_one();
+}
+
+LandingPrediction
+LandingPredictor::getPrediction()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_prediction;
+}
+
+void
+LandingPredictor::getState(State *dst)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	*dst = m_state;
+}
+
+void
+LandingPredictor::setState(const State &src)
+{
+	if (m_running) return;
+
+	m_serial = SerialTable::shared().intern(std::string(src.serial, strnlen(src.serial, sizeof(src.serial))).c_str());
+	for (int i=0; i<WIND_BIN_COUNT; i++) {
+		m_windU[i] = src.windU[i];
+		m_windV[i] = src.windV[i];
+		m_windKnown[i] = src.windKnown[i];
+	}
+	m_observedMin = src.observedMin;
+	m_observedMax = src.observedMax;
+	m_burst = src.burst;
+	m_prediction = src.prediction;
+	saveState();
+}
+
+/* Private methods {{{ */
+void
+LandingPredictor::worker()
+{
+	TrackPoint point, latest;
+	Config config;
+	bool fresh;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lck(m_mtx);
+			m_cv.wait_for(lck, std::chrono::milliseconds(IDLE_TIMEOUT_MS),
+			              [this]{ return !m_running || m_points.size() > 0; });
+			if (!m_running) return;
+			config = m_config;
+		}
+
+		/* Learn from every point, but only predict from the most recent one */
+		fresh = false;
+		while (m_points.pop(&point)) {
+			ingest(point);
+			latest = point;
+			fresh = true;
+		}
+
+		if (fresh) {
+			predict(latest, config);
+
+			std::lock_guard<std::mutex> lck(m_mtx);
+			saveState();
+		}
+	}
+}
+
+void
+LandingPredictor::ingest(const TrackPoint &point)
+{
+	int bin;
+	float u, v;
+
+	if (point.serial && point.serial != m_serial) {
+		/* New sonde, forget everything about the previous flight */
+		m_serial = point.serial;
+		for (int i=0; i<WIND_BIN_COUNT; i++) m_windKnown[i] = false;
+		m_observedMin = INFINITY;
+		m_observedMax = -INFINITY;
+		m_burst = false;
+
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_prediction.valid = false;
+	}
+
+	if (isnan(point.lat) || isnan(point.lon) || isnan(point.alt)) return;
+	if (point.lat == 0 && point.lon == 0 && point.alt == 0) return;
+
+	if (point.climb < BURST_CLIMB) m_burst = true;
+
+	/* The sonde drifts with the wind, so its ground velocity is the wind */
+	bin = std::min(std::max((int)(point.alt / WIND_BIN_HEIGHT), 0), WIND_BIN_COUNT - 1);
+	u = point.spd * sinf(point.hdg * DEG2RAD);
+	v = point.spd * cosf(point.hdg * DEG2RAD);
+
+	m_observedMin = std::min(m_observedMin, point.alt);
+	m_observedMax = std::max(m_observedMax, point.alt);
+
+	if (m_windKnown[bin]) {
+		m_windU[bin] += WIND_SMOOTHING * (u - m_windU[bin]);
+		m_windV[bin] += WIND_SMOOTHING * (v - m_windV[bin]);
+	} else {
+		m_windU[bin] = u;
+		m_windV[bin] = v;
+		m_windKnown[bin] = true;
+	}
+}
+
+void
+LandingPredictor::predict(const TrackPoint &point, const Config &config)
+{
+	typedef std::chrono::steady_clock clock;
+	const clock::time_point start = clock::now();
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+	LandingPrediction result;
+	double meanLat, meanLon, meanTime, sxx, syy, sxy, kx, ky;
+	float descentRate, spread, l1, l2;
+	int last, n;
+	bool ascending;
+
+	if (isnan(point.lat) || isnan(point.lon) || isnan(point.alt)) return;
+	if (point.lat == 0 && point.lon == 0 && point.alt == 0) return;
+
+	/* Fill the gaps in the wind profile with the closest known bins */
+	last = -1;
+	for (int i=0; i<WIND_BIN_COUNT; i++) {
+		if (m_windKnown[i]) {
+			if (last < 0) {
+				for (int j=0; j<i; j++) {
+					m_profileU[j] = m_windU[i];
+					m_profileV[j] = m_windV[i];
+				}
+			} else {
+				for (int j=last+1; j<i; j++) {
+					const bool lower = j - last <= i - j;
+					m_profileU[j] = lower ? m_windU[last] : m_windU[i];
+					m_profileV[j] = lower ? m_windV[last] : m_windV[i];
+				}
+			}
+			m_profileU[i] = m_windU[i];
+			m_profileV[i] = m_windV[i];
+			last = i;
+		}
+	}
+	for (int i=last+1; i<WIND_BIN_COUNT; i++) {
+		m_profileU[i] = last < 0 ? 0 : m_windU[last];
+		m_profileV[i] = last < 0 ? 0 : m_windV[last];
+	}
+
+	ascending = !m_burst && point.climb >= 0;
+
+	/* Sea-level equivalent descent rate: drag balances weight, so the descent
+	 * rate scales with the inverse square root of the air density */
+	if (!ascending && point.climb < BURST_CLIMB) {
+		descentRate = -point.climb * expf(-point.alt / (2 * SCALE_HEIGHT));
+	} else {
+		descentRate = config.descentRate;
+	}
+
+	/* Draw the ensemble. Member 0 is the unperturbed, nominal trajectory */
+	n = config.members;
+	m_ensemble.resize(n);
+	for (int i=0; i<n; i++) {
+		const float k = i ? 1.0f : 0.0f;
+
+		m_ensemble.lat[i] = point.lat;
+		m_ensemble.lon[i] = point.lon;
+		m_ensemble.alt[i] = point.alt;
+		m_ensemble.landingTime[i] = 0;
+
+		if (ascending) {
+			m_ensemble.burstAlt[i] = std::max(config.burstAlt + k * config.burstAltSigma * gauss(m_rng), point.alt);
+		} else {
+			m_ensemble.burstAlt[i] = -INFINITY;
+		}
+		m_ensemble.ascentRate[i] = std::max(point.climb, 1.0f) * (1 + k * 0.1f * gauss(m_rng));
+		m_ensemble.descentRate[i] = std::max(descentRate * (1 + k * config.descentRateSigma * gauss(m_rng)), 0.5f);
+		m_ensemble.windScale[i] = 1 + k * config.windScaleSigma * gauss(m_rng);
+		m_ensemble.windOffsetU[i] = k * config.windOffsetSigma * gauss(m_rng);
+		m_ensemble.windOffsetV[i] = k * config.windOffsetSigma * gauss(m_rng);
+	}
+
+	/* Map the terrain around the sonde now, rather than stalling the pool on I/O */
+	if (m_terrain) m_terrain->preload(point.lat, point.lon, TERRAIN_PRELOAD);
+
+	{
+		/* Keep the forecast and terrain mapped until every trajectory is done with them */
+		std::unique_ptr<radiosonde::EpochDomain::Guard> windGuard, terrainGuard;
+		const WindGrid *grid = NULL;
+
+		if (m_windField) {
+			windGuard.reset(new radiosonde::EpochDomain::Guard(m_windField->domain()));
+			grid = m_windField->grid();
+		}
+		if (m_terrain) terrainGuard.reset(new radiosonde::EpochDomain::Guard(m_terrain->domain()));
+
+		/* Decoding on the same pool always goes first */
+		radiosonde::ThreadPool::shared().parallelFor(n, PREDICT_CHUNK, [this, &config, grid, &point](int begin, int end) {
+			integrate(config, grid, point.time, begin, end);
+		}, radiosonde::TASK_BACKGROUND);
+		result.forecast = grid != NULL;
+	}
+
+	/* Dispersion: covariance of the landing points on the local tangent plane */
+	meanLat = meanLon = meanTime = 0;
+	for (int i=0; i<n; i++) {
+		meanLat += m_ensemble.lat[i];
+		meanLon += m_ensemble.lon[i];
+		meanTime += m_ensemble.landingTime[i];
+	}
+	meanLat /= n;
+	meanLon /= n;
+	meanTime /= n;
+
+	ky = EARTH_RADIUS * DEG2RAD;
+	kx = ky * cos(meanLat * DEG2RAD);
+	sxx = syy = sxy = 0;
+	for (int i=0; i<n; i++) {
+		const double dx = (m_ensemble.lon[i] - meanLon) * kx;
+		const double dy = (m_ensemble.lat[i] - meanLat) * ky;
+		sxx += dx * dx;
+		syy += dy * dy;
+		sxy += dx * dy;
+	}
+	sxx /= n;
+	syy /= n;
+	sxy /= n;
+
+	spread = sqrt((sxx - syy) * (sxx - syy) / 4 + sxy * sxy);
+	l1 = (sxx + syy) / 2 + spread;
+	l2 = std::max((sxx + syy) / 2 - spread, 0.0);
+
+	result.valid = true;
+	result.time = point.time;
+	result.ascending = ascending;
+	result.lat = m_ensemble.lat[0];
+	result.lon = m_ensemble.lon[0];
+	result.meanLat = meanLat;
+	result.meanLon = meanLon;
+	result.semiMajor = ELLIPSE_SCALE * sqrtf(l1);
+	result.semiMinor = ELLIPSE_SCALE * sqrtf(l2);
+	result.orientation = fmodf(90.0f - 0.5f * atan2f(2 * sxy, sxx - syy) * RAD2DEG + 360.0f, 180.0f);
+	result.burstAlt = ascending ? std::max(config.burstAlt, point.alt) : point.alt;
+	result.landingAlt = m_ensemble.alt[0];
+	result.timeToLanding = meanTime;
+	result.members = n;
+	result.computeMs = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_prediction = result;
+}
+
+/* [begin, end) is at most PREDICT_CHUNK members, as handed out by parallelFor() */
+void
+LandingPredictor::integrate(const Config &config, const WindGrid *grid, time_t time, int begin, int end)
+{
+	float *lat = m_ensemble.lat.data(), *lon = m_ensemble.lon.data(), *alt = m_ensemble.alt.data();
+	float *burstAlt = m_ensemble.burstAlt.data();
+	const float *ascentRate = m_ensemble.ascentRate.data(), *descentRate = m_ensemble.descentRate.data();
+	const float *windScale = m_ensemble.windScale.data();
+	const float *windOffsetU = m_ensemble.windOffsetU.data(), *windOffsetV = m_ensemble.windOffsetV.data();
+	float *landingTime = m_ensemble.landingTime.data();
+	Terrain *terrain = m_terrain;
+	const float observedMin = m_observedMin, observedMax = m_observedMax;
+	float ground[PREDICT_CHUNK], windU[PREDICT_CHUNK], windV[PREDICT_CHUNK];
+	float queryLat[PREDICT_CHUNK], queryLon[PREDICT_CHUNK], queryElevation[PREDICT_CHUNK];
+	int queryIndex[PREDICT_CHUNK];
+	WindGrid::TimeIndex timeIndex;
+	bool forecast;
+	int active, queries;
+
+	end = std::min(end, begin + PREDICT_CHUNK);
+
+	for (int step=0; step<PREDICT_MAX_STEPS; step++) {
+		/* Members still airborne have all flown for exactly this long, landed
+		 * ones no longer move: the forecast time steps are the same for all */
+		const float elapsed = step * PREDICT_STEP;
+		forecast = grid && grid->timeIndex(time + (time_t)elapsed, &timeIndex);
+
+		/* Lookups first, only for the members that need them: terrain below
+		 * the ceiling, in one batch so that the tile is resolved once, and
+		 * forecast winds outside the altitudes measured by the sonde */
+		queries = 0;
+		for (int i=begin; i<end; i++) {
+			const int k = i - begin;
+			const float a = alt[i];
+			const int bin = std::min(std::max((int)(a * (1.0f / WIND_BIN_HEIGHT)), 0), WIND_BIN_COUNT - 1);
+			float fu, fv;
+
+			ground[k] = config.groundAlt;
+			windU[k] = m_profileU[bin];
+			windV[k] = m_profileV[bin];
+			if (landingTime[i] != elapsed) continue;
+
+			if (terrain && a < TERRAIN_CEILING) {
+				queryLat[queries] = lat[i];
+				queryLon[queries] = lon[i];
+				queryIndex[queries++] = k;
+			}
+			/* Measured winds are better than any forecast, but only where the sonde has been */
+			if (forecast && (a < observedMin || a > observedMax) && grid->sample(timeIndex, lat[i], lon[i], a, &fu, &fv)) {
+				windU[k] = fu;
+				windV[k] = fv;
+			}
+		}
+		if (queries) {
+			terrain->elevation(queryLat, queryLon, queryElevation, queries);
+			for (int q=0; q<queries; q++) {
+				if (!isnan(queryElevation[q])) ground[queryIndex[q]] = queryElevation[q];
+			}
+		}
+
+		/* Then step all the trajectories of the batch together, with no
+		 * data-dependent branches: landed members just stop moving */
+		active = 0;
+		for (int i=begin; i<end; i++) {
+			const int k = i - begin;
+			const float a = alt[i];
+			const bool ascent = a < burstAlt[i];
+			const bool airborne = landingTime[i] == elapsed && (ascent || a > ground[k]);
+			const float dt = airborne ? PREDICT_STEP : 0.0f;
+			const float u = windU[k] * windScale[i] + windOffsetU[i];
+			const float v = windV[k] * windScale[i] + windOffsetV[i];
+			const float vz = ascent ? ascentRate[i] : -descentRate[i] * expf(a * (0.5f / SCALE_HEIGHT));
+
+			/* Once the burst altitude is reached, never go back to ascending */
+			burstAlt[i] = ascent ? burstAlt[i] : -INFINITY;
+			alt[i] = std::max(a + vz * dt, airborne ? ground[k] : a);
+			lat[i] += v * dt * (RAD2DEG / EARTH_RADIUS);
+			lon[i] += u * dt * (RAD2DEG / EARTH_RADIUS) / cosf(lat[i] * DEG2RAD);
+			landingTime[i] += dt;
+			active += airborne;
+		}
+		if (!active) break;
+	}
+}
+
+/* Must be called with m_mtx held, or before the worker is started */
+void
+LandingPredictor::saveState()
+{
+	strncpy(m_state.serial, serial_name(m_serial).c_str(), sizeof(m_state.serial)-1);
+	m_state.serial[sizeof(m_state.serial)-1] = '\0';
+	for (int i=0; i<WIND_BIN_COUNT; i++) {
+		m_state.windU[i] = m_windU[i];
+		m_state.windV[i] = m_windV[i];
+		m_state.windKnown[i] = m_windKnown[i];
+	}
+	m_state.observedMin = m_observedMin;
+	m_state.observedMax = m_observedMax;
+	m_state.burst = m_burst;
+	m_state.prediction = m_prediction;
+}
+
+void
+LandingPredictor::Ensemble::resize(int n)
+{
+	lat.resize(n);
+	lon.resize(n);
+	alt.resize(n);
+	burstAlt.resize(n);
+	ascentRate.resize(n);
+	descentRate.resize(n);
+	windScale.resize(n);
+	windOffsetU.resize(n);
+	windOffsetV.resize(n);
+	landingTime.resize(n);
+}
+/* }}} */
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <condition_variable>
+#include <stdint.h>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "decode/common.hpp"
+#include "spsc.hpp"
+#include "terrain.hpp"
+#include "threadpool.hpp"
+#include "windfield.hpp"
+
+#define WIND_BIN_HEIGHT 100.0f      /* Vertical resolution of the wind profile, meters */
+#define WIND_BIN_COUNT 500          /* Profile covers 0-50km */
+
+struct LandingPrediction {
+	bool valid;
+	time_t time;                /* Onboard time of the frame the prediction is based on */
+	bool ascending;
+	float lat, lon;             /* Landing point of the nominal trajectory */
+	float meanLat, meanLon;     /* Centroid of the ensemble landing points */
+	float semiMajor, semiMinor; /* 95% dispersion ellipse axes, meters */
+	float orientation;          /* Bearing of the major axis, degrees */
+	float burstAlt;             /* Burst altitude of the nominal trajectory, meters */
+	float landingAlt;           /* Ground elevation at the nominal landing point, meters */
+	float timeToLanding;        /* Mean time to landing, seconds */
+	int members;                /* Number of trajectories in the ensemble */
+	bool forecast;              /* Forecast winds were available */
+	float computeMs;            /* Time spent computing the ensemble */
+};
+
+/**
+ * Monte Carlo landing predictor. Winds are learned from the track itself, then
+ * an ensemble of trajectories with perturbed burst altitude, descent rate and
+ * winds is integrated on the shared thread pool every time a new position is
+ * received. Where the flight has not measured the wind yet, forecast winds are
+ * used if a WindField is attached. update() is meant to be called from the DSP thread and never blocks;
+ * all the work happens in a background thread.
+ */
+class LandingPredictor {
+public:
+	struct Config {
+		float burstAlt;             /* Nominal burst altitude, meters */
+		float burstAltSigma;        /* Burst altitude spread, meters */
+		float descentRate;          /* Sea-level descent rate used before burst, m/s */
+		float descentRateSigma;     /* Relative descent rate spread */
+		float windScaleSigma;       /* Relative wind speed spread */
+		float windOffsetSigma;      /* Absolute wind spread per component, m/s */
+		float groundAlt;            /* Elevation of the landing area where no terrain data is available, meters */
+		int members;                /* Ensemble size */
+	};
+
+	/* Everything learned about the current flight, as plain data */
+	struct State {
+		char serial[32];
+		float windU[WIND_BIN_COUNT], windV[WIND_BIN_COUNT];
+		uint8_t windKnown[WIND_BIN_COUNT];
+		float observedMin, observedMax;
+		uint8_t burst;
+		LandingPrediction prediction;
+	};
+
+	LandingPredictor();
+	~LandingPredictor();
+
+	void start();
+	void stop();
+
+	/**
+	 * Change the prediction parameters. Takes effect from the next update.
+	 *
+	 * @param config new parameters
+	 */
+	void setConfig(const Config &config);
+	Config getConfig();
+
+	/**
+	 * Attach a wind forecast, used outside the altitude range flown so far. Must
+	 * be called before start(), and the field must outlive the predictor.
+	 *
+	 * @param field wind forecast, or NULL to only use the winds measured in flight
+	 */
+	void setWindField(WindField *field);
+
+	/**
+	 * Attach a terrain model, used to find where trajectories hit the ground.
+	 * Must be called before start(), and the terrain must outlive the predictor.
+	 *
+	 * @param terrain elevation tiles, or NULL to use the configured ground altitude
+	 */
+	void setTerrain(Terrain *terrain);
+
+	/**
+	 * Feed a new frame to the predictor. Never blocks; if the predictor is
+	 * lagging behind, the frame is dropped.
+	 *
+	 * @param data decoded frame
+	 */
+	void update(const SondeFullData &data);
+
+	/**
+	 * Get the most recent prediction.
+	 */
+	LandingPrediction getPrediction();
+
+	/**
+	 * Get a copy of the flight state, as of the last processed batch of frames.
+	 *
+	 * @param dst destination for the state
+	 */
+	void getState(State *dst);
+
+	/**
+	 * Resume a flight from a previously saved state. Must be called before start().
+	 *
+	 * @param src state returned by getState()
+	 */
+	void setState(const State &src);
+
+	/**
+	 * Bytes held by the predictor: flight state, queued frames and ensemble.
+	 */
+	size_t memoryUsage();
+
+private:
+	struct TrackPoint {
+		SerialId serial;
+		time_t time;
+		float lat, lon, alt;
+		float spd, hdg, climb;
+	};
+
+	/* Ensemble state, one array per variable so that steps vectorize */
+	struct Ensemble {
+		std::vector<float> lat, lon, alt;
+		std::vector<float> burstAlt, ascentRate, descentRate;
+		std::vector<float> windScale, windOffsetU, windOffsetV;
+		std::vector<float> landingTime;
+		void resize(int n);
+	};
+
+	void worker();
+	void ingest(const TrackPoint &point);
+	void predict(const TrackPoint &point, const Config &config);
+	void integrate(const Config &config, const WindGrid *grid, time_t time, int begin, int end);
+	void saveState();
+
+	std::thread m_thread;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	bool m_running, m_pending;
+
+	radiosonde::SpscQueue<TrackPoint> m_points;
+	Config m_config;
+	LandingPrediction m_prediction;
+	State m_state;
+	WindField *m_windField;
+	Terrain *m_terrain;
+
+	/* Only touched by the worker thread */
+	SerialRef m_serial;
+	float m_windU[WIND_BIN_COUNT], m_windV[WIND_BIN_COUNT];
+	bool m_windKnown[WIND_BIN_COUNT];
+	float m_observedMin, m_observedMax;
+	float m_profileU[WIND_BIN_COUNT], m_profileV[WIND_BIN_COUNT];
+	bool m_burst;
+	Ensemble m_ensemble;
+	std::mt19937 m_rng;
+};
@@ -1,13 +1,17 @@
 #include "ptu.hpp"
 
 bool
-PTUWriter::init(const char *fname)
+PTUWriter::init(const char *fname, bool append)
 {
 	if (m_fd) deinit();
 
-	m_fd = fopen(fname, "wb");
+	m_fd = fopen(fname, append ? "ab" : "wb");
 	if(!m_fd) return false;
 
+	/* Only write the header once */
+	fseek(m_fd, 0, SEEK_END);
+	if (ftell(m_fd) > 0) return true;
+
 	fprintf(m_fd, "Epoch,Temperature,Relative humidity,Dew point,Pressure,Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA\n");
 
 	return true;
@@ -22,7 +26,7 @@ PTUWriter::deinit()
 }
 
 void
-PTUWriter::addPoint(SondeFullData *data)
+PTUWriter::addPoint(const SondeFullData *data)
 {
 	if (!m_fd) return;
 	fprintf(m_fd, "%ld,%.1f,%.1f,%.1f,%.1f,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%s\n",
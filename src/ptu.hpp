@@ -12,7 +12,14 @@ public:
 	PTUWriter() { m_fd = NULL; };
 	~PTUWriter() { deinit(); };
 
-	bool init(const char *fname);
+	/**
+	 * Open a log file.
+	 *
+	 * @param fname path to the file
+	 * @param append if true, keep the existing contents of the file
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *fname, bool append = false);
 	void deinit();
 
 	/**
@@ -20,7 +27,7 @@ public:
 	 *
 	 * @param data data to log
 	 */
-	void addPoint(SondeFullData *data);
+	void addPoint(const SondeFullData *data);
 private:
 	FILE *m_fd;
 };
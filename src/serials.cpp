@@ -0,0 +1,110 @@
+#include <ctype.h>
+#include <string.h>
+#include "serials.hpp"
+
+#define SLOT_BITS 10
+static_assert(SERIAL_TABLE_SIZE == 1 << SLOT_BITS, "SLOT_BITS does not match the table size");
+
+SerialTable::SerialTable()
+{
+	for (Entry &entry : m_entries) {
+		entry.id = 0;
+		entry.name[0] = '\0';
+		entry.pins = 0;
+	}
+	m_next = 1;
+	m_generation = 0;
+}
+
+SerialId
+SerialTable::intern(const char *serial, SerialId hint)
+{
+	char current[SERIAL_MAX_LEN + 1];
+	size_t len;
+	SerialId id;
+
+	if (hint && name(hint, current) && !strcmp(current, serial)) return hint;
+
+	/* Validated once, before the serial number gets an ID */
+	len = strlen(serial);
+	if (!len || len > SERIAL_MAX_LEN) return 0;
+	for (size_t i=0; i<len; i++) if (!isgraph((unsigned char)serial[i])) return 0;
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const auto it = m_index.find(serial);
+	if (it != m_index.end()) return it->second;
+
+	/* Take the oldest slot nobody holds on to, forgetting the serial number it had */
+	for (int i=0; m_entries[m_next].pins; i++) {
+		if (i == SERIAL_TABLE_SIZE) return 0;
+		advance();
+	}
+	Entry &entry = m_entries[m_next];
+	if (entry.id.load(std::memory_order_relaxed)) m_index.erase(entry.name);
+	entry.id.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(entry.name, serial, len + 1);
+
+	id = m_generation << SLOT_BITS | m_next;
+	entry.id.store(id, std::memory_order_release);
+	m_index[entry.name] = id;
+
+	advance();
+	return id;
+}
+
+bool
+SerialTable::name(SerialId id, char *dst) const
+{
+	const Entry &entry = m_entries[id & (SERIAL_TABLE_SIZE - 1)];
+
+	/* Seqlock: the ID is cleared before the name is overwritten */
+	dst[0] = '\0';
+	if (!id || entry.id.load(std::memory_order_acquire) != id) return false;
+	memcpy(dst, entry.name, sizeof(entry.name));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (entry.id.load(std::memory_order_relaxed) != id) {
+		dst[0] = '\0';
+		return false;
+	}
+	dst[SERIAL_MAX_LEN] = '\0';
+	return true;
+}
+
+void
+SerialTable::pin(SerialId id)
+{
+	Entry &entry = m_entries[id & (SERIAL_TABLE_SIZE - 1)];
+
+	if (!id) return;
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (entry.id.load(std::memory_order_relaxed) == id) entry.pins++;
+}
+
+void
+SerialTable::unpin(SerialId id)
+{
+	Entry &entry = m_entries[id & (SERIAL_TABLE_SIZE - 1)];
+
+	if (!id) return;
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (entry.id.load(std::memory_order_relaxed) == id && entry.pins) entry.pins--;
+}
+
+SerialTable&
+SerialTable::shared()
+{
+	static SerialTable table;
+	return table;
+}
+
+/* Private methods {{{ */
+void
+SerialTable::advance()
+{
+	if (++m_next == SERIAL_TABLE_SIZE) {
+		m_next = 1;
+		m_generation++;
+	}
+}
+/* }}} */
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#define SERIAL_TABLE_SIZE 1024      /* Sondes known at once, the oldest is forgotten first */
+#define SERIAL_MAX_LEN 31
+
+/* Interned serial number, 0 if unknown */
+typedef uint32_t SerialId;
+
+/**
+ * Serial numbers seen by the decoders, each validated once and given an
+ * integer ID. Frames carry the ID, so that copying them and detecting a new
+ * sonde never touches strings: only the decoder compares the serial number of
+ * a frame with the one of the previous frame.
+ *
+ * Entries are never modified once published, until SERIAL_TABLE_SIZE newer
+ * serial numbers have been interned and the slot is reused. The ID then
+ * changes, so that a stale ID resolves to an empty name instead of another
+ * sonde. Names are copied out and checked against the ID afterwards, so that
+ * a slot reused in the middle of the copy never shows a torn name. IDs held
+ * for longer than a frame, through SerialRef, pin their slot so that it is
+ * not reused at all.
+ */
+class SerialTable {
+public:
+	SerialTable();
+	SerialTable(const SerialTable&) = delete;
+	SerialTable &operator=(const SerialTable&) = delete;
+
+	/**
+	 * Look up a serial number, adding it if new. Takes a lock only when the
+	 * serial number differs from the hint.
+	 *
+	 * @param serial serial number, as received
+	 * @param hint ID of the serial number most likely to match, usually the
+	 *        one of the previous frame
+	 * @return ID of the serial number, 0 if empty or not printable
+	 */
+	SerialId intern(const char *serial, SerialId hint = 0);
+
+	/**
+	 * Copy the serial number of an ID.
+	 *
+	 * @param id ID of the serial number
+	 * @param dst destination, SERIAL_MAX_LEN + 1 bytes
+	 * @return true on success, false (and empty dst) for 0 or a forgotten ID
+	 */
+	bool name(SerialId id, char *dst) const;
+
+	/**
+	 * Keep the slot of an ID from being reused, or allow it again. Pins are
+	 * counted; pinning a forgotten ID has no effect.
+	 */
+	void pin(SerialId id);
+	void unpin(SerialId id);
+
+	/**
+	 * Table shared by all decoders and outputs.
+	 */
+	static SerialTable &shared();
+
+private:
+	struct Entry {
+		std::atomic<SerialId> id;   /* 0 while the name is being written */
+		char name[SERIAL_MAX_LEN + 1];
+		uint32_t pins;              /* Protected by the mutex */
+	};
+
+	void advance();
+
+	Entry m_entries[SERIAL_TABLE_SIZE];
+	std::mutex m_mtx;
+	std::unordered_map<std::string, SerialId> m_index;
+	uint32_t m_next;                /* Slot to use next, 0 is never used so that no ID is 0 */
+	uint32_t m_generation;
+};
+
+/**
+ * ID of a serial number that outlives the frame it came from, such as the one
+ * of the flight being recorded. Its name stays available for as long as the
+ * reference exists.
+ */
+class SerialRef {
+public:
+	SerialRef(SerialId id = 0) : m_id(id) { SerialTable::shared().pin(m_id); }
+	SerialRef(const SerialRef &other) : SerialRef(other.m_id) {}
+	~SerialRef() { SerialTable::shared().unpin(m_id); }
+
+	SerialRef &operator=(const SerialRef &other) { return *this = other.m_id; }
+	SerialRef &operator=(SerialId id) {
+		if (id == m_id) return *this;
+		SerialTable::shared().pin(id);
+		SerialTable::shared().unpin(m_id);
+		m_id = id;
+		return *this;
+	}
+	operator SerialId() const { return m_id; }
+
+private:
+	SerialId m_id;
+};
+
+/* Serial number copied out of the table, valid whatever happens to the slot */
+struct SerialName {
+	char str[SERIAL_MAX_LEN + 1];
+	const char *c_str() const { return str; }
+};
+
+static inline SerialName
+serial_name(SerialId id)
+{
+	SerialName name;
+	SerialTable::shared().name(id, name.str);
+	return name;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+namespace radiosonde {
+	/**
+	 * Bounded single-producer single-consumer queue. Neither side ever blocks or
+	 * takes a lock: push() fails when the queue is full, pop() when it is empty.
+	 */
+	template<typename T>
+	class SpscQueue {
+	public:
+		/**
+		 * @param capacity maximum number of queued items, rounded up to a power of two
+		 */
+		SpscQueue(size_t capacity) {
+			size_t size;
+			for (size = 1; size < capacity; size <<= 1);
+			m_buf.resize(size);
+			m_mask = size - 1;
+			m_head = m_tail = 0;
+		}
+
+		/* Producer side */
+		bool push(const T &item) {
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head.load(std::memory_order_acquire) > m_mask) return false;
+
+			m_buf[tail & m_mask] = item;
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* Producer side: slot to fill in place, NULL if the queue is full. Only
+		 * queued by the following commit() */
+		T *reserve() {
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head.load(std::memory_order_acquire) > m_mask) return NULL;
+			return &m_buf[tail & m_mask];
+		}
+		void commit() {
+			m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/* Consumer side */
+		bool pop(T *item) {
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+			*item = m_buf[head & m_mask];
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* Consumer side: look at the next item without removing it */
+		const T *peek() const {
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire)) return NULL;
+			return &m_buf[head & m_mask];
+		}
+
+		/* Consumer side: remove the item returned by peek() */
+		void consume() {
+			m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		size_t size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+		size_t capacity() const { return m_mask + 1; }
+
+	private:
+		std::vector<T> m_buf;
+		size_t m_mask;
+		alignas(64) std::atomic<size_t> m_head;
+		alignas(64) std::atomic<size_t> m_tail;
+	};
+}
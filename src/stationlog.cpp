@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include "stationlog.hpp"
+
+#define STATION_MAGIC "RSSTLOG1"
+#define MERGE_TICK_MS 100
+
+static_assert(sizeof(StationLog::Record) == 144, "Station log records must keep the same layout");
+
+static void
+copy_string(char *dst, const char *src, size_t len)
+{
+	strncpy(dst, src, len-1);
+	dst[len-1] = '\0';
+}
+
+/* StationLog::Source {{{ */
+StationLog::Source::Source(const char *instance)
+	: m_queue(STATION_QUEUE_SIZE)
+{
+	copy_string(m_instance, instance, sizeof(m_instance));
+	m_active = false;
+	m_dropped = 0;
+}
+
+bool
+StationLog::Source::push(const SondeFullData &data, double frequency)
+{
+	Record record;
+
+	if (!m_active.load(std::memory_order_relaxed)) return false;
+
+	memset(&record, 0, sizeof(record));
+	record.rxTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	record.frequency = frequency;
+	memcpy(record.instance, m_instance, sizeof(record.instance));
+	copy_string(record.serial, serial_name(data.serial).c_str(), sizeof(record.serial));
+	record.time = data.time;
+	record.seq = data.seq;
+	record.burstkill = data.burstkill;
+	record.lat = data.lat;
+	record.lon = data.lon;
+	record.alt = data.alt;
+	record.spd = data.spd;
+	record.hdg = data.hdg;
+	record.climb = data.climb;
+	record.temp = data.temp;
+	record.rh = data.rh;
+	record.dewpt = data.dewpt;
+	record.pressure = data.pressure;
+	record.calibrated = data.calibrated;
+
+	/* No notification: the merge thread polls, it has to wait for the other instances anyway */
+	if (!m_queue.push(record)) {
+		m_dropped++;
+		return false;
+	}
+	return true;
+}
+/* }}} */
+
+/* StationLog {{{ */
+StationLog::StationLog()
+{
+	m_running = false;
+	m_fd = NULL;
+	m_binary = false;
+	m_written = 0;
+}
+
+StationLog::~StationLog()
+{
+	closeFile();
+	for (Source *source : m_sources) delete source;
+}
+
+StationLog::Source*
+StationLog::addSource(const char *instance)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Source *source = new Source(instance);
+
+	m_sources.push_back(source);
+	return source;
+}
+
+void
+StationLog::removeSource(Source *source)
+{
+	setActive(source, false);
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (m_fd) merge(true);
+	m_sources.erase(std::remove(m_sources.begin(), m_sources.end(), source), m_sources.end());
+	delete source;
+}
+
+bool
+StationLog::setActive(Source *source, bool active)
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+	bool any = false;
+
+	source->m_active = active;
+	for (const Source *s : m_sources) any = any || s->m_active;
+
+	if (any && !m_fd) return openFile();
+	if (!any && m_fd) {
+		lck.unlock();
+		closeFile();
+	}
+	return true;
+}
+
+bool
+StationLog::setPath(const char *fname)
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	if (m_path == fname) return true;
+	m_path = fname;
+	if (!m_fd) return true;
+
+	lck.unlock();
+	closeFile();
+	lck.lock();
+	return openFile();
+}
+
+StationLog::Stats
+StationLog::stats() const
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Stats stats;
+
+	stats.written = m_written;
+	stats.activeSources = std::count_if(m_sources.begin(), m_sources.end(), [](const Source *s) { return s->m_active.load(); });
+	stats.open = m_fd != NULL;
+	return stats;
+}
+
+StationLog&
+StationLog::shared()
+{
+	static StationLog log;
+	return log;
+}
+
+/* Private methods {{{ */
+/* Called with m_mtx held */
+bool
+StationLog::openFile()
+{
+	const size_t len = m_path.size();
+	uint32_t header[2] = {sizeof(Record), 0};
+
+	if (!(m_fd = fopen(m_path.c_str(), "ab"))) return false;
+	m_binary = len >= 4 && !m_path.compare(len - 4, 4, ".bin");
+
+	/* Only write the header once */
+	fseek(m_fd, 0, SEEK_END);
+	if (ftell(m_fd) == 0) {
+		if (m_binary) {
+			fwrite(STATION_MAGIC, 1, 8, m_fd);
+			fwrite(header, sizeof(header), 1, m_fd);
+		} else {
+			fprintf(m_fd, "Receive time,Instance,Frequency,Serial,Frame,Epoch,Latitude,Longitude,Altitude,"
+			              "Speed,Heading,Climb,Temperature,Relative humidity,Dew point,Pressure,Burstkill\n");
+		}
+	}
+
+	m_running = true;
+	m_thread = std::thread(&StationLog::worker, this);
+	return true;
+}
+
+/* Called without m_mtx held */
+void
+StationLog::closeFile()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		if (!m_running) return;
+		m_running = false;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	fclose(m_fd);
+	m_fd = NULL;
+}
+
+void
+StationLog::worker()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	for (;;) {
+		m_cv.wait_for(lck, std::chrono::milliseconds(MERGE_TICK_MS), [this]{ return !m_running; });
+
+		/* Once stopping, write everything that is left, in order */
+		merge(!m_running);
+		fflush(m_fd);
+		if (!m_running) break;
+	}
+}
+
+/* Called with m_mtx held */
+void
+StationLog::merge(bool drain)
+{
+	const int64_t horizon = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count() - (int64_t)STATION_MERGE_DELAY_MS * 1000000;
+	Record record;
+
+	for (;;) {
+		Source *oldest = NULL;
+		const Record *oldestHead = NULL;
+		bool complete = true;
+
+		/* k-way merge: the queues are each in receive order, so the oldest frame is at one of their heads */
+		for (Source *source : m_sources) {
+			const Record *head = source->m_queue.peek();
+
+			if (!head) {
+				if (source->m_active) complete = false;
+				continue;
+			}
+			if (!oldestHead || head->rxTime < oldestHead->rxTime) {
+				oldest = source;
+				oldestHead = head;
+			}
+		}
+
+		if (!oldest) break;
+
+		/* An active instance with nothing queued might still deliver an older frame */
+		if (!drain && !complete && oldestHead->rxTime > horizon) break;
+
+		oldest->m_queue.pop(&record);
+		write(record);
+	}
+}
+
+void
+StationLog::write(const Record &record)
+{
+	if (m_binary) {
+		fwrite(&record, sizeof(record), 1, m_fd);
+	} else {
+		fprintf(m_fd, "%.3f,%s,%.0f,%s,%d,%lld,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%d\n",
+		        record.rxTime / 1e9, record.instance, record.frequency, record.serial, record.seq, (long long)record.time,
+		        record.lat, record.lon, record.alt, record.spd, record.hdg, record.climb,
+		        record.temp, record.rh, record.dewpt, record.pressure, record.burstkill);
+	}
+	m_written++;
+}
+/* }}} */
+/* }}} */
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "decode/common.hpp"
+#include "spsc.hpp"
+
+#define STATION_QUEUE_SIZE 256      /* Frames buffered per instance */
+#define STATION_MERGE_DELAY_MS 2000 /* How long a frame waits for older ones from instances with nothing queued */
+
+/**
+ * Station-wide log, merging the frames of every module instance into a single
+ * file ordered by receive time. Each instance feeds its own lock-free queue; a
+ * single background thread repeatedly takes the oldest frame at the head of
+ * the queues. A frame is only written once every active instance has a newer
+ * one queued, or once it is older than STATION_MERGE_DELAY_MS, so that
+ * instances decoding at different rates still interleave correctly.
+ *
+ * The log is CSV, or fixed-size binary records (see Record) if the file name
+ * ends in .bin. Either way it is appended to, and only open while at least one
+ * instance is logging to it.
+ */
+class StationLog {
+public:
+	/* Binary record, stored as-is in native byte order after a 16-byte header */
+	struct Record {
+		int64_t rxTime;             /* Receive time, ns since the Unix epoch */
+		double frequency;           /* Frequency the instance is tuned to, Hz */
+		char instance[32];
+		char serial[32];
+		int64_t time;               /* Onboard time */
+		int32_t seq;
+		int32_t burstkill;
+		float lat, lon, alt;
+		float spd, hdg, climb;
+		float temp, rh, dewpt, pressure;
+		uint8_t calibrated;
+		uint8_t reserved[7];
+	};
+
+	/* Frames of one instance */
+	class Source {
+	public:
+		/**
+		 * Queue a frame, stamped with the current time. Meant to be called from
+		 * the DSP thread: never blocks nor takes a lock.
+		 *
+		 * @param data decoded frame
+		 * @param frequency frequency the instance is tuned to, Hz
+		 * @return true if the frame was queued, false if the instance is not
+		 *         logging or the merge thread is lagging behind
+		 */
+		bool push(const SondeFullData &data, double frequency);
+
+		uint64_t dropped() const { return m_dropped; }
+		size_t memoryUsage() const { return sizeof(*this) + m_queue.capacity() * sizeof(Record); }
+
+	private:
+		friend class StationLog;
+		Source(const char *instance);
+
+		char m_instance[32];
+		radiosonde::SpscQueue<Record> m_queue;
+		std::atomic<bool> m_active;
+		std::atomic<uint64_t> m_dropped;
+	};
+
+	struct Stats {
+		uint64_t written;
+		int activeSources;
+		bool open;
+	};
+
+	StationLog();
+	~StationLog();
+	StationLog(const StationLog&) = delete;
+	StationLog &operator=(const StationLog&) = delete;
+
+	/**
+	 * Register an instance. Its frames are discarded until setActive() is called.
+	 *
+	 * @param instance name of the instance, written in every record
+	 * @return source to push frames to, owned by the log
+	 */
+	Source *addSource(const char *instance);
+
+	/**
+	 * Unregister an instance. Its queued frames are written first, and the
+	 * source must not be used anymore.
+	 */
+	void removeSource(Source *source);
+
+	/**
+	 * Start or stop logging the frames of an instance. The file is opened when
+	 * the first instance starts, and closed when the last one stops.
+	 *
+	 * @return false if the file could not be opened, true otherwise
+	 */
+	bool setActive(Source *source, bool active);
+
+	/**
+	 * Change the log file, reopening it if it is currently open.
+	 *
+	 * @param fname path to the file
+	 * @return false if the file could not be opened, true otherwise
+	 */
+	bool setPath(const char *fname);
+
+	Stats stats() const;
+
+	/**
+	 * Log shared by all module instances.
+	 */
+	static StationLog &shared();
+
+private:
+	bool openFile();
+	void closeFile();
+	void worker();
+	void merge(bool drain);
+	void write(const Record &record);
+
+	mutable std::mutex m_mtx;       /* Protects everything below but the counters */
+	std::condition_variable m_cv;
+	std::thread m_thread;
+	bool m_running;
+
+	std::vector<Source*> m_sources;
+	std::string m_path;
+	FILE *m_fd;
+	bool m_binary;
+
+	std::atomic<uint64_t> m_written;
+};
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <ctype.h>
+#include <filesystem>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "terrain.hpp"
+
+#define TILE_SLOTS (180 * 360)
+#define HGT_VOID -32768
+
+namespace fs = std::filesystem;
+
+static inline int16_t
+hgt_sample(const uint8_t *data, int size, int x, int y)
+{
+	const uint8_t *p = data + 2 * ((size_t)y * size + x);
+	return (int16_t)(p[0] << 8 | p[1]);
+}
+
+Terrain::Terrain(size_t budget) : m_slots(new std::atomic<Tile*>[TILE_SLOTS])
+{
+	for (int i=0; i<TILE_SLOTS; i++) m_slots[i] = NULL;
+	m_missing.data = NULL;
+	m_missing.size = 0;
+	m_missing.index = -1;
+	m_skipped.data = NULL;
+	m_skipped.size = 0;
+	m_skipped.index = -1;
+	m_tick = 0;
+	m_budget = budget;
+	m_usage = 0;
+	m_pinLat = m_pinLon = 0;
+	m_pinRadius = -1;
+}
+
+Terrain::~Terrain()
+{
+	m_domain.synchronize();
+	for (Tile *tile : m_loaded) delete tile;
+}
+
+void
+Terrain::setDirectory(const std::string &dir)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+
+		for (int i=0; i<TILE_SLOTS; i++) {
+			if (m_slots[i].load(std::memory_order_relaxed) == &m_missing) m_slots[i] = NULL;
+		}
+		unskip();
+		while (!m_loaded.empty()) evict(m_loaded.back());
+		m_dir = dir;
+	}
+	m_domain.reclaim();
+}
+
+void
+Terrain::setBudget(size_t budget)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_budget = budget;
+		shrink(m_budget);
+		unskip();
+	}
+	m_domain.reclaim();
+}
+
+float
+Terrain::elevation(float lat, float lon)
+{
+	int ilat, ilon;
+
+	if (!cell(lat, &lon, &ilat, &ilon)) return NAN;
+	return interpolate(lookup(ilat, ilon, m_tick.load(std::memory_order_relaxed)), lat, lon, ilat, ilon);
+}
+
+void
+Terrain::elevation(const float *lat, const float *lon, float *dst, int count)
+{
+	const uint32_t tick = m_tick.load(std::memory_order_relaxed);
+	const Tile *tile = NULL;
+	int ilat, ilon, prevLat = 0, prevLon = 0;
+	float x;
+
+	for (int i=0; i<count; i++) {
+		x = lon[i];
+		if (!cell(lat[i], &x, &ilat, &ilon)) {
+			dst[i] = NAN;
+			continue;
+		}
+		if (!tile || ilat != prevLat || ilon != prevLon) {
+			tile = lookup(ilat, ilon, tick);
+			prevLat = ilat;
+			prevLon = ilon;
+		}
+		dst[i] = interpolate(tile, lat[i], x, ilat, ilon);
+	}
+}
+
+void
+Terrain::preload(float lat, float lon, float radius)
+{
+	int ilat, ilon;
+	float x = lon;
+
+	/* Keep this area mapped from now on; moving it may free some budget for the skipped cells */
+	if (cell(std::min(std::max(lat, -89.5f), 89.5f), &x, &ilat, &ilon)) {
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_pinLat = ilat;
+		m_pinLon = ilon;
+		m_pinRadius = (int)ceilf(radius);
+		unskip();
+	}
+
+	{
+		radiosonde::EpochDomain::Guard guard(m_domain);
+		for (float y = lat - radius; y < lat + radius + 1; y += 1.0f) {
+			for (float x = lon - radius; x < lon + radius + 1; x += 1.0f) {
+				elevation(std::min(std::max(y, -89.5f), 89.5f), x);
+			}
+		}
+	}
+	m_domain.reclaim();
+}
+
+int
+Terrain::tiles()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_loaded.size();
+}
+
+size_t
+Terrain::usage()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_usage;
+}
+
+/* Private methods {{{ */
+/* Normalize the longitude, and find the 1x1 degree cell containing a point */
+bool
+Terrain::cell(float lat, float *lon, int *ilat, int *ilon)
+{
+	if (!(lat >= -90 && lat < 90) || isnan(*lon)) return false;
+	*lon = fmodf(*lon + 180.0f, 360.0f);
+	*lon = (*lon < 0 ? *lon + 360.0f : *lon) - 180.0f;
+
+	*ilat = (int)floorf(lat);
+	*ilon = std::min((int)floorf(*lon), 179);
+	return true;
+}
+
+Terrain::Tile*
+Terrain::lookup(int ilat, int ilon, uint32_t tick)
+{
+	Tile *tile = m_slots[slotIndex(ilat, ilon)].load(std::memory_order_acquire);
+
+	if (!tile) tile = load(ilat, ilon);
+
+	/* Approximate LRU: only write when the tick changed, to keep the cache line shared */
+	if (tile != &m_missing && tile != &m_skipped && tile->lastUse.load(std::memory_order_relaxed) != tick) {
+		tile->lastUse.store(tick, std::memory_order_relaxed);
+	}
+	return tile;
+}
+
+float
+Terrain::interpolate(const Tile *tile, float lat, float lon, int ilat, int ilon)
+{
+	int x0, y0, x1, y1, n;
+	int16_t h00, h01, h10, h11;
+	float fx, fy;
+
+	if (!tile->data) return NAN;
+
+	/* Rows go from north to south, and tiles overlap their neighbors by one sample */
+	n = tile->size;
+	fx = (lon - ilon) * (n - 1);
+	fy = (ilat + 1 - lat) * (n - 1);
+	x0 = std::min((int)fx, n - 1);
+	y0 = std::min((int)fy, n - 1);
+	x1 = std::min(x0 + 1, n - 1);
+	y1 = std::min(y0 + 1, n - 1);
+	fx -= x0;
+	fy -= y0;
+
+	h00 = hgt_sample(tile->data, n, x0, y0);
+	h01 = hgt_sample(tile->data, n, x1, y0);
+	h10 = hgt_sample(tile->data, n, x0, y1);
+	h11 = hgt_sample(tile->data, n, x1, y1);
+	if (h00 == HGT_VOID || h01 == HGT_VOID || h10 == HGT_VOID || h11 == HGT_VOID) return NAN;
+
+	return (1 - fy) * (h00 + fx * (h01 - h00)) + fy * (h10 + fx * (h11 - h10));
+}
+
+void
+Terrain::destroyTile(void *ptr)
+{
+	delete (Tile*)ptr;
+}
+
+Terrain::Tile*
+Terrain::load(int ilat, int ilon)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	const int index = slotIndex(ilat, ilon);
+	Tile *tile;
+	char name[16];
+
+	/* Someone else might have loaded it while we were waiting for the lock */
+	if ((tile = m_slots[index].load(std::memory_order_acquire))) return tile;
+	if (m_dir.empty()) {
+		m_slots[index].store(&m_missing, std::memory_order_release);
+		return &m_missing;
+	}
+
+	snprintf(name, sizeof(name), "%c%02d%c%03d.hgt", ilat >= 0 ? 'N' : 'S', abs(ilat), ilon >= 0 ? 'E' : 'W', abs(ilon));
+
+	tile = new Tile();
+	if (!tile->file.open((fs::u8path(m_dir) / name).string().c_str())) {
+		/* Some archives use lowercase names */
+		for (char *c = name; *c; c++) *c = tolower(*c);
+		tile->file.open((fs::u8path(m_dir) / name).string().c_str());
+	}
+
+	/* Only square tiles are valid, anything else is not an .hgt file */
+	tile->size = (int)sqrt(tile->file.size() / 2);
+	if (!tile->file.isOpen() || tile->size < 2 || (size_t)tile->size * tile->size * 2 != tile->file.size()) {
+		delete tile;
+		m_slots[index].store(&m_missing, std::memory_order_release);
+		return &m_missing;
+	}
+
+	tile->data = (const uint8_t*)tile->file.data();
+	tile->index = index;
+	tile->lastUse = m_tick.fetch_add(1, std::memory_order_relaxed) + 1;
+	tile->file.prefetch();
+
+	/* Make room for the new tile. Past the budget, only the cells around the
+	 * preloaded point are mapped: evicting each other on every lookup would
+	 * remap the same tiles over and over under the lock */
+	shrink(m_budget > tile->file.size() ? m_budget - tile->file.size() : 0);
+	if (m_usage + tile->file.size() > m_budget && !pinned(index)) {
+		delete tile;
+		m_skippedSlots.push_back(index);
+		m_slots[index].store(&m_skipped, std::memory_order_release);
+		return &m_skipped;
+	}
+
+	m_loaded.push_back(tile);
+	m_usage += tile->file.size();
+	m_slots[index].store(tile, std::memory_order_release);
+	return tile;
+}
+
+/* Whether a cell is around the last preloaded point, and must stay mapped */
+bool
+Terrain::pinned(int index) const
+{
+	const int ilat = index / 360 - 90;
+	const int dlon = abs(index % 360 - 180 - m_pinLon);
+
+	return m_pinRadius >= 0 && abs(ilat - m_pinLat) <= m_pinRadius && std::min(dlon, 360 - dlon) <= m_pinRadius;
+}
+
+/* Let the cells skipped for lack of budget be tried again */
+void
+Terrain::unskip()
+{
+	for (int index : m_skippedSlots) {
+		if (m_slots[index].load(std::memory_order_relaxed) == &m_skipped) m_slots[index].store(NULL, std::memory_order_release);
+	}
+	m_skippedSlots.clear();
+}
+
+/* Unmap unpinned tiles, least recently used first, until at most target bytes are mapped */
+void
+Terrain::shrink(size_t target)
+{
+	std::vector<Tile*>::iterator oldest;
+
+	while (m_usage > target) {
+		oldest = m_loaded.end();
+		for (auto it = m_loaded.begin(); it != m_loaded.end(); it++) {
+			if (pinned((*it)->index)) continue;
+			if (oldest == m_loaded.end() || (*it)->lastUse.load(std::memory_order_relaxed) < (*oldest)->lastUse.load(std::memory_order_relaxed)) oldest = it;
+		}
+		if (oldest == m_loaded.end()) break;
+		evict(*oldest);
+	}
+}
+
+void
+Terrain::evict(Tile *tile)
+{
+	m_slots[tile->index].store(NULL, std::memory_order_release);
+	m_loaded.erase(std::find(m_loaded.begin(), m_loaded.end(), tile));
+	m_usage -= tile->file.size();
+	m_domain.retire(tile, destroyTile);
+}
+/* }}} */
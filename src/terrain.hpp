@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "epoch.hpp"
+#include "mmap.hpp"
+
+#define TERRAIN_DEFAULT_BUDGET ((size_t)256 << 20)  /* Bytes of tiles kept mapped */
+
+/**
+ * Ground elevation from SRTM-style .hgt tiles (1x1 degree, big-endian 16-bit
+ * samples, 3 or 1 arcsecond resolution). Tiles are mapped on first access and
+ * unmapped in least-recently-used order once the memory budget is exceeded.
+ * The tiles around the last preloaded point are kept whatever the budget;
+ * past it, other tiles are not mapped at all and read as missing, rather than
+ * evicting each other on every lookup.
+ *
+ * Lookups never take locks once a tile is mapped, and are safe from any number
+ * of threads as long as they hold a guard on domain(): evicted tiles are only
+ * unmapped once no reader can see them.
+ */
+class Terrain {
+public:
+	/**
+	 * @param budget maximum size of the mapped tiles, in bytes. The tiles around
+	 *        the last preloaded point are kept even past it
+	 */
+	Terrain(size_t budget = TERRAIN_DEFAULT_BUDGET);
+	~Terrain();
+
+	/**
+	 * Change the directory containing the tiles. Mapped tiles are dropped.
+	 *
+	 * @param dir directory containing the .hgt files, or an empty string to disable
+	 */
+	void setDirectory(const std::string &dir);
+
+	/**
+	 * Change the memory budget, unmapping the least recently used tiles until
+	 * the mapped ones fit or only the ones around the last preloaded point are
+	 * left.
+	 *
+	 * @param budget maximum size of the mapped tiles, in bytes
+	 */
+	void setBudget(size_t budget);
+
+	/**
+	 * Interpolate the ground elevation at a given point.
+	 *
+	 * @param lat latitude, degrees
+	 * @param lon longitude, degrees
+	 * @return elevation above mean sea level in meters, NaN if no tile covers the point
+	 */
+	float elevation(float lat, float lon);
+
+	/**
+	 * Interpolate the ground elevation at several points. Cheaper than as many
+	 * calls to elevation() for points close to each other: the tile is only
+	 * looked up again when a point falls into a different one.
+	 *
+	 * @param lat latitudes, degrees
+	 * @param lon longitudes, degrees
+	 * @param dst destination for the elevations, NaN where no tile covers the point
+	 * @param count number of points
+	 */
+	void elevation(const float *lat, const float *lon, float *dst, int count);
+
+	/**
+	 * Map the tiles around a point ahead of time, so that lookups in that area
+	 * never stall on I/O, and keep them mapped until the next call whatever the
+	 * budget. Also frees evicted tiles no longer in use.
+	 *
+	 * @param lat latitude, degrees
+	 * @param lon longitude, degrees
+	 * @param radius half-size of the area to preload, degrees
+	 */
+	void preload(float lat, float lon, float radius);
+
+	radiosonde::EpochDomain &domain() { return m_domain; }
+
+	/* Statistics */
+	int tiles();
+	size_t usage();
+
+private:
+	struct Tile {
+		MappedFile file;
+		const uint8_t *data;
+		int size;                       /* Samples per side */
+		int index;                      /* Slot in the tile table */
+		std::atomic<uint32_t> lastUse;
+	};
+
+	static int slotIndex(int ilat, int ilon) { return (ilat + 90) * 360 + (ilon + 180); }
+	static bool cell(float lat, float *lon, int *ilat, int *ilon);
+	static float interpolate(const Tile *tile, float lat, float lon, int ilat, int ilon);
+	Tile *lookup(int ilat, int ilon, uint32_t tick);
+	static void destroyTile(void *ptr);
+	Tile *load(int ilat, int ilon);
+	bool pinned(int index) const;
+	void unskip();
+	void shrink(size_t target);
+	void evict(Tile *tile);
+
+	radiosonde::EpochDomain m_domain;
+	std::unique_ptr<std::atomic<Tile*>[]> m_slots;     /* One per 1x1 degree cell */
+	Tile m_missing;                                     /* Marks cells with no tile on disk */
+	Tile m_skipped;                                     /* Marks cells not mapped for lack of budget */
+	std::atomic<uint32_t> m_tick;
+
+	std::mutex m_mtx;
+	std::string m_dir;
+	std::vector<Tile*> m_loaded;
+	std::vector<int> m_skippedSlots;
+	size_t m_budget, m_usage;
+	int m_pinLat, m_pinLon, m_pinRadius;    /* Cells kept whatever the budget, radius -1 for none */
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "threadpool.hpp"
+
+using namespace radiosonde;
+
+/* State of a parallelFor() call. Shared, since helper tasks might start after
+ * the call has returned, and must still find valid memory to bail out on */
+struct ParallelForState {
+	std::function<void(int, int)> fn;
+	int count, chunk;
+	std::atomic<int> next, done;
+	std::mutex mtx;
+	std::condition_variable cv;
+	const ThreadPool *yieldTo;  /* Pool whose normal tasks background helpers make way for, NULL if none */
+
+	/* Helpers may stop early, the calling thread then takes the remaining chunks */
+	void work(bool helper) {
+		int begin, end, processed = 0;
+
+		while (!(helper && yieldTo && yieldTo->busy()) && (begin = next.fetch_add(chunk)) < count) {
+			end = std::min(begin + chunk, count);
+			fn(begin, end);
+			processed += end - begin;
+		}
+
+		if (processed && done.fetch_add(processed) + processed == count) {
+			std::lock_guard<std::mutex> lck(mtx);
+			cv.notify_all();
+		}
+	}
+};
+
+ThreadPool::ThreadPool(int threads)
+{
+	m_stop = false;
+	m_pending = 0;
+	for (int i=0; i<threads; i++) {
+		m_threads.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	for (std::thread &thread : m_threads) {
+		thread.join();
+	}
+}
+
+bool
+ThreadPool::submit(std::function<void()> task, TaskPriority priority)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		std::deque<std::function<void()>> &queue = priority == TASK_BACKGROUND ? m_background : m_tasks;
+
+		if (m_stop || queue.size() >= THREADPOOL_MAX_QUEUED) return false;
+		queue.push_back(std::move(task));
+		m_pending = m_tasks.size();
+	}
+	m_cv.notify_one();
+	return true;
+}
+
+void
+ThreadPool::parallelFor(int count, int chunk, const std::function<void(int, int)> &fn, TaskPriority priority)
+{
+	std::shared_ptr<ParallelForState> state;
+	int helpers;
+
+	if (count <= 0) return;
+	chunk = std::max(chunk, 1);
+
+	state = std::make_shared<ParallelForState>();
+	state->fn = fn;
+	state->count = count;
+	state->chunk = chunk;
+	state->next = 0;
+	state->done = 0;
+	state->yieldTo = priority == TASK_BACKGROUND ? this : NULL;
+
+	/* The calling thread takes part too, so one helper less is needed */
+	helpers = std::min((count + chunk - 1) / chunk - 1, size());
+	for (int i=0; i<helpers; i++) {
+		if (!submit([state]{ state->work(true); }, priority)) break;
+	}
+
+	state->work(false);
+
+	std::unique_lock<std::mutex> lck(state->mtx);
+	state->cv.wait(lck, [&state]{ return state->done.load() == state->count; });
+}
+
+ThreadPool&
+ThreadPool::shared()
+{
+	static ThreadPool pool(std::max(1, (int)std::thread::hardware_concurrency() - 1));
+	return pool;
+}
+
+void
+ThreadPool::worker()
+{
+	std::function<void()> task;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lck(m_mtx);
+			m_cv.wait(lck, [this]{ return m_stop || !m_tasks.empty() || !m_background.empty(); });
+			if (m_stop && m_tasks.empty() && m_background.empty()) return;
+
+			/* Background tasks only when nothing else is waiting */
+			if (!m_tasks.empty()) {
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+				m_pending = m_tasks.size();
+			} else {
+				task = std::move(m_background.front());
+				m_background.pop_front();
+			}
+		}
+		task();
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define THREADPOOL_MAX_QUEUED 256     /* Per priority */
+
+namespace radiosonde {
+	enum TaskPriority {
+		TASK_NORMAL,        /* Latency-sensitive work, e.g. decoding */
+		TASK_BACKGROUND,    /* Only runs when no normal task is waiting */
+	};
+
+	/**
+	 * Fixed-size pool of worker threads with a bounded task queue. Intended for
+	 * background computations that must never hold up the DSP threads: nothing in
+	 * this class blocks the submitter except parallelFor(), which is meant to be
+	 * called from a thread that does not process samples.
+	 *
+	 * Background tasks are only started when no normal task is queued, and
+	 * background parallelFor() helpers give their worker back between chunks
+	 * as soon as a normal task shows up, so that long computations cannot
+	 * delay decoding by more than one chunk.
+	 */
+	class ThreadPool {
+	public:
+		/**
+		 * @param threads number of worker threads
+		 */
+		ThreadPool(int threads);
+		~ThreadPool();
+
+		/**
+		 * Queue a task for execution.
+		 *
+		 * @param task function to run on a worker
+		 * @param priority queue to add the task to
+		 * @return true if the task was queued, false if the queue is full
+		 */
+		bool submit(std::function<void()> task, TaskPriority priority = TASK_NORMAL);
+
+		/**
+		 * Run fn over [0, count) split into chunks, on the workers and on the
+		 * calling thread. Returns once every chunk has been processed.
+		 *
+		 * @param count number of items
+		 * @param chunk number of items per call to fn
+		 * @param fn function processing items [begin, end)
+		 * @param priority priority of the helper tasks. With TASK_BACKGROUND,
+		 *        the calling thread might end up processing most chunks itself
+		 */
+		void parallelFor(int count, int chunk, const std::function<void(int begin, int end)> &fn,
+		                 TaskPriority priority = TASK_NORMAL);
+
+		int size() const { return m_threads.size(); }
+
+		/* Whether normal tasks are waiting for a worker */
+		bool busy() const { return m_pending.load(std::memory_order_relaxed) > 0; }
+
+		/**
+		 * Pool shared by all module instances, sized after the number of cores.
+		 */
+		static ThreadPool &shared();
+
+	private:
+		void worker();
+
+		std::vector<std::thread> m_threads;
+		std::deque<std::function<void()>> m_tasks, m_background;
+		std::atomic<int> m_pending;     /* Size of m_tasks */
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		bool m_stop;
+	};
+}
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include "mmap.hpp"
+#include "tilecache.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+/* Only the few functions needed here, kept private to this file */
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#include <imgui/stb_image.h>
+
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+#define MAX_TILE_SIZE 1024          /* Pixels per side, larger images are not tiles */
+
+namespace fs = std::filesystem;
+
+TileCache::TileCache(size_t budget)
+{
+	m_budget = budget;
+	m_usage = 0;
+	m_frame = 0;
+	m_running = true;
+	m_generation = 0;
+	m_decodeSeconds = 0;
+	m_decodeCount = 0;
+	m_thread = std::thread(&TileCache::worker, this);
+}
+
+/* The GL context is gone by the time the shared cache is destroyed: the textures go with it */
+TileCache::~TileCache()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+void
+TileCache::setDirectory(const std::string &dir)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+
+		if (m_dir == dir) return;
+		m_dir = dir;
+		m_generation++;
+		m_requests.clear();
+		m_queued.clear();
+		m_decoded.clear();
+	}
+	while (!m_lru.empty()) release(std::prev(m_lru.end()));
+}
+
+void
+TileCache::setBudget(size_t budget)
+{
+	m_budget = budget;
+}
+
+uint32_t
+TileCache::get(int z, int x, int y)
+{
+	const uint64_t key = tileKey(z, x, y);
+	const uint32_t texture = peek(z, x, y);
+
+	if (texture || m_tiles.count(key)) return texture;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+
+		if (m_dir.empty()) return 0;
+		if (m_queued.count(key)) {
+			/* Still wanted: move it ahead of the tiles that scrolled out of view */
+			for (auto it = m_requests.begin(); it != m_requests.end(); it++) {
+				if (*it == key) {
+					m_requests.splice(m_requests.begin(), m_requests, it);
+					break;
+				}
+			}
+			return 0;
+		}
+
+		m_queued.insert(key);
+		m_requests.push_front(key);
+		if (m_requests.size() > TILECACHE_MAX_PENDING) {
+			m_queued.erase(m_requests.back());
+			m_requests.pop_back();
+		}
+	}
+	m_cv.notify_one();
+	return 0;
+}
+
+uint32_t
+TileCache::peek(int z, int x, int y)
+{
+	const auto it = m_tiles.find(tileKey(z, x, y));
+
+	if (it == m_tiles.end()) return 0;
+	it->second->lastFrame = m_frame;
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+	return it->second->texture;
+}
+
+void
+TileCache::update(uint64_t frame)
+{
+	std::vector<Decoded> decoded;
+	uint64_t generation;
+
+	if (frame == m_frame) return;
+	m_frame = frame;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		const size_t count = std::min(m_decoded.size(), (size_t)TILECACHE_UPLOADS);
+
+		for (size_t i=0; i<count; i++) {
+			m_queued.erase(m_decoded[i].key);
+			decoded.push_back(std::move(m_decoded[i]));
+		}
+		m_decoded.erase(m_decoded.begin(), m_decoded.begin() + count);
+		generation = m_generation;
+	}
+
+	for (const Decoded &tile : decoded) {
+		GLuint texture = 0;
+
+		if (tile.generation != generation || m_tiles.count(tile.key)) continue;
+
+		if (!tile.pixels.empty()) {
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tile.width, tile.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, tile.pixels.data());
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		m_lru.push_front({tile.key, texture, tile.pixels.size(), m_frame});
+		m_tiles[tile.key] = m_lru.begin();
+		m_usage += tile.pixels.size();
+	}
+
+	/* Least recently used first, but never the tiles drawn in the previous frame */
+	while ((m_usage > m_budget || m_tiles.size() > TILECACHE_MAX_TILES)
+	       && !m_lru.empty() && m_lru.back().lastFrame + 1 < m_frame) {
+		release(std::prev(m_lru.end()));
+	}
+}
+
+TileCache::Stats
+TileCache::stats() const
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Stats stats;
+
+	stats.tiles = m_tiles.size();
+	stats.usage = m_usage;
+	stats.pending = m_queued.size();
+	stats.decodeMs = m_decodeCount ? 1e3 * m_decodeSeconds / m_decodeCount : 0;
+	return stats;
+}
+
+TileCache&
+TileCache::shared()
+{
+	static TileCache cache;
+	return cache;
+}
+
+/* Private methods {{{ */
+void
+TileCache::worker()
+{
+	typedef std::chrono::steady_clock clock;
+	static const char *const extensions[] = {".png", ".jpg", ".jpeg"};
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	for (;;) {
+		m_cv.wait(lck, [this]{ return !m_running || !m_requests.empty(); });
+		if (!m_running) break;
+
+		const clock::time_point start = clock::now();
+		Decoded tile;
+		tile.key = m_requests.front();
+		tile.generation = m_generation;
+		tile.width = tile.height = 0;
+		m_requests.pop_front();
+
+		const fs::path dir = fs::path(m_dir) / std::to_string(tile.key >> 58) / std::to_string(tile.key >> 29 & 0x1FFFFFFF);
+		lck.unlock();
+
+		/* Tiles missing on disk are remembered as such, without a texture */
+		for (const char *ext : extensions) {
+			MappedFile file;
+			uint8_t *pixels;
+			int channels;
+
+			if (!file.open((dir / (std::to_string(tile.key & 0x1FFFFFFF) + ext)).string().c_str())) continue;
+			pixels = stbi_load_from_memory((const stbi_uc*)file.data(), file.size(), &tile.width, &tile.height, &channels, 4);
+			if (pixels && tile.width <= MAX_TILE_SIZE && tile.height <= MAX_TILE_SIZE) {
+				tile.pixels.assign(pixels, pixels + (size_t)tile.width * tile.height * 4);
+			}
+			if (pixels) stbi_image_free(pixels);
+			break;
+		}
+
+		lck.lock();
+		m_decodeSeconds += std::chrono::duration<double>(clock::now() - start).count();
+		m_decodeCount++;
+		if (tile.generation == m_generation && m_queued.count(tile.key)) m_decoded.push_back(std::move(tile));
+	}
+}
+
+/* Called from the GUI thread */
+void
+TileCache::release(std::list<Tile>::iterator it)
+{
+	if (it->texture) {
+		const GLuint texture = it->texture;
+		glDeleteTextures(1, &texture);
+	}
+	m_usage -= it->size;
+	m_tiles.erase(it->key);
+	m_lru.erase(it);
+}
+/* }}} */
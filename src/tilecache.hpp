@@ -0,0 +1,120 @@
+#pragma once
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define TILECACHE_DEFAULT_BUDGET ((size_t)64 << 20)    /* Bytes of textures kept on the GPU */
+#define TILECACHE_MAX_PENDING 64    /* Tile requests queued for decoding, the oldest are dropped first */
+#define TILECACHE_UPLOADS 4         /* Textures created per frame, to bound the frame time */
+#define TILECACHE_MAX_TILES 4096    /* Entries kept, including tiles missing on disk */
+
+/**
+ * Map tiles stored locally in the usual {z}/{x}/{y}.png (or .jpg) layout, as
+ * OpenGL textures. Tiles are read and decoded on a background thread, then
+ * turned into textures by the GUI thread a few at a time, and released in
+ * least-recently-used order once the memory budget is exceeded.
+ *
+ * Everything but the constructor and destructor must be called from the GUI
+ * thread, with the GL context current.
+ */
+class TileCache {
+public:
+	struct Stats {
+		size_t tiles;               /* Textures on the GPU */
+		size_t usage;               /* Bytes used by the textures */
+		size_t pending;             /* Tiles waiting to be decoded */
+		double decodeMs;            /* Average time to read and decode a tile */
+	};
+
+	/**
+	 * @param budget maximum size of the textures, in bytes. The tiles drawn in
+	 *        the current frame are never released, even when over budget
+	 */
+	TileCache(size_t budget = TILECACHE_DEFAULT_BUDGET);
+	~TileCache();
+	TileCache(const TileCache&) = delete;
+	TileCache &operator=(const TileCache&) = delete;
+
+	/**
+	 * Change the directory containing the tiles. Cached tiles are released.
+	 *
+	 * @param dir directory containing the zoom levels, or an empty string to disable
+	 */
+	void setDirectory(const std::string &dir);
+	void setBudget(size_t budget);
+
+	/**
+	 * Look up a tile, and queue it for loading if it is not cached yet.
+	 *
+	 * @param z zoom level
+	 * @param x column
+	 * @param y row
+	 * @return texture name, 0 if the tile is not available (yet)
+	 */
+	uint32_t get(int z, int x, int y);
+
+	/**
+	 * Look up a tile without loading it.
+	 */
+	uint32_t peek(int z, int x, int y);
+
+	/**
+	 * Turn decoded tiles into textures and release the least recently used
+	 * ones. Called before drawing, only the first call in a frame has any effect.
+	 *
+	 * @param frame number of the current frame
+	 */
+	void update(uint64_t frame);
+
+	Stats stats() const;
+
+	/**
+	 * Cache shared by all module instances, which all draw in the same GL context.
+	 */
+	static TileCache &shared();
+
+private:
+	struct Tile {
+		uint64_t key;
+		uint32_t texture;           /* 0 if the tile is missing on disk */
+		size_t size;
+		uint64_t lastFrame;
+	};
+	struct Decoded {
+		uint64_t key;
+		uint64_t generation;        /* Directory the tile was read from */
+		int width, height;
+		std::vector<uint8_t> pixels;
+	};
+
+	static uint64_t tileKey(int z, int x, int y) { return (uint64_t)z << 58 | (uint64_t)x << 29 | (uint64_t)y; }
+	void worker();
+	void release(std::list<Tile>::iterator it);
+
+	/* GUI thread only */
+	std::list<Tile> m_lru;          /* Most recently used first */
+	std::unordered_map<uint64_t, std::list<Tile>::iterator> m_tiles;
+	size_t m_budget, m_usage;
+	uint64_t m_frame;
+
+	/* Shared with the decoding thread */
+	mutable std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+	bool m_running;
+	std::string m_dir;
+	uint64_t m_generation;
+	std::list<uint64_t> m_requests;     /* Most recent first */
+	std::unordered_set<uint64_t> m_queued;   /* Requested, decoding or decoded */
+	std::vector<Decoded> m_decoded;
+	double m_decodeSeconds;
+	uint64_t m_decodeCount;
+};
@@ -0,0 +1,204 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "udp.hpp"
+
+#ifdef _WIN32
+#define INVALID_FD INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#define INVALID_FD -1
+#define close_socket ::close
+#endif
+
+bool
+split_host_port(const char *str, std::string *host, int *port)
+{
+	const char *colon = strrchr(str, ':');
+
+	if (!colon || !colon[1]) return false;
+	*host = std::string(str, colon - str);
+	*port = atoi(colon + 1);
+
+	/* Allow [addr]:port for IPv6 literals */
+	if (host->size() >= 2 && host->front() == '[' && host->back() == ']') *host = host->substr(1, host->size() - 2);
+	return true;
+}
+
+/* UdpAddress {{{ */
+bool
+UdpAddress::operator==(const UdpAddress &other) const
+{
+	return len == other.len && !memcmp(&addr, &other.addr, len);
+}
+
+std::string
+UdpAddress::toString() const
+{
+	char host[INET6_ADDRSTRLEN], out[INET6_ADDRSTRLEN + 8];
+	int port;
+
+	if (addr.ss_family == AF_INET6) {
+		const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6*)&addr;
+		inet_ntop(AF_INET6, (void*)&sin6->sin6_addr, host, sizeof(host));
+		port = ntohs(sin6->sin6_port);
+		snprintf(out, sizeof(out), "[%s]:%d", host, port);
+	} else {
+		const struct sockaddr_in *sin = (const struct sockaddr_in*)&addr;
+		inet_ntop(AF_INET, (void*)&sin->sin_addr, host, sizeof(host));
+		port = ntohs(sin->sin_port);
+		snprintf(out, sizeof(out), "%s:%d", host, port);
+	}
+	return out;
+}
+/* }}} */
+
+/* UdpSocket {{{ */
+UdpSocket::UdpSocket()
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	m_fd = INVALID_FD;
+}
+
+UdpSocket::~UdpSocket()
+{
+	close();
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+bool
+UdpSocket::bind(int port)
+{
+	struct sockaddr_in6 local;
+	int off = 0;
+
+	close();
+
+	/* Dual-stack socket, so that both IPv4 and IPv6 stations can reach us */
+	if ((m_fd = socket(AF_INET6, SOCK_DGRAM, 0)) == INVALID_FD) return false;
+	setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&off, sizeof(off));
+
+	memset(&local, 0, sizeof(local));
+	local.sin6_family = AF_INET6;
+	local.sin6_addr = in6addr_any;
+	local.sin6_port = htons(port);
+
+	if (::bind(m_fd, (struct sockaddr*)&local, sizeof(local)) || !setNonBlocking()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool
+UdpSocket::connect(const char *host, int port)
+{
+	struct addrinfo hints, *res, *ai;
+	char service[8];
+
+	close();
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	snprintf(service, sizeof(service), "%d", port);
+	if (getaddrinfo(host, service, &hints, &res)) return false;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((m_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == INVALID_FD) continue;
+		if (!::connect(m_fd, ai->ai_addr, ai->ai_addrlen) && setNonBlocking()) break;
+		close();
+	}
+
+	freeaddrinfo(res);
+	return m_fd != INVALID_FD;
+}
+
+void
+UdpSocket::close()
+{
+	if (m_fd == INVALID_FD) return;
+	close_socket(m_fd);
+	m_fd = INVALID_FD;
+}
+
+int
+UdpSocket::send(const uint8_t *buf, size_t len)
+{
+	if (m_fd == INVALID_FD) return -1;
+	return ::send(m_fd, (const char*)buf, len, 0);
+}
+
+int
+UdpSocket::sendTo(const uint8_t *buf, size_t len, const UdpAddress &to)
+{
+	if (m_fd == INVALID_FD) return -1;
+	return ::sendto(m_fd, (const char*)buf, len, 0, (const struct sockaddr*)&to.addr, to.len);
+}
+
+int
+UdpSocket::recv(uint8_t *buf, size_t len, UdpAddress *from, int timeoutMs)
+{
+	UdpAddress dummy;
+	int ret;
+
+	if (m_fd == INVALID_FD) return -1;
+
+	if (timeoutMs > 0) {
+#ifdef _WIN32
+		WSAPOLLFD pfd;
+		pfd.fd = m_fd;
+		pfd.events = POLLRDNORM;
+		ret = WSAPoll(&pfd, 1, timeoutMs);
+#else
+		struct pollfd pfd;
+		pfd.fd = m_fd;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, timeoutMs);
+#endif
+		if (ret <= 0) return ret;
+	}
+
+	if (!from) from = &dummy;
+	from->len = sizeof(from->addr);
+	ret = ::recvfrom(m_fd, (char*)buf, len, 0, (struct sockaddr*)&from->addr, &from->len);
+
+#ifdef _WIN32
+	if (ret < 0 && (WSAGetLastError() == WSAEWOULDBLOCK || WSAGetLastError() == WSAECONNRESET)) return 0;
+#else
+	if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED)) return 0;
+#endif
+	return ret;
+}
+
+bool
+UdpSocket::isOpen() const
+{
+	return m_fd != INVALID_FD;
+}
+
+/* Private methods {{{ */
+bool
+UdpSocket::setNonBlocking()
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	return !ioctlsocket(m_fd, FIONBIO, &mode);
+#else
+	const int flags = fcntl(m_fd, F_GETFL, 0);
+	return flags >= 0 && !fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+/* }}} */
+/* }}} */
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET udp_socket_t;
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+typedef int udp_socket_t;
+#endif
+
+/* Address of a remote UDP endpoint */
+struct UdpAddress {
+	struct sockaddr_storage addr;
+	socklen_t len;
+
+	bool operator==(const UdpAddress &other) const;
+	std::string toString() const;
+};
+
+/**
+ * Split a host:port string. IPv6 literals must be enclosed in brackets.
+ *
+ * @param str string to split
+ * @param host destination for the host name or address
+ * @param port destination for the port
+ * @return true on success, false if the string has no port
+ */
+bool split_host_port(const char *str, std::string *host, int *port);
+
+/**
+ * Thin, portable wrapper around a UDP socket.
+ */
+class UdpSocket {
+public:
+	UdpSocket();
+	~UdpSocket();
+
+	/**
+	 * Open a socket listening on a local port.
+	 *
+	 * @param port local port
+	 * @return true on success, false otherwise
+	 */
+	bool bind(int port);
+
+	/**
+	 * Open a socket sending to a remote host. Resolves the host name, so it may
+	 * block for a while.
+	 *
+	 * @param host remote host name or address
+	 * @param port remote port
+	 * @return true on success, false otherwise
+	 */
+	bool connect(const char *host, int port);
+	void close();
+
+	/**
+	 * Send a datagram to the connected peer. Never blocks.
+	 *
+	 * @return number of bytes sent, or -1 on error
+	 */
+	int send(const uint8_t *buf, size_t len);
+
+	/**
+	 * Send a datagram to a given address. Never blocks.
+	 *
+	 * @return number of bytes sent, or -1 on error
+	 */
+	int sendTo(const uint8_t *buf, size_t len, const UdpAddress &to);
+
+	/**
+	 * Receive a datagram.
+	 *
+	 * @param buf destination buffer
+	 * @param len size of the buffer
+	 * @param from destination for the sender address, or NULL
+	 * @param timeoutMs time to wait for a datagram, 0 to return immediately
+	 * @return number of bytes received, 0 on timeout, -1 on error
+	 */
+	int recv(uint8_t *buf, size_t len, UdpAddress *from, int timeoutMs);
+
+	bool isOpen() const;
+
+private:
+	bool setNonBlocking();
+
+	udp_socket_t m_fd;
+};
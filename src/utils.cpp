@@ -1,5 +1,18 @@
+#include <stdint.h>
 #include "utils.hpp"
 
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <time.h>
+#else
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 std::string 
 getTempFile(std::string file)
 {
@@ -15,3 +28,55 @@ getTempFile(std::string file)
 	return (std::string(env) + "\\" + file);
 #endif
 }
+
+double
+threadCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	return 1e-7 * (((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime)
+	             + ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime));
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+size_t
+residentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+	return info.resident_size;
+#else
+	unsigned long size, resident;
+	FILE *fd;
+	int ok;
+
+	if (!(fd = fopen("/proc/self/statm", "r"))) return 0;
+	ok = fscanf(fd, "%lu %lu", &size, &resident) == 2;
+	fclose(fd);
+	return ok ? (size_t)resident * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+time_t
+utc_time(int year, int month, int day, int hour, int min, int sec)
+{
+	const int y = year - (month <= 2);
+	const int era = (y >= 0 ? y : y - 399) / 400;
+	const int yoe = y - era * 400;
+	const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	const long days = (long)era * 146097 + doe - 719468;
+
+	return (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
+}
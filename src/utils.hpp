@@ -1,4 +1,15 @@
 #pragma once
+#include <stddef.h>
 #include <string>
+#include <time.h>
 
 std::string getTempFile(std::string file);
+
+/* CPU time consumed by the calling thread, seconds */
+double threadCpuSeconds();
+
+/* Resident memory of the whole process, bytes, 0 if unknown */
+size_t residentBytes();
+
+/* timegm() replacement, not available everywhere */
+time_t utc_time(int year, int month, int day, int hour, int min, int sec);
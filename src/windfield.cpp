@@ -0,0 +1,535 @@
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <filesystem>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "grib2.hpp"
+#include "threadpool.hpp"
+#include "windfield.hpp"
+
+#define WIND_CACHE_MAGIC "RSWIND01"
+#define WIND_CACHE_MAX_SIZE ((size_t)1 << 30)
+#define WIND_ALT_STEP 50.0f         /* Resolution of the altitude -> level table, meters */
+#define WIND_ALT_MAX 50000.0f
+#define WIND_TIME_STEP 3600         /* Resolution of the time -> step table, seconds */
+#define WIND_TIME_MARGIN (3 * 3600) /* Extrapolate forecasts up to this much outside their range */
+#define DATA_ALIGN 64
+
+namespace fs = std::filesystem;
+
+/* Standard atmosphere altitude of a pressure level */
+static float
+isa_altitude(double pressure)
+{
+	if (pressure >= 22632.1) return 44330.8 * (1 - pow(pressure / 101325.0, 0.190263));
+	return 11000 + 6341.62 * log(22632.1 / pressure);
+}
+
+static bool
+is_wind_field(const GribField &field)
+{
+	return field.discipline == GRIB_DISCIPLINE_METEO
+	    && field.category == GRIB_CATEGORY_MOMENTUM
+	    && (field.number == GRIB_PARAM_UGRD || field.number == GRIB_PARAM_VGRD)
+	    && field.levelType == GRIB_LEVEL_ISOBARIC;
+}
+
+static bool
+is_grib_file(const fs::path &path)
+{
+	std::string ext = path.extension().string();
+
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return tolower(c); });
+	return ext == ".grb2" || ext == ".grib2" || ext == ".grb" || ext == ".grib";
+}
+
+static float
+bilinear(const float *layer, int ni, int i0, int i1, int j0, int j1, float fi, float fj)
+{
+	const float top = layer[j0 * ni + i0] + fi * (layer[j0 * ni + i1] - layer[j0 * ni + i0]);
+	const float bottom = layer[j1 * ni + i0] + fi * (layer[j1 * ni + i1] - layer[j1 * ni + i0]);
+	return top + fj * (bottom - top);
+}
+
+/* WindGrid {{{ */
+WindGrid*
+WindGrid::open(const char *fname)
+{
+	WindGrid *grid = new WindGrid();
+	const uint8_t *base;
+	const Header *header;
+
+	if (!grid->m_file.open(fname) || grid->m_file.size() < sizeof(Header)) {
+		delete grid;
+		return NULL;
+	}
+
+	base = (const uint8_t*)grid->m_file.data();
+	header = (const Header*)base;
+	if (memcmp(header->magic, WIND_CACHE_MAGIC, sizeof(header->magic))
+	    || header->ni <= 0 || header->nj <= 0 || header->nlev <= 0 || header->ntime <= 0 || header->nsources < 0
+	    || grid->m_file.size() != fileSize(header->ni, header->nj, header->nlev, header->ntime, header->nsources)) {
+		delete grid;
+		return NULL;
+	}
+
+	grid->m_header = header;
+	grid->m_levels = (const double*)(base + levelsOffset());
+	grid->m_times = (const int64_t*)(base + timesOffset(header->nlev));
+	grid->m_sources = (const Source*)(base + sourcesOffset(header->nlev, header->ntime));
+	grid->m_layerSize = (size_t)header->ni * header->nj;
+	grid->m_u = (float*)(base + dataOffset(header->nlev, header->ntime, header->nsources));
+	grid->m_v = grid->m_u + grid->m_layerSize * header->nlev * header->ntime;
+
+	if (!grid->buildIndex()) {
+		delete grid;
+		return NULL;
+	}
+	return grid;
+}
+
+bool
+WindGrid::sample(float lat, float lon, float alt, time_t time, float *u, float *v) const
+{
+	TimeIndex t;
+
+	return timeIndex(time, &t) && sample(t, lat, lon, alt, u, v);
+}
+
+bool
+WindGrid::timeIndex(time_t time, TimeIndex *dst) const
+{
+	const Header *h = m_header;
+	int64_t dt;
+	int bin;
+
+	dt = (int64_t)time - m_times[0];
+	if (dt < -WIND_TIME_MARGIN || dt > m_times[h->ntime - 1] - m_times[0] + WIND_TIME_MARGIN) return false;
+	bin = std::min(std::max((int)(dt / WIND_TIME_STEP), 0), (int)m_timeIndex.size() - 1);
+	dst->t0 = m_timeIndex[bin];
+	if (dst->t0 + 1 < h->ntime && time >= m_times[dst->t0 + 1]) dst->t0++;
+	dst->t1 = std::min(dst->t0 + 1, h->ntime - 1);
+	dst->ft = dst->t1 == dst->t0 ? 0 : std::min(std::max((float)(time - m_times[dst->t0]) / (m_times[dst->t1] - m_times[dst->t0]), 0.0f), 1.0f);
+	return true;
+}
+
+bool
+WindGrid::sample(const TimeIndex &time, float lat, float lon, float alt, float *u, float *v) const
+{
+	const Header *h = m_header;
+	const int t0 = time.t0, t1 = time.t1;
+	const float ft = time.ft;
+	float fi, fj, fl, lu[2], lv[2];
+	int i0, i1, j0, j1, l0, l1, bin;
+
+	/* Horizontal position, wrapping around in longitude */
+	fi = fmodf(lon - h->lon0, 360.0f) / h->dlon;
+	if (fi < 0) fi += 360.0f / fabsf(h->dlon);
+	fj = (lat - h->lat0) / h->dlat;
+	if (fj < 0 || fj > h->nj - 1) return false;
+	if (!m_global && fi > h->ni - 1) return false;
+
+	i0 = std::min((int)fi, h->ni - 1);
+	i1 = m_global ? (i0 + 1) % h->ni : std::min(i0 + 1, h->ni - 1);
+	j0 = (int)fj;
+	j1 = std::min(j0 + 1, h->nj - 1);
+	fi -= i0;
+	fj -= j0;
+
+	/* Vertical position: the table gives the level just below the altitude bin,
+	 * at most one more level can be crossed within the bin */
+	bin = std::min(std::max((int)(alt * (1.0f / WIND_ALT_STEP)), 0), (int)m_altIndex.size() - 1);
+	l0 = m_altIndex[bin];
+	if (l0 + 1 < h->nlev && alt >= m_levelAlt[l0 + 1]) l0++;
+	l1 = std::min(l0 + 1, h->nlev - 1);
+	fl = l1 == l0 ? 0 : std::min(std::max((alt - m_levelAlt[l0]) / (m_levelAlt[l1] - m_levelAlt[l0]), 0.0f), 1.0f);
+
+	for (int k=0; k<2; k++) {
+		const int t = k ? t1 : t0;
+		const float a = bilinear(layer(m_u, t, l0), h->ni, i0, i1, j0, j1, fi, fj);
+		const float b = bilinear(layer(m_u, t, l1), h->ni, i0, i1, j0, j1, fi, fj);
+		const float c = bilinear(layer(m_v, t, l0), h->ni, i0, i1, j0, j1, fi, fj);
+		const float d = bilinear(layer(m_v, t, l1), h->ni, i0, i1, j0, j1, fi, fj);
+		lu[k] = a + fl * (b - a);
+		lv[k] = c + fl * (d - c);
+	}
+
+	*u = lu[0] + ft * (lu[1] - lu[0]);
+	*v = lv[0] + ft * (lv[1] - lv[0]);
+
+	/* Missing data anywhere in the neighborhood propagates as NaN */
+	return !isnan(*u) && !isnan(*v);
+}
+
+size_t
+WindGrid::dataOffset(int nlev, int ntime, int nsources)
+{
+	const size_t offset = sourcesOffset(nlev, ntime) + nsources * sizeof(Source);
+	return (offset + DATA_ALIGN - 1) / DATA_ALIGN * DATA_ALIGN;
+}
+
+size_t
+WindGrid::fileSize(int ni, int nj, int nlev, int ntime, int nsources)
+{
+	return dataOffset(nlev, ntime, nsources) + 2 * sizeof(float) * ni * nj * nlev * ntime;
+}
+
+bool
+WindGrid::buildIndex()
+{
+	const Header *h = m_header;
+	int k;
+
+	m_global = fabs(fabs(h->dlon) * h->ni - 360.0) < 1e-3;
+
+	for (int i=0; i<h->nlev; i++) {
+		if (m_levels[i] <= 0 || (i && m_levels[i] >= m_levels[i-1])) return false;
+		m_levelAlt.push_back(isa_altitude(m_levels[i]));
+	}
+	for (int i=1; i<h->ntime; i++) {
+		if (m_times[i] <= m_times[i-1]) return false;
+	}
+
+	k = 0;
+	m_altIndex.resize((size_t)(WIND_ALT_MAX / WIND_ALT_STEP) + 1);
+	for (size_t i=0; i<m_altIndex.size(); i++) {
+		while (k + 1 < h->nlev && m_levelAlt[k + 1] <= i * WIND_ALT_STEP) k++;
+		m_altIndex[i] = k;
+	}
+
+	k = 0;
+	m_timeIndex.resize((m_times[h->ntime - 1] - m_times[0]) / WIND_TIME_STEP + 1);
+	for (size_t i=0; i<m_timeIndex.size(); i++) {
+		while (k + 1 < h->ntime && m_times[k + 1] <= m_times[0] + (int64_t)i * WIND_TIME_STEP) k++;
+		m_timeIndex[i] = k;
+	}
+
+	return true;
+}
+/* }}} */
+
+/* WindField {{{ */
+WindField::WindField()
+{
+	m_running = false;
+	m_dirty = false;
+	m_status = "Disabled";
+}
+
+WindField::~WindField()
+{
+	if (m_running) {
+		{
+			std::lock_guard<std::mutex> lck(m_mtx);
+			m_running = false;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+}
+
+void
+WindField::setDirectory(const std::string &dir)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_dir = dir;
+		m_dirty = true;
+		if (!m_running) {
+			m_running = true;
+			m_thread = std::thread(&WindField::worker, this);
+		}
+	}
+	m_cv.notify_all();
+}
+
+void
+WindField::reload()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_dirty = true;
+	}
+	m_cv.notify_all();
+}
+
+std::string
+WindField::status()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_status;
+}
+
+/* Private methods {{{ */
+void
+WindField::worker()
+{
+	std::string dir;
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	while (m_running) {
+		m_cv.wait_for(lck, std::chrono::seconds(WIND_RESCAN_INTERVAL), [this]{ return !m_running || m_dirty; });
+		if (!m_running) break;
+		m_dirty = false;
+		dir = m_dir;
+
+		lck.unlock();
+		rescan(dir);
+		m_domain.reclaim();
+		lck.lock();
+	}
+}
+
+void
+WindField::rescan(const std::string &dir)
+{
+	const std::string cachePath = (fs::path(dir) / WIND_CACHE_NAME).string();
+	const std::string tmpPath = cachePath + ".tmp";
+	std::vector<std::pair<std::string, WindGrid::Source>> listing, toDecode;
+	std::vector<std::vector<GribField>> decoded;
+	std::map<long, int> levelIdx;
+	std::map<int64_t, int> timeIdx;
+	std::vector<double> levels;
+	std::vector<int64_t> times;
+	const WindGrid *base;
+	WindGrid *loaded = NULL, *grid;
+	GribGrid geometry;
+	MappedFile out;
+	bool full, haveGeometry;
+	size_t size;
+	std::error_code err;
+	char status[128];
+	int skipped;
+
+	if (dir.empty()) {
+		m_grid.publish(NULL);
+		m_gridDir.clear();
+		setStatus("Disabled");
+		return;
+	}
+
+	/* List the forecast files, sorted by name so that later runs override earlier ones */
+	for (fs::directory_iterator it(fs::u8path(dir), err), end; !err && it != end; it.increment(err)) {
+		WindGrid::Source info;
+		const std::string name = it->path().filename().string();
+
+		if (!it->is_regular_file(err) || !is_grib_file(it->path()) || name.size() >= sizeof(info.name)) continue;
+
+		memset(&info, 0, sizeof(info));
+		strcpy(info.name, name.c_str());
+		info.size = it->file_size(err);
+		info.mtime = it->last_write_time(err).time_since_epoch().count();
+		listing.push_back(std::make_pair(it->path().string(), info));
+	}
+	if (err) {
+		setStatus("Cannot read " + dir);
+		return;
+	}
+	std::sort(listing.begin(), listing.end(), [](const std::pair<std::string, WindGrid::Source> &a, const std::pair<std::string, WindGrid::Source> &b) {
+		return strcmp(a.second.name, b.second.name) < 0;
+	});
+
+	/* Start from the published grid, or from the cache left by a previous session */
+	base = m_gridDir == dir ? m_grid.get() : NULL;
+	if (!base) base = loaded = WindGrid::open(cachePath.c_str());
+
+	/* Any source that changed or disappeared invalidates the whole cache */
+	full = !base;
+	if (base) {
+		const std::vector<WindGrid::Source> sources = base->sources();
+		for (const WindGrid::Source &src : sources) {
+			const auto match = std::find_if(listing.begin(), listing.end(), [&src](const std::pair<std::string, WindGrid::Source> &f) {
+				return !strcmp(f.second.name, src.name) && f.second.mtime == src.mtime && f.second.size == src.size;
+			});
+			if (match == listing.end()) full = true;
+		}
+		for (const auto &f : listing) {
+			const auto match = std::find_if(sources.begin(), sources.end(), [&f](const WindGrid::Source &src) {
+				return !strcmp(f.second.name, src.name);
+			});
+			if (full || match == sources.end()) toDecode.push_back(f);
+		}
+	} else {
+		toDecode = listing;
+	}
+
+	if (full) {
+		delete loaded;
+		base = loaded = NULL;
+	}
+
+	if (toDecode.empty()) {
+		if (loaded) {
+			m_grid.publish(loaded);
+			m_gridDir = dir;
+		} else if (!base) {
+			m_grid.publish(NULL);
+			m_gridDir = dir;
+			setStatus("No forecast files");
+			return;
+		}
+		grid = m_grid.get();
+		snprintf(status, sizeof(status), "%d files, %dx%d, %d levels, %d steps",
+		         (int)listing.size(), grid->ni(), grid->nj(), grid->levels(), grid->times());
+		setStatus(status);
+		return;
+	}
+
+	setStatus("Decoding " + std::to_string(toDecode.size()) + " files...");
+
+	/* Decode the new files in parallel, each one is independent */
+	decoded.resize(toDecode.size());
+	radiosonde::ThreadPool::shared().parallelFor(toDecode.size(), 1, [&toDecode, &decoded](int begin, int end) {
+		for (int i=begin; i<end; i++) {
+			MappedFile file;
+			if (!file.open(toDecode[i].first.c_str())) continue;
+			grib2_decode((const uint8_t*)file.data(), file.size(), is_wind_field, &decoded[i]);
+		}
+	}, radiosonde::TASK_BACKGROUND);
+
+	/* All the fields must share the same grid as the existing cache */
+	haveGeometry = base != NULL;
+	if (base) {
+		geometry.ni = base->m_header->ni;
+		geometry.nj = base->m_header->nj;
+		geometry.lat0 = base->m_header->lat0;
+		geometry.lon0 = base->m_header->lon0;
+		geometry.dlat = base->m_header->dlat;
+		geometry.dlon = base->m_header->dlon;
+		for (int i=0; i<base->levels(); i++) levelIdx[lround(base->m_levels[i])] = 0;
+		for (int i=0; i<base->times(); i++) timeIdx[base->m_times[i]] = 0;
+	}
+
+	skipped = 0;
+	for (auto &fields : decoded) {
+		for (GribField &field : fields) {
+			if (!haveGeometry) {
+				geometry = field.grid;
+				haveGeometry = true;
+			}
+			if (!(field.grid == geometry) || field.level <= 0) {
+				field.values.clear();
+				skipped++;
+				continue;
+			}
+			levelIdx[lround(field.level)] = 0;
+			timeIdx[field.validTime] = 0;
+		}
+	}
+
+	if (!haveGeometry || levelIdx.empty() || timeIdx.empty()) {
+		delete loaded;
+		setStatus("No usable wind fields");
+		return;
+	}
+
+	/* Levels sorted by decreasing pressure, i.e. increasing altitude */
+	for (auto it = levelIdx.rbegin(); it != levelIdx.rend(); it++) {
+		it->second = levels.size();
+		levels.push_back(it->first);
+	}
+	for (auto &it : timeIdx) {
+		it.second = times.size();
+		times.push_back(it.first);
+	}
+
+	size = WindGrid::fileSize(geometry.ni, geometry.nj, levels.size(), times.size(), listing.size());
+	if (size > WIND_CACHE_MAX_SIZE) {
+		delete loaded;
+		setStatus("Forecast too large, crop it to a smaller region");
+		return;
+	}
+
+	if (!out.create(tmpPath.c_str(), size)) {
+		delete loaded;
+		setStatus("Cannot write " + tmpPath);
+		return;
+	}
+
+	/* Header and index */
+	{
+		uint8_t *ptr = (uint8_t*)out.data();
+		WindGrid::Header *header = (WindGrid::Header*)ptr;
+		float *u, *v;
+		size_t layerSize = (size_t)geometry.ni * geometry.nj;
+
+		memset(header, 0, sizeof(*header));
+		memcpy(header->magic, WIND_CACHE_MAGIC, sizeof(header->magic));
+		header->ni = geometry.ni;
+		header->nj = geometry.nj;
+		header->nlev = levels.size();
+		header->ntime = times.size();
+		header->nsources = listing.size();
+		header->lat0 = geometry.lat0;
+		header->lon0 = geometry.lon0;
+		header->dlat = geometry.dlat;
+		header->dlon = geometry.dlon;
+
+		memcpy(ptr + WindGrid::levelsOffset(), levels.data(), levels.size() * sizeof(double));
+		memcpy(ptr + WindGrid::timesOffset(levels.size()), times.data(), times.size() * sizeof(int64_t));
+		for (size_t i=0; i<listing.size(); i++) {
+			memcpy(ptr + WindGrid::sourcesOffset(levels.size(), times.size()) + i * sizeof(WindGrid::Source),
+			       &listing[i].second, sizeof(WindGrid::Source));
+		}
+
+		u = (float*)(ptr + WindGrid::dataOffset(levels.size(), times.size(), listing.size()));
+		v = u + layerSize * levels.size() * times.size();
+		std::fill(u, v + layerSize * levels.size() * times.size(), NAN);
+
+		/* Carry over the layers already in the cache, then add the new ones */
+		if (base) {
+			for (int t=0; t<base->times(); t++) {
+				for (int l=0; l<base->levels(); l++) {
+					const size_t dst = ((size_t)timeIdx[base->m_times[t]] * levels.size() + levelIdx[lround(base->m_levels[l])]) * layerSize;
+					memcpy(u + dst, base->layer(base->m_u, t, l), layerSize * sizeof(float));
+					memcpy(v + dst, base->layer(base->m_v, t, l), layerSize * sizeof(float));
+				}
+			}
+		}
+
+		for (const auto &fields : decoded) {
+			for (const GribField &field : fields) {
+				if (field.values.empty()) continue;
+				const size_t dst = ((size_t)timeIdx[field.validTime] * levels.size() + levelIdx[lround(field.level)]) * layerSize;
+				memcpy((field.number == GRIB_PARAM_UGRD ? u : v) + dst, field.values.data(), layerSize * sizeof(float));
+			}
+		}
+	}
+
+	out.sync(false);
+	out.close();
+	delete loaded;
+
+	/* Readers may still be using the old mapping; on POSIX the rename is safe
+	 * regardless, elsewhere fall back to using the temporary file directly */
+	fs::rename(fs::u8path(tmpPath), fs::u8path(cachePath), err);
+	grid = WindGrid::open(err ? tmpPath.c_str() : cachePath.c_str());
+	if (!grid) {
+		setStatus("Cannot map " + cachePath);
+		return;
+	}
+
+	m_grid.publish(grid);
+	m_gridDir = dir;
+
+	if (skipped) {
+		snprintf(status, sizeof(status), "%d files, %dx%d, %d levels, %d steps (%d fields on other grids skipped)",
+		         (int)listing.size(), grid->ni(), grid->nj(), grid->levels(), grid->times(), skipped);
+	} else {
+		snprintf(status, sizeof(status), "%d files, %dx%d, %d levels, %d steps",
+		         (int)listing.size(), grid->ni(), grid->nj(), grid->levels(), grid->times());
+	}
+	setStatus(status);
+}
+
+void
+WindField::setStatus(const std::string &status)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_status = status;
+}
+/* }}} */
+/* }}} */
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "epoch.hpp"
+#include "mmap.hpp"
+
+#define WIND_CACHE_NAME ".radiosonde_wind.cache"
+#define WIND_RESCAN_INTERVAL 60     /* Seconds between two scans of the forecast directory */
+
+/**
+ * Immutable 4D wind grid (time, pressure level, latitude, longitude), backed by
+ * a memory-mapped cache file containing the pre-decoded forecast fields. All
+ * lookups are O(1): lat/lon are on a regular grid, and altitude and time go
+ * through precomputed index tables.
+ */
+class WindGrid {
+public:
+	struct Source {
+		char name[256];
+		int64_t mtime;
+		int64_t size;
+	};
+
+	/* Time steps around a given time, see timeIndex() */
+	struct TimeIndex {
+		int t0, t1;
+		float ft;
+	};
+
+	~WindGrid() {};
+
+	/**
+	 * Map a cache file.
+	 *
+	 * @param fname path to the cache file
+	 * @return new grid, or NULL if the file is missing or invalid
+	 */
+	static WindGrid *open(const char *fname);
+
+	/**
+	 * Interpolate the wind at a given point in space and time.
+	 *
+	 * @param lat latitude, degrees
+	 * @param lon longitude, degrees
+	 * @param alt altitude, meters. Converted to pressure using the standard atmosphere
+	 * @param time UTC time
+	 * @param u destination for the eastward component, m/s
+	 * @param v destination for the northward component, m/s
+	 * @return true on success, false if the point is not covered by the grid
+	 */
+	bool sample(float lat, float lon, float alt, time_t time, float *u, float *v) const;
+
+	/**
+	 * Split of sample() for many points at the same time: find the time steps
+	 * once, then interpolate each point in space.
+	 *
+	 * @param time UTC time
+	 * @param dst destination for the time steps
+	 * @return true on success, false if the time is not covered by the grid
+	 */
+	bool timeIndex(time_t time, TimeIndex *dst) const;
+	bool sample(const TimeIndex &time, float lat, float lon, float alt, float *u, float *v) const;
+
+	/* Geometry */
+	int ni() const { return m_header->ni; }
+	int nj() const { return m_header->nj; }
+	int levels() const { return m_header->nlev; }
+	int times() const { return m_header->ntime; }
+	time_t time(int idx) const { return m_times[idx]; }
+	const std::vector<Source> sources() const { return std::vector<Source>(m_sources, m_sources + m_header->nsources); }
+
+private:
+	friend class WindField;
+
+	struct Header {
+		char magic[8];
+		int32_t ni, nj, nlev, ntime, nsources;
+		int32_t reserved;
+		double lat0, lon0, dlat, dlon;
+	};
+
+	/* Layout of the cache file, with the given dimensions */
+	static size_t levelsOffset() { return sizeof(Header); }
+	static size_t timesOffset(int nlev) { return levelsOffset() + nlev * sizeof(double); }
+	static size_t sourcesOffset(int nlev, int ntime) { return timesOffset(nlev) + ntime * sizeof(int64_t); }
+	static size_t dataOffset(int nlev, int ntime, int nsources);
+	static size_t fileSize(int ni, int nj, int nlev, int ntime, int nsources);
+
+	WindGrid() {};
+	bool buildIndex();
+	float *layer(float *base, int t, int l) const { return base + ((size_t)t * m_header->nlev + l) * m_layerSize; }
+
+	MappedFile m_file;
+	const Header *m_header;
+	const double *m_levels;     /* Pa, decreasing: index increases with altitude */
+	const int64_t *m_times;
+	const Source *m_sources;
+	float *m_u, *m_v;
+	size_t m_layerSize;
+
+	std::vector<float> m_levelAlt;      /* Standard atmosphere altitude of each level */
+	std::vector<uint16_t> m_altIndex;   /* Altitude bin -> level below */
+	std::vector<uint16_t> m_timeIndex;  /* Hour since the first time -> time step before */
+	bool m_global;
+};
+
+/**
+ * Wind forecast cache. Watches a directory for GRIB2 files, decodes the U/V
+ * wind components on isobaric levels, and publishes them as a WindGrid. New
+ * files are decoded incrementally and merged into the existing cache; the cache
+ * file survives restarts, so already decoded forecasts are just mapped again.
+ *
+ * Readers must hold a guard on domain() while using the grid returned by grid().
+ */
+class WindField {
+public:
+	WindField();
+	~WindField();
+
+	/**
+	 * Start watching a directory. An empty path disables forecasts.
+	 *
+	 * @param dir directory containing GRIB2 files
+	 */
+	void setDirectory(const std::string &dir);
+
+	/**
+	 * Rescan the directory as soon as possible.
+	 */
+	void reload();
+
+	radiosonde::EpochDomain &domain() { return m_domain; }
+	const WindGrid *grid() const { return m_grid.get(); }
+
+	/**
+	 * Get a human-readable description of the cache state.
+	 */
+	std::string status();
+
+private:
+	void worker();
+	void rescan(const std::string &dir);
+	void setStatus(const std::string &status);
+
+	radiosonde::EpochDomain m_domain;
+	radiosonde::Published<WindGrid> m_grid{m_domain};
+
+	std::thread m_thread;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::string m_dir, m_status;
+	bool m_running, m_dirty;
+
+	/* Only touched by the worker thread */
+	std::string m_gridDir;
+};
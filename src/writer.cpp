@@ -0,0 +1,106 @@
+#include <chrono>
+#include "writer.hpp"
+
+#define IDLE_TIMEOUT_MS 200
+
+namespace radiosonde {
+	AsyncWriter::AsyncWriter()
+		: m_queue(WRITER_QUEUE_SIZE)
+	{
+		m_running = false;
+		m_handler = NULL;
+		m_ctx = NULL;
+		m_written = m_dropped = 0;
+		m_maxBacklog = 0;
+		m_maxWriteSeconds = 0;
+	}
+
+	AsyncWriter::~AsyncWriter()
+	{
+		stop();
+	}
+
+	void
+	AsyncWriter::start(void (*handler)(const SondeFullData *data, void *ctx), void *ctx)
+	{
+		if (m_running) return;
+		m_handler = handler;
+		m_ctx = ctx;
+		m_running = true;
+		m_thread = std::thread(&AsyncWriter::worker, this);
+	}
+
+	void
+	AsyncWriter::stop()
+	{
+		if (!m_running) return;
+		{
+			std::lock_guard<std::mutex> lck(m_mtx);
+			m_running = false;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	bool
+	AsyncWriter::push(const SondeFullData &data)
+	{
+		size_t backlog;
+
+		if (!m_queue.push(data)) {
+			m_dropped++;
+			return false;
+		}
+
+		/* Only the producer updates the high-water mark, no need for a CAS loop */
+		backlog = m_queue.size();
+		if (backlog > m_maxBacklog.load(std::memory_order_relaxed)) m_maxBacklog = backlog;
+
+		/* No lock here: the worker polls the queue if it misses the notification */
+		m_cv.notify_one();
+		return true;
+	}
+
+	AsyncWriter::Stats
+	AsyncWriter::stats() const
+	{
+		Stats stats;
+
+		stats.written = m_written;
+		stats.dropped = m_dropped;
+		stats.maxBacklog = m_maxBacklog;
+		stats.maxWriteSeconds = m_maxWriteSeconds;
+		return stats;
+	}
+
+	/* Private methods {{{ */
+	void
+	AsyncWriter::worker()
+	{
+		typedef std::chrono::steady_clock clock;
+		SondeFullData data;
+		bool running = true;
+
+		while (running) {
+			{
+				std::unique_lock<std::mutex> lck(m_mtx);
+				m_cv.wait_for(lck, std::chrono::milliseconds(IDLE_TIMEOUT_MS),
+				              [this]{ return !m_running || m_queue.size() > 0; });
+				running = m_running;
+			}
+
+			/* Frames queued before stop() are still written */
+			while (m_queue.pop(&data)) {
+				const clock::time_point start = clock::now();
+				double seconds;
+
+				m_handler(&data, m_ctx);
+				m_written++;
+
+				seconds = std::chrono::duration<double>(clock::now() - start).count();
+				if (seconds > m_maxWriteSeconds.load(std::memory_order_relaxed)) m_maxWriteSeconds = seconds;
+			}
+		}
+	}
+	/* }}} */
+}
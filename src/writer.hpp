@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include "decode/common.hpp"
+#include "spsc.hpp"
+
+#define WRITER_QUEUE_SIZE 64        /* Frames buffered while the outputs are stalled */
+
+namespace radiosonde {
+	/**
+	 * Moves the outputs (files, network) off the DSP thread. Frames are copied
+	 * into a bounded queue, and handed over in order to a callback running on a
+	 * dedicated thread. A slow disk or network can then only delay the outputs:
+	 * if they stall for longer than the queue lasts, new frames are dropped and
+	 * counted, and the decoder never waits.
+	 */
+	class AsyncWriter {
+	public:
+		struct Stats {
+			uint64_t written;
+			uint64_t dropped;           /* Frames lost because the queue was full */
+			size_t maxBacklog;          /* Most frames ever waiting in the queue */
+			double maxWriteSeconds;     /* Longest time spent in the callback for a single frame */
+		};
+
+		AsyncWriter();
+		~AsyncWriter();
+
+		/**
+		 * Start the writer thread.
+		 *
+		 * @param handler function called on the writer thread for every frame
+		 * @param ctx context passed to the handler
+		 */
+		void start(void (*handler)(const SondeFullData *data, void *ctx), void *ctx);
+
+		/**
+		 * Stop the writer thread, once the frames still queued have been handled.
+		 */
+		void stop();
+
+		/**
+		 * Queue a frame. Meant to be called from the DSP thread: never blocks.
+		 *
+		 * @param data decoded frame
+		 * @return true if the frame was queued, false if it was dropped
+		 */
+		bool push(const SondeFullData &data);
+
+		Stats stats() const;
+
+		/* Bytes held by the queue */
+		size_t memoryUsage() const { return m_queue.capacity() * sizeof(SondeFullData); }
+
+	private:
+		void worker();
+
+		std::thread m_thread;
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		bool m_running;
+
+		void (*m_handler)(const SondeFullData *data, void *ctx);
+		void *m_ctx;
+		SpscQueue<SondeFullData> m_queue;
+
+		std::atomic<uint64_t> m_written, m_dropped;
+		std::atomic<size_t> m_maxBacklog;
+		std::atomic<double> m_maxWriteSeconds;
+	};
+}
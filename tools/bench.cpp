@@ -0,0 +1,590 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include "capture.hpp"
+#include "decode/sondetypes.hpp"
+#include "fir.hpp"
+#include "perf.hpp"
+#include "spsc.hpp"
+#include "writer.hpp"
+
+#define DEFAULT_SAMPLERATE 48000
+#define BUFFERS_PER_SEC 100
+#define FILTER_BENCH_SECONDS 10     /* Signal length used to benchmark each filter */
+#define FAULT_INPUT_BUFFERS 4       /* Buffers the source holds before dropping samples */
+#define FAULT_SINKS 3               /* GPX, PTU and network stand-ins */
+
+using namespace radiosonde;
+
+struct BenchResult {
+	const char *fname;
+	size_t samples;
+	int samplerate;
+	unsigned long frames;
+	double wallSeconds;
+	double maxBufferSeconds;
+	PerfStage::Snapshot perf;
+	bool perfAvailable;
+};
+
+/* Misbehaviour of the stand-in sinks, see parseFaults() */
+struct FaultSpec {
+	std::string text;
+	double latencyMs;           /* Added to every write */
+	double spikeMs;             /* Stall every spikeEvery writes */
+	int spikeEvery;
+	double errorRate;           /* Fraction of writes that fail */
+	size_t fullBytes;           /* Writes fail once this much has been written, 0 for never */
+	double budgetMs;            /* Maximum delay between a buffer's arrival and the end of its decoding */
+	double speed;               /* Replay speed, relative to real time */
+	bool inlineSinks;           /* Call the sinks from the decoder thread, without AsyncWriter */
+};
+
+/* Stand-in for one output: renders frames like PTUWriter, then misbehaves */
+struct FaultySink {
+	const FaultSpec *spec;
+	std::mt19937 rng;
+	size_t bytes;
+	unsigned long writes, errors, full;
+};
+
+struct FaultResult {
+	const char *fname;
+	size_t buffers, samplesDropped;
+	unsigned long framesExpected, framesDecoded;
+	double maxBufferSeconds;
+	unsigned long sinkErrors, sinkFull;
+	AsyncWriter::Stats writer;
+	bool passed;
+};
+
+static void usage(const char *progname);
+static bool bench(const SondeType *type, const Capture &capture, int blockSize, bool perf, BenchResult *result);
+static void printResult(FILE *fd, const SondeType *type, const BenchResult &result, bool last);
+static void printString(FILE *fd, const char *str);
+static void benchFilters(FILE *fd, int samplerate, int blockSize);
+static bool parseFaults(const char *str, FaultSpec *dst);
+static unsigned long countFrames(const SondeType *type, const Capture &capture, int blockSize);
+static bool faultTest(const SondeType *type, const Capture &capture, int blockSize, const FaultSpec &faults, FaultResult *result);
+static void printFaultResult(FILE *fd, const SondeType *type, const FaultSpec &faults, const FaultResult &result, bool last);
+static void faultyWrite(const SondeFullData *data, void *ctx);
+
+int
+main(int argc, char *argv[])
+{
+	const SondeType *type = NULL;
+	int blockSize = 0, rawSamplerate = DEFAULT_SAMPLERATE;
+	const char *outFname = NULL;
+	bool perf = false, filters = false, faultMode = false, passed = true;
+	FaultSpec faults;
+	std::vector<BenchResult> results;
+	std::vector<FaultResult> faultResults;
+	FILE *out = stdout;
+	int i;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-p")) {
+			perf = true;
+		} else if (!strcmp(argv[i], "-F")) {
+			filters = true;
+		} else if (i+1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		} else if (!strcmp(argv[i], "-t")) {
+			if (!(type = findSondeType(argv[++i]))) {
+				fprintf(stderr, "Unknown sonde type: %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-b")) {
+			blockSize = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-r")) {
+			rawSamplerate = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-o")) {
+			outFname = argv[++i];
+		} else if (!strcmp(argv[i], "-S")) {
+			if (!parseFaults(argv[++i], &faults)) {
+				fprintf(stderr, "Invalid fault specification: %s\n", argv[i]);
+				return 1;
+			}
+			faultMode = true;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (filters) {
+		if (outFname && !(out = fopen(outFname, "w"))) {
+			fprintf(stderr, "Could not open %s for writing\n", outFname);
+			return 1;
+		}
+		benchFilters(out, rawSamplerate, blockSize ? blockSize : rawSamplerate / BUFFERS_PER_SEC);
+		if (out != stdout) fclose(out);
+		return 0;
+	}
+
+	if (!type || i >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (; i<argc; i++) {
+		Capture capture;
+		BenchResult result;
+
+		if (!capture.load(argv[i], rawSamplerate, 1)) {
+			fprintf(stderr, "Could not load %s\n", argv[i]);
+			return 1;
+		}
+		if (capture.isBaseband()) {
+			fprintf(stderr, "%s: expected FM demodulated audio, got I/Q baseband\n", argv[i]);
+			return 1;
+		}
+
+		if (faultMode) {
+			FaultResult faultResult;
+
+			faultResult.fname = argv[i];
+			if (!faultTest(type, capture, blockSize ? blockSize : capture.samplerate / BUFFERS_PER_SEC, faults, &faultResult)) {
+				fprintf(stderr, "Failed to run %s\n", argv[i]);
+				return 1;
+			}
+			passed = passed && faultResult.passed;
+			faultResults.push_back(faultResult);
+			continue;
+		}
+
+		result.fname = argv[i];
+		if (!bench(type, capture, blockSize ? blockSize : capture.samplerate / BUFFERS_PER_SEC, perf, &result)) {
+			fprintf(stderr, "Failed to benchmark %s\n", argv[i]);
+			return 1;
+		}
+		results.push_back(result);
+	}
+
+	if (outFname && !(out = fopen(outFname, "w"))) {
+		fprintf(stderr, "Could not open %s for writing\n", outFname);
+		return 1;
+	}
+
+	fprintf(out, "[\n");
+	for (size_t j=0; j<results.size(); j++) {
+		printResult(out, type, results[j], j == results.size() - 1);
+	}
+	for (size_t j=0; j<faultResults.size(); j++) {
+		printFaultResult(out, type, faults, faultResults[j], j == faultResults.size() - 1);
+	}
+	fprintf(out, "]\n");
+
+	if (out != stdout) fclose(out);
+	return passed ? 0 : 2;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s -t <type> [options] <capture>...\n", progname);
+	fprintf(stderr, "       %s -F [-r <rate>] [-b <n>] [-o <file>]\n", progname);
+	fprintf(stderr, "\t-t <type>    Sonde type:");
+	for (const SondeType &type : sondeTypes) fprintf(stderr, " %s", type.key);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "\t-b <n>       Samples per buffer (default: 10ms worth)\n");
+	fprintf(stderr, "\t-r <rate>    Sample rate of raw captures (default: %d)\n", DEFAULT_SAMPLERATE);
+	fprintf(stderr, "\t-o <file>    Write the JSON report to file (default: stdout)\n");
+	fprintf(stderr, "\t-p           Sample hardware performance counters\n");
+	fprintf(stderr, "\t-F           Compare direct and FFT filtering over a range of tap counts\n");
+	fprintf(stderr, "\t-S <faults>  Decode in real time while the outputs misbehave, and check that no\n");
+	fprintf(stderr, "\t             samples are lost. Comma separated list of:\n");
+	fprintf(stderr, "\t               latency=<ms>       delay every write\n");
+	fprintf(stderr, "\t               spike=<ms>/<n>     stall every n-th write\n");
+	fprintf(stderr, "\t               error=<fraction>   fail this fraction of writes\n");
+	fprintf(stderr, "\t               full=<bytes>       fail every write past this size (disk full)\n");
+	fprintf(stderr, "\t               budget=<ms>        maximum buffer latency (default: one buffer)\n");
+	fprintf(stderr, "\t               speed=<x>          replay faster than real time (default: 1)\n");
+	fprintf(stderr, "\t               inline             write from the decoder thread, without a writer thread\n");
+	fprintf(stderr, "\t             Exits with status 2 if the check fails\n");
+}
+
+static bool
+bench(const SondeType *type, const Capture &capture, int blockSize, bool perf, BenchResult *result)
+{
+	typedef std::chrono::steady_clock clock;
+	PerfCounters counters;
+	PerfStage stage("decoder");
+	PerfSample before, after, delta;
+	SondeData fragment;
+	int lastSeq = -1;
+	void *decoder;
+
+	if (blockSize <= 0) return false;
+	if (!(decoder = type->init(capture.samplerate))) return false;
+
+	result->samples = capture.length();
+	result->samplerate = capture.samplerate;
+	result->frames = 0;
+	result->maxBufferSeconds = 0;
+	result->perfAvailable = perf && counters.open();
+
+	const clock::time_point start = clock::now();
+	for (size_t offset = 0; offset < capture.length(); offset += blockSize) {
+		const size_t len = std::min((size_t)blockSize, capture.length() - offset);
+		const float *src = capture.samples.data() + offset;
+		const clock::time_point bufStart = clock::now();
+
+		if (result->perfAvailable) counters.read(&before);
+
+		/* Same calling convention as radiosonde::Decoder::run() */
+		while (type->decode(decoder, &fragment, src, len) != PROCEED) {
+			if ((fragment.fields & DATA_SEQ) && fragment.seq != lastSeq) {
+				lastSeq = fragment.seq;
+				result->frames++;
+			}
+		}
+
+		if (result->perfAvailable && counters.read(&after)) {
+			for (int i=0; i<PERF_EVENT_COUNT; i++) {
+				delta.counts[i] = after.counts[i] - before.counts[i];
+			}
+			stage.add(delta, len);
+		}
+
+		result->maxBufferSeconds = std::max(result->maxBufferSeconds,
+		                                    std::chrono::duration<double>(clock::now() - bufStart).count());
+	}
+	result->wallSeconds = std::chrono::duration<double>(clock::now() - start).count();
+	result->perf = stage.snapshot();
+
+	type->deinit(decoder);
+	return true;
+}
+
+static void
+printResult(FILE *fd, const SondeType *type, const BenchResult &result, bool last)
+{
+	const double signalSeconds = (double)result.samples / result.samplerate;
+
+	fprintf(fd, "\t{\n");
+	fprintf(fd, "\t\t\"file\": ");
+	printString(fd, result.fname);
+	fprintf(fd, ",\n\t\t\"type\": \"%s\",\n", type->name);
+	fprintf(fd, "\t\t\"samplerate\": %d,\n", result.samplerate);
+	fprintf(fd, "\t\t\"samples\": %zu,\n", result.samples);
+	fprintf(fd, "\t\t\"frames\": %lu,\n", result.frames);
+	fprintf(fd, "\t\t\"wall_seconds\": %.6f,\n", result.wallSeconds);
+	fprintf(fd, "\t\t\"realtime_factor\": %.1f,\n", result.wallSeconds > 0 ? signalSeconds / result.wallSeconds : 0);
+	fprintf(fd, "\t\t\"ns_per_sample\": %.2f,\n", result.samples ? 1e9 * result.wallSeconds / result.samples : 0);
+	fprintf(fd, "\t\t\"max_buffer_latency_ms\": %.3f", 1e3 * result.maxBufferSeconds);
+
+	if (result.perfAvailable) {
+		fprintf(fd, ",\n\t\t\"stages\": {\n");
+		fprintf(fd, "\t\t\t\"decoder\": {\n");
+		fprintf(fd, "\t\t\t\t\"cycles\": %llu,\n", (unsigned long long)result.perf.counts[PERF_CYCLES]);
+		fprintf(fd, "\t\t\t\t\"instructions\": %llu,\n", (unsigned long long)result.perf.counts[PERF_INSTRUCTIONS]);
+		fprintf(fd, "\t\t\t\t\"cache_misses\": %llu,\n", (unsigned long long)result.perf.counts[PERF_CACHE_MISSES]);
+		fprintf(fd, "\t\t\t\t\"branch_misses\": %llu,\n", (unsigned long long)result.perf.counts[PERF_BRANCH_MISSES]);
+		fprintf(fd, "\t\t\t\t\"buffers\": %llu,\n", (unsigned long long)result.perf.buffers);
+		fprintf(fd, "\t\t\t\t\"ipc\": %.3f,\n", result.perf.ipc());
+		fprintf(fd, "\t\t\t\t\"cycles_per_sample\": %.2f,\n", result.perf.perSample(PERF_CYCLES));
+		fprintf(fd, "\t\t\t\t\"max_cycles_per_sample\": %.2f,\n", result.perf.maxCyclesPerSample);
+		fprintf(fd, "\t\t\t\t\"cache_misses_per_sample\": %.4f,\n", result.perf.perSample(PERF_CACHE_MISSES));
+		fprintf(fd, "\t\t\t\t\"branch_misses_per_sample\": %.4f\n", result.perf.perSample(PERF_BRANCH_MISSES));
+		fprintf(fd, "\t\t\t}\n");
+		fprintf(fd, "\t\t}\n");
+	} else {
+		fprintf(fd, "\n");
+	}
+	fprintf(fd, "\t}%s\n", last ? "" : ",");
+}
+
+static void
+printString(FILE *fd, const char *str)
+{
+	fputc('"', fd);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') fputc('\\', fd);
+		fputc(*str, fd);
+	}
+	fputc('"', fd);
+}
+
+/* Time both filtering methods on white noise, and check that they agree */
+static void
+benchFilters(FILE *fd, int samplerate, int blockSize)
+{
+	typedef std::chrono::steady_clock clock;
+	const size_t len = (size_t)samplerate * FILTER_BENCH_SECONDS;
+	const FirFilter::Method methods[2] = {FirFilter::FIR_DIRECT, FirFilter::FIR_OVERLAP_SAVE};
+	std::vector<float> input(len), taps, output[2];
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> dist(-1, 1);
+	bool first = true;
+
+	for (float &sample : input) sample = dist(rng);
+
+	fprintf(fd, "[\n");
+	for (int ntaps = 8; ntaps <= 4096; ntaps *= 2) {
+		double nsPerSample[2], maxError = 0;
+		int latency = 0;
+
+		taps.resize(ntaps);
+		for (float &tap : taps) tap = dist(rng) / ntaps;
+
+		for (int m=0; m<2; m++) {
+			FirFilter filter;
+			filter.setTaps(taps.data(), ntaps, methods[m]);
+			if (filter.latency()) latency = filter.latency();
+			output[m].resize(len);
+
+			const clock::time_point start = clock::now();
+			for (size_t offset = 0; offset < len; offset += blockSize) {
+				const size_t count = std::min((size_t)blockSize, len - offset);
+				filter.process(input.data() + offset, output[m].data() + offset, count);
+			}
+			nsPerSample[m] = 1e9 * std::chrono::duration<double>(clock::now() - start).count() / len;
+		}
+
+		/* Overlap-save output is delayed by one block */
+		for (size_t j=latency; j<len; j++) {
+			maxError = std::max(maxError, (double)fabsf(output[1][j] - output[0][j - latency]));
+		}
+
+		fprintf(fd, "%s\t{\n", first ? "" : ",\n");
+		fprintf(fd, "\t\t\"taps\": %d,\n", ntaps);
+		fprintf(fd, "\t\t\"direct_ns_per_sample\": %.2f,\n", nsPerSample[0]);
+		fprintf(fd, "\t\t\"fft_ns_per_sample\": %.2f,\n", nsPerSample[1]);
+		fprintf(fd, "\t\t\"fft_latency_samples\": %d,\n", latency);
+		fprintf(fd, "\t\t\"max_error\": %.3g,\n", maxError);
+		fprintf(fd, "\t\t\"auto\": \"%s\"\n", ntaps > FIR_FFT_THRESHOLD ? "fft" : "direct");
+		fprintf(fd, "\t}");
+		first = false;
+	}
+	fprintf(fd, "\n]\n");
+}
+
+/* Parse a comma separated list of key=value faults */
+static bool
+parseFaults(const char *str, FaultSpec *dst)
+{
+	std::string list = str;
+
+	dst->text = str;
+	dst->latencyMs = dst->spikeMs = 0;
+	dst->spikeEvery = 0;
+	dst->errorRate = 0;
+	dst->fullBytes = 0;
+	dst->budgetMs = 0;
+	dst->speed = 1;
+	dst->inlineSinks = false;
+
+	for (size_t start = 0, end; start < list.size(); start = end + 1) {
+		end = std::min(list.find(',', start), list.size());
+		const std::string item = list.substr(start, end - start);
+		const size_t eq = item.find('=');
+		const std::string key = item.substr(0, eq);
+		const char *value = eq == std::string::npos ? NULL : item.c_str() + eq + 1;
+
+		if (key == "inline" && !value) {
+			dst->inlineSinks = true;
+		} else if (!value) {
+			return false;
+		} else if (key == "latency") {
+			dst->latencyMs = atof(value);
+		} else if (key == "spike") {
+			if (sscanf(value, "%lf/%d", &dst->spikeMs, &dst->spikeEvery) != 2 || dst->spikeEvery <= 0) return false;
+		} else if (key == "error") {
+			dst->errorRate = atof(value);
+		} else if (key == "full") {
+			dst->fullBytes = strtoull(value, NULL, 10);
+		} else if (key == "budget") {
+			dst->budgetMs = atof(value);
+		} else if (key == "speed") {
+			if ((dst->speed = atof(value)) <= 0) return false;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Frames decoded from a capture when nothing gets in the way */
+static unsigned long
+countFrames(const SondeType *type, const Capture &capture, int blockSize)
+{
+	BenchResult result;
+
+	if (!bench(type, capture, blockSize, false, &result)) return 0;
+	return result.frames;
+}
+
+/*
+ * Replay a capture in real time through a source that, like the SDR++ streams,
+ * only holds a few buffers, while the decoder thread hands frames to stand-in
+ * sinks that misbehave as specified.
+ */
+static bool
+faultTest(const SondeType *type, const Capture &capture, int blockSize, const FaultSpec &faults, FaultResult *result)
+{
+	typedef std::chrono::steady_clock clock;
+	struct Buffer {
+		size_t offset;
+		clock::time_point arrival;
+	};
+	const clock::duration period = std::chrono::duration_cast<clock::duration>(
+		std::chrono::duration<double>((double)blockSize / capture.samplerate / faults.speed));
+	const double budget = faults.budgetMs > 0 ? 1e-3 * faults.budgetMs : (double)blockSize / capture.samplerate / faults.speed;
+	SpscQueue<Buffer> input(FAULT_INPUT_BUFFERS);
+	std::atomic<bool> sourceDone(false);
+	std::atomic<size_t> dropped(0);
+	FaultySink sinks[FAULT_SINKS];
+	AsyncWriter writer;
+	SondeFullData data;
+	SondeData fragment;
+	std::thread source;
+	Buffer buf;
+	int lastSeq = -1;
+	void *decoder;
+
+	if (blockSize <= 0) return false;
+	result->framesExpected = countFrames(type, capture, blockSize);
+	if (!(decoder = type->init(capture.samplerate))) return false;
+
+	result->buffers = 0;
+	result->framesDecoded = 0;
+	result->maxBufferSeconds = 0;
+	result->sinkErrors = result->sinkFull = 0;
+	for (int i=0; i<FAULT_SINKS; i++) {
+		sinks[i].spec = &faults;
+		sinks[i].rng.seed(i);
+		sinks[i].bytes = 0;
+		sinks[i].writes = sinks[i].errors = sinks[i].full = 0;
+	}
+	if (!faults.inlineSinks) writer.start(faultyWrite, sinks);
+
+	/* Source: one buffer per period, dropped if the decoder has not made room for it */
+	source = std::thread([&]() {
+		clock::time_point next = clock::now();
+
+		for (size_t offset = 0; offset < capture.length(); offset += blockSize) {
+			std::this_thread::sleep_until(next);
+			if (!input.push({offset, next})) dropped += std::min((size_t)blockSize, capture.length() - offset);
+			next += period;
+		}
+		sourceDone = true;
+	});
+
+	/* Decoder thread, with the same frame assembly as radiosonde::Decoder::run() */
+	for (;;) {
+		if (!input.pop(&buf)) {
+			if (sourceDone && !input.peek()) break;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			continue;
+		}
+
+		const size_t len = std::min((size_t)blockSize, capture.length() - buf.offset);
+		while (type->decode(decoder, &fragment, capture.samples.data() + buf.offset, len) != PROCEED) {
+			if (fragment.fields & DATA_SEQ) {
+				if (fragment.seq != lastSeq) result->framesDecoded++;
+				lastSeq = data.seq = fragment.seq;
+			}
+			if (fragment.fields & DATA_POS) {
+				data.lat = fragment.lat;
+				data.lon = fragment.lon;
+				data.alt = fragment.alt;
+			}
+			if (fragment.fields & DATA_TIME) data.time = fragment.time;
+			if (fragment.fields & DATA_SERIAL) data.serial = SerialTable::shared().intern(fragment.serial, data.serial);
+			if (!fragment.fields) continue;
+
+			if (faults.inlineSinks) {
+				faultyWrite(&data, sinks);
+			} else {
+				writer.push(data);
+			}
+		}
+
+		result->buffers++;
+		result->maxBufferSeconds = std::max(result->maxBufferSeconds,
+		                                    std::chrono::duration<double>(clock::now() - buf.arrival).count());
+	}
+
+	source.join();
+	writer.stop();
+	type->deinit(decoder);
+
+	result->samplesDropped = dropped;
+	result->writer = writer.stats();
+	for (const FaultySink &sink : sinks) {
+		result->sinkErrors += sink.errors;
+		result->sinkFull += sink.full;
+	}
+	result->passed = !result->samplesDropped
+	              && result->framesDecoded == result->framesExpected
+	              && result->maxBufferSeconds <= budget;
+	return true;
+}
+
+static void
+printFaultResult(FILE *fd, const SondeType *type, const FaultSpec &faults, const FaultResult &result, bool last)
+{
+	fprintf(fd, "\t{\n");
+	fprintf(fd, "\t\t\"file\": ");
+	printString(fd, result.fname);
+	fprintf(fd, ",\n\t\t\"type\": \"%s\",\n", type->name);
+	fprintf(fd, "\t\t\"faults\": ");
+	printString(fd, faults.text.c_str());
+	fprintf(fd, ",\n\t\t\"writer\": \"%s\",\n", faults.inlineSinks ? "inline" : "async");
+	fprintf(fd, "\t\t\"buffers\": %zu,\n", result.buffers);
+	fprintf(fd, "\t\t\"samples_dropped\": %zu,\n", result.samplesDropped);
+	fprintf(fd, "\t\t\"frames_expected\": %lu,\n", result.framesExpected);
+	fprintf(fd, "\t\t\"frames_decoded\": %lu,\n", result.framesDecoded);
+	fprintf(fd, "\t\t\"max_buffer_latency_ms\": %.3f,\n", 1e3 * result.maxBufferSeconds);
+	fprintf(fd, "\t\t\"frames_written\": %llu,\n", (unsigned long long)result.writer.written);
+	fprintf(fd, "\t\t\"frames_dropped_by_writer\": %llu,\n", (unsigned long long)result.writer.dropped);
+	fprintf(fd, "\t\t\"max_writer_backlog\": %zu,\n", result.writer.maxBacklog);
+	fprintf(fd, "\t\t\"max_write_ms\": %.3f,\n", 1e3 * result.writer.maxWriteSeconds);
+	fprintf(fd, "\t\t\"sink_errors\": %lu,\n", result.sinkErrors);
+	fprintf(fd, "\t\t\"sink_full\": %lu,\n", result.sinkFull);
+	fprintf(fd, "\t\t\"passed\": %s\n", result.passed ? "true" : "false");
+	fprintf(fd, "\t}%s\n", last ? "" : ",");
+}
+
+/* AsyncWriter handler: every stand-in gets the frame, in turn */
+static void
+faultyWrite(const SondeFullData *data, void *ctx)
+{
+	FaultySink *sinks = (FaultySink*)ctx;
+	char line[512];
+	int len;
+
+	for (int i=0; i<FAULT_SINKS; i++) {
+		FaultySink *sink = &sinks[i];
+		const FaultSpec *spec = sink->spec;
+		double delayMs = spec->latencyMs;
+
+		len = snprintf(line, sizeof(line), "%ld,%.1f,%.1f,%.1f,%.1f,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%s\n",
+		               (long)data->time,
+		               data->temp, data->rh, data->dewpt, data->pressure,
+		               data->lat, data->lon, data->alt,
+		               data->spd, data->hdg, data->climb,
+		               data->auxData.c_str());
+
+		sink->writes++;
+		if (spec->spikeEvery && sink->writes % spec->spikeEvery == 0) delayMs += spec->spikeMs;
+		if (delayMs > 0) std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delayMs));
+
+		if (spec->fullBytes && sink->bytes + len > spec->fullBytes) {
+			sink->full++;
+		} else if (std::uniform_real_distribution<double>(0, 1)(sink->rng) < spec->errorRate) {
+			sink->errors++;
+		} else {
+			sink->bytes += len;
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "capture.hpp"
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t
+le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t
+le16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+bool
+Capture::load(const char *fname, int rawSamplerate, int rawChannels)
+{
+	std::vector<unsigned char> data;
+	FILE *fd;
+	long len;
+
+	if (!(fd = fopen(fname, "rb"))) return false;
+	fseek(fd, 0, SEEK_END);
+	len = ftell(fd);
+	fseek(fd, 0, SEEK_SET);
+
+	data.resize(len);
+	if (len <= 0 || fread(data.data(), len, 1, fd) != 1) {
+		fclose(fd);
+		return false;
+	}
+	fclose(fd);
+
+	if (len >= 12 && !memcmp(data.data(), "RIFF", 4) && !memcmp(data.data() + 8, "WAVE", 4)) {
+		return loadWav(data.data(), len);
+	}
+
+	/* Raw 32-bit float */
+	samplerate = rawSamplerate;
+	channels = rawChannels;
+	samples.resize(len / sizeof(float));
+	memcpy(samples.data(), data.data(), samples.size() * sizeof(float));
+	return samplerate > 0 && channels > 0;
+}
+
+bool
+Capture::loadWav(const unsigned char *data, size_t len)
+{
+	const unsigned char *fmt = NULL, *payload = NULL;
+	size_t offset, payloadLen = 0;
+	int format, bits;
+
+	/* Walk the chunk list looking for the format and data chunks */
+	for (offset = 12; offset + 8 <= len; ) {
+		const uint32_t chunkLen = le32(data + offset + 4);
+		const unsigned char *chunk = data + offset + 8;
+
+		if (chunkLen > len - offset - 8) break;
+
+		if (!memcmp(data + offset, "fmt ", 4) && chunkLen >= 16) {
+			fmt = chunk;
+		} else if (!memcmp(data + offset, "data", 4)) {
+			payload = chunk;
+			payloadLen = chunkLen;
+		}
+		offset += 8 + chunkLen + (chunkLen & 1);
+	}
+
+	/* Tolerate truncated recordings, whose data chunk length is bogus */
+	if (!payload && offset + 8 <= len && !memcmp(data + offset, "data", 4)) {
+		payload = data + offset + 8;
+		payloadLen = len - offset - 8;
+	}
+	if (!fmt || !payload) return false;
+
+	format = le16(fmt);
+	channels = le16(fmt + 2);
+	samplerate = le32(fmt + 4);
+	bits = le16(fmt + 14);
+	if (format == WAV_FORMAT_EXTENSIBLE && le16(fmt + 16) >= 22) {
+		format = le16(fmt + 24);
+	}
+
+	if (format == WAV_FORMAT_PCM && bits == 16) {
+		samples.resize(payloadLen / 2);
+		for (size_t i=0; i<samples.size(); i++) {
+			samples[i] = (int16_t)le16(payload + 2*i) / 32768.0f;
+		}
+	} else if (format == WAV_FORMAT_FLOAT && bits == 32) {
+		samples.resize(payloadLen / 4);
+		memcpy(samples.data(), payload, samples.size() * sizeof(float));
+	} else {
+		return false;
+	}
+
+	return channels > 0 && samplerate > 0;
+}
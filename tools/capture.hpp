@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Recorded signal, loaded in memory. Supported formats are WAV files (16-bit PCM
+ * or 32-bit float) and raw 32-bit float files. Mono files are treated as FM
+ * demodulated audio, stereo files as I/Q baseband.
+ */
+class Capture {
+public:
+	Capture() { samplerate = 0; channels = 0; };
+
+	/**
+	 * Load a capture from file.
+	 *
+	 * @param fname path to the file
+	 * @param rawSamplerate sample rate to assume for raw files
+	 * @param rawChannels number of channels to assume for raw files
+	 * @return true on success, false otherwise
+	 */
+	bool load(const char *fname, int rawSamplerate, int rawChannels);
+
+	/**
+	 * @return number of samples per channel
+	 */
+	size_t length() const { return channels ? samples.size() / channels : 0; };
+
+	bool isBaseband() const { return channels == 2; };
+
+	std::vector<float> samples;     /* Interleaved if more than one channel */
+	int samplerate;
+	int channels;
+
+private:
+	bool loadWav(const unsigned char *data, size_t len);
+};
@@ -0,0 +1,88 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.hpp"
+
+#define DEFAULT_PORT 5005
+#define POLL_INTERVAL_MS 500
+
+static volatile sig_atomic_t running = 1;
+
+static void usage(const char *progname);
+static void stop(int sig);
+
+int
+main(int argc, char *argv[])
+{
+	DeltaReceiver receiver;
+	SondeFullData data;
+	UdpAddress from;
+	int port = DEFAULT_PORT;
+	FILE *out = stdout;
+	int i;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (i+1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		} else if (!strcmp(argv[i], "-p")) {
+			port = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-o")) {
+			if (!(out = fopen(argv[++i], "ab"))) {
+				fprintf(stderr, "Could not open %s\n", argv[i]);
+				return 1;
+			}
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (i < argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!receiver.init(port)) {
+		fprintf(stderr, "Could not listen on port %d\n", port);
+		return 1;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	/* Same columns as the PTU log, prefixed with the station and the serial number */
+	fseek(out, 0, SEEK_END);
+	if (out == stdout || ftell(out) <= 0) fprintf(out, "Station,Serial,Frame,Epoch,Temperature,Relative humidity,Dew point,Pressure,Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA\n");
+	fflush(out);
+
+	while (running) {
+		if (!receiver.receive(&data, &from, POLL_INTERVAL_MS)) continue;
+
+		fprintf(out, "%s,%s,%d,%ld,%.2f,%.1f,%.2f,%.2f,%.6f,%.6f,%.1f,%.2f,%.1f,%.2f,%s\n",
+		        from.toString().c_str(), serial_name(data.serial).c_str(), data.seq, (long)data.time,
+		        data.temp, data.rh, data.dewpt, data.pressure,
+		        data.lat, data.lon, data.alt,
+		        data.spd, data.hdg, data.climb,
+		        data.auxData.c_str());
+		fflush(out);
+	}
+
+	if (out != stdout) fclose(out);
+	return 0;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options]\n", progname);
+	fprintf(stderr, "\t-p <port>    UDP port to listen on (default: %d)\n", DEFAULT_PORT);
+	fprintf(stderr, "\t-o <file>    Append the CSV output to file (default: stdout)\n");
+}
+
+static void
+stop(int sig)
+{
+	(void)sig;
+	running = 0;
+}
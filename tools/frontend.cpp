@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <math.h>
+#include "frontend.hpp"
+
+#define RESAMPLE_PHASES 256         /* Fractional delays tabulated */
+#define RESAMPLE_ZEROS 8            /* Zero crossings of the sinc on each side */
+
+void
+resample(const float *src, size_t len, size_t stride, double inRate, double outRate, double cutoff, std::vector<float> *dst)
+{
+	const double ratio = inRate / outRate;
+	const double fc = std::min(cutoff, std::min(inRate, outRate) / 2) / inRate;   /* Cycles per input sample */
+	const int half = (int)ceil(RESAMPLE_ZEROS / (2 * fc));
+	const int taps = 2 * half;
+	std::vector<float> table((size_t)(RESAMPLE_PHASES + 1) * taps);
+	size_t outLen;
+
+	/* Row p holds the filter for a fractional delay of p/RESAMPLE_PHASES, normalized for unity gain */
+	for (int p=0; p<=RESAMPLE_PHASES; p++) {
+		float *row = table.data() + (size_t)p * taps;
+		double sum = 0;
+
+		for (int k=0; k<taps; k++) {
+			const double x = k - half + 1 - (double)p / RESAMPLE_PHASES;
+			const double w = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2 * M_PI * x / half);   /* Blackman */
+			const double sinc = x == 0 ? 1 : sin(2 * M_PI * fc * x) / (2 * M_PI * fc * x);
+			row[k] = fabs(x) < half ? sinc * w : 0;
+			sum += row[k];
+		}
+		for (int k=0; k<taps; k++) row[k] /= sum;
+	}
+
+	outLen = (size_t)(len / ratio);
+	dst->resize(outLen);
+
+	for (size_t n=0; n<outLen; n++) {
+		const double t = n * ratio;
+		const long center = (long)t;
+		const float *row = table.data() + (size_t)lround((t - center) * RESAMPLE_PHASES) * taps;
+		const long first = center - half + 1;
+		const int kmin = (int)std::max(0L, -first);
+		const int kmax = (int)std::min((long)taps, (long)len - first);
+		float acc = 0;
+
+		for (int k=kmin; k<kmax; k++) acc += row[k] * src[(first + k) * stride];
+		(*dst)[n] = acc;
+	}
+}
+
+void
+fm_demod(const std::vector<float> &i, const std::vector<float> &q, double samplerate, double deviation, std::vector<float> *dst)
+{
+	const float gain = samplerate / (2 * M_PI * deviation);
+	float prevI = 0, prevQ = 0;
+
+	dst->resize(std::min(i.size(), q.size()));
+	for (size_t n=0; n<dst->size(); n++) {
+		/* Phase difference between consecutive samples: arg(x[n] * conj(x[n-1])) */
+		const float re = i[n] * prevI + q[n] * prevQ;
+		const float im = q[n] * prevI - i[n] * prevQ;
+
+		(*dst)[n] = gain * atan2f(im, re);
+		prevI = i[n];
+		prevQ = q[n];
+	}
+}
+
+void
+frontend(const Capture &capture, double bandwidth, int outRate, std::vector<float> *dst)
+{
+	std::vector<float> i, q, audio;
+
+	if (!capture.isBaseband()) {
+		if (capture.samplerate == outRate) {
+			*dst = capture.samples;
+		} else {
+			resample(capture.samples.data(), capture.length(), 1, capture.samplerate, outRate, outRate / 2.0, dst);
+		}
+		return;
+	}
+
+	/* Same chain as the module: VFO at the bandwidth, demodulator with a deviation of half of it */
+	resample(capture.samples.data(), capture.length(), 2, capture.samplerate, bandwidth, bandwidth / 2, &i);
+	resample(capture.samples.data() + 1, capture.length(), 2, capture.samplerate, bandwidth, bandwidth / 2, &q);
+	fm_demod(i, q, bandwidth, bandwidth / 2, &audio);
+	resample(audio.data(), audio.size(), 1, bandwidth, outRate, outRate / 2.0, dst);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "capture.hpp"
+
+/**
+ * Resample a signal with a windowed-sinc interpolator, at any ratio.
+ *
+ * @param src input samples
+ * @param len number of input samples
+ * @param stride distance between consecutive input samples, e.g. 2 for one channel of an I/Q pair
+ * @param inRate input sample rate
+ * @param outRate output sample rate
+ * @param cutoff lowpass cutoff frequency, clamped to the Nyquist frequency of both rates
+ * @param dst destination for the output samples
+ */
+void resample(const float *src, size_t len, size_t stride, double inRate, double outRate, double cutoff, std::vector<float> *dst);
+
+/**
+ * Quadrature FM demodulator, scaled like the one in the live DSP chain: a
+ * frequency offset equal to the deviation maps to 1.0.
+ *
+ * @param i in-phase samples
+ * @param q quadrature samples
+ * @param samplerate sample rate
+ * @param deviation frequency deviation, Hz
+ * @param dst destination for the demodulated samples
+ */
+void fm_demod(const std::vector<float> &i, const std::vector<float> &q, double samplerate, double deviation, std::vector<float> *dst);
+
+/**
+ * Offline equivalent of the module's front end (VFO, FM demodulator and
+ * resampler). I/Q captures are filtered and decimated to the given bandwidth,
+ * then demodulated; FM demodulated captures are only resampled.
+ *
+ * @param capture recorded signal
+ * @param bandwidth VFO bandwidth, Hz; ignored for demodulated captures
+ * @param outRate sample rate of the output, as fed to the decoder
+ * @param dst destination for the demodulated audio
+ */
+void frontend(const Capture &capture, double bandwidth, int outRate, std::vector<float> *dst);
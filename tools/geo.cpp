@@ -0,0 +1,132 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "geoindex.hpp"
+#include "scan.hpp"
+
+static void usage(const char *progname);
+static bool parseList(const char *arg, double *values, int count);
+static bool parseTime(const char *p, const char *end, int64_t *time);
+
+int
+main(int argc, char *argv[])
+{
+	typedef std::chrono::steady_clock clock;
+	GeoIndex index;
+	GeoIndex::Query query;
+	std::vector<GeoIndex::Match> matches;
+	const char *dir = NULL;
+	clock::time_point start;
+	double values[4], elapsed;
+	bool list = true;
+	int i;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-l")) {
+			query.landings = true;
+		} else if (!strcmp(argv[i], "-s")) {
+			list = false;
+		} else if (i+1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		} else if (!strcmp(argv[i], "-d")) {
+			dir = argv[++i];
+		} else if (!strcmp(argv[i], "-c")) {
+			if (!parseList(argv[++i], values, 3) || values[2] <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			query.lat = values[0];
+			query.lon = values[1];
+			query.radius = values[2];
+		} else if (!strcmp(argv[i], "-b")) {
+			if (!parseList(argv[++i], values, 4)) {
+				usage(argv[0]);
+				return 1;
+			}
+			query.minLat = values[0];
+			query.minLon = values[1];
+			query.maxLat = values[2];
+			query.maxLon = values[3];
+		} else if (!strcmp(argv[i], "-t")) {
+			const char *comma = strchr(argv[++i], ',');
+			if (!comma || (comma > argv[i] && !parseTime(argv[i], comma, &query.from))
+			    || (comma[1] && !parseTime(comma + 1, comma + strlen(comma), &query.to))) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!dir || i < argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!index.open(dir)) {
+		fprintf(stderr, "Could not open the archive index in %s\n", dir);
+		return 1;
+	}
+
+	start = clock::now();
+	if (!index.query(query, &matches)) {
+		fprintf(stderr, "Query failed\n");
+		return 1;
+	}
+	elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	if (list) {
+		printf("Serial,Launch,Landing,Time,Latitude,Longitude,Altitude,Distance\n");
+		for (const GeoIndex::Match &match : matches) {
+			printf("%s,%lld,%lld,%lld,%.6f,%.6f,%.1f,%.3f\n", match.serial, (long long)match.start, (long long)match.end,
+			       (long long)match.point.time, match.point.lat, match.point.lon, match.point.alt, match.distance);
+		}
+	}
+
+	const GeoIndex::Stats stats = index.stats();
+	fprintf(stderr, "%zu of %u flights match (%.3f ms, %llu points indexed)\n",
+	        matches.size(), stats.flights, elapsed, (unsigned long long)stats.points);
+	return 0;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s -d <dir> [options]\n", progname);
+	fprintf(stderr, "Finds the flights in an archive that came near a place, within a time window\n");
+	fprintf(stderr, "\t-d <dir>                          Archive directory, as set in the module or given to radiosonde_import -g\n");
+	fprintf(stderr, "\t-c <lat>,<lon>,<km>               Search circle\n");
+	fprintf(stderr, "\t-b <minlat>,<minlon>,<maxlat>,<maxlon>  Search box\n");
+	fprintf(stderr, "\t-t [from],[to]                    Time window, as Unix times or YYYY-MM-DDTHH:MM:SSZ\n");
+	fprintf(stderr, "\t-l                                Only match landing positions\n");
+	fprintf(stderr, "\t-s                                Only print the summary\n");
+}
+
+/* Comma separated list of exactly count numbers */
+static bool
+parseList(const char *arg, double *values, int count)
+{
+	const char *end = arg + strlen(arg), *comma;
+
+	for (int i=0; i<count; i++) {
+		if (!(comma = (const char*)memchr(arg, ',', end - arg))) comma = end;
+		if ((comma == end) != (i == count - 1) || !parse_decimal(arg, comma, &values[i])) return false;
+		arg = comma + 1;
+	}
+	return true;
+}
+
+static bool
+parseTime(const char *p, const char *end, int64_t *time)
+{
+	double value;
+
+	if (parse_iso8601(p, end, time)) return true;
+	if (!parse_decimal(p, end, &value)) return false;
+	*time = (int64_t)value;
+	return true;
+}
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "geoindex.hpp"
+#include "mmap.hpp"
+#include "scan.hpp"
+#include "threadpool.hpp"
+
+#define PTU_COLUMNS 12
+#define FLUSH_THRESHOLD (1 << 20)   /* Bytes rendered by a job before handing them to the output */
+#define SNIFF_LEN 512               /* Bytes looked at to tell a GPX track from a PTU log */
+
+using namespace radiosonde;
+namespace fs = std::filesystem;
+
+enum Format {
+	FMT_LINE_PROTOCOL,
+	FMT_CSV,
+	FMT_NONE,
+};
+
+/* One point of a track. Values absent from the file are NaN */
+struct Row {
+	int64_t epoch;
+	double temp, rh, dewpt, pressure;
+	double lat, lon, alt, spd, hdg, climb;
+	const char *xdata;
+	size_t xdataLen;
+};
+
+struct FileJob {
+	fs::path path;
+	uintmax_t size;
+	size_t rows, bad;
+	bool truncated, failed;
+};
+
+/* Destination shared by all the jobs */
+struct Output {
+	FILE *fd;
+	Format format;
+	std::mutex mtx;
+	GeoIndex *index;                /* Flight archive to add the tracks to, or NULL */
+};
+
+static void usage(const char *progname);
+static void import(FileJob *job, Output *output);
+static void parsePtu(const char *data, size_t len, FileJob *job, Output *output, std::string *buf);
+static void parseGpx(const char *data, size_t len, FileJob *job, Output *output, std::string *buf);
+static void emit(Output *output, std::string *buf, const FileJob &job, const std::string &serial, const Row &row);
+static void flush(Output *output, std::string *buf);
+static void addPoint(const Output *output, std::vector<GeoIndex::Point> *track, const Row &row);
+static void indexTrack(Output *output, const FileJob &job, const std::string &serial, std::vector<GeoIndex::Point> *track);
+
+int
+main(int argc, char *argv[])
+{
+	typedef std::chrono::steady_clock clock;
+	Output output;
+	GeoIndex index;
+	std::vector<FileJob> jobs;
+	const char *outFname = NULL, *indexDir = NULL;
+	size_t rows = 0, bad = 0, bytes = 0, truncated = 0, failed = 0;
+	clock::time_point start;
+	double elapsed;
+	int i;
+
+	output.fd = stdout;
+	output.format = FMT_LINE_PROTOCOL;
+	output.index = NULL;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-n")) {
+			output.format = FMT_NONE;
+		} else if (i+1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		} else if (!strcmp(argv[i], "-f")) {
+			i++;
+			if (!strcmp(argv[i], "lp")) {
+				output.format = FMT_LINE_PROTOCOL;
+			} else if (!strcmp(argv[i], "csv")) {
+				output.format = FMT_CSV;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-o")) {
+			outFname = argv[++i];
+		} else if (!strcmp(argv[i], "-g")) {
+			indexDir = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (i >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* Explicit files are imported whatever their name, directories only contribute .csv and .gpx files */
+	for (; i<argc; i++) {
+		std::error_code err;
+
+		if (fs::is_directory(argv[i], err)) {
+			for (auto it = fs::recursive_directory_iterator(argv[i], fs::directory_options::skip_permission_denied, err);
+			     it != fs::recursive_directory_iterator(); it.increment(err)) {
+				const std::string ext = it->path().extension().string();
+				if (!it->is_regular_file(err)) continue;
+				if (ext != ".csv" && ext != ".gpx" && ext != ".CSV" && ext != ".GPX") continue;
+				jobs.push_back({it->path(), it->file_size(err), 0, 0, false, false});
+			}
+		} else if (fs::is_regular_file(argv[i], err)) {
+			jobs.push_back({argv[i], fs::file_size(argv[i], err), 0, 0, false, false});
+		} else {
+			fprintf(stderr, "Could not open %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (output.format != FMT_NONE && outFname && !(output.fd = fopen(outFname, "wb"))) {
+		fprintf(stderr, "Could not open %s for writing\n", outFname);
+		return 1;
+	}
+	if (indexDir) {
+		if (!index.open(indexDir)) {
+			fprintf(stderr, "Could not open the archive index in %s\n", indexDir);
+			return 1;
+		}
+		output.index = &index;
+	}
+	if (output.format == FMT_CSV) {
+		fprintf(output.fd, "File,Serial,Epoch,Temperature,Relative humidity,Dew point,Pressure,"
+		                   "Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA\n");
+	}
+
+	/* Largest files first, so that a big archive does not end up last on a single thread */
+	std::sort(jobs.begin(), jobs.end(), [](const FileJob &a, const FileJob &b) { return a.size > b.size; });
+
+	start = clock::now();
+	ThreadPool::shared().parallelFor(jobs.size(), 1, [&](int begin, int end) {
+		for (int job=begin; job<end; job++) import(&jobs[job], &output);
+	});
+	elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+	for (const FileJob &job : jobs) {
+		if (job.failed) {
+			fprintf(stderr, "Skipped %s: not a PTU log or GPX track\n", job.path.string().c_str());
+			failed++;
+			continue;
+		}
+		if (job.truncated) {
+			fprintf(stderr, "%s: truncated, imported the %zu complete points\n", job.path.string().c_str(), job.rows);
+			truncated++;
+		}
+		rows += job.rows;
+		bad += job.bad;
+		bytes += job.size;
+	}
+
+	if (output.fd != stdout) fclose(output.fd);
+	else fflush(stdout);
+
+	fprintf(stderr, "%zu files, %zu rows (%zu malformed), %zu truncated, %zu skipped\n",
+	        jobs.size() - failed, rows, bad, truncated, failed);
+	fprintf(stderr, "%.1f MB in %.3f s (%.1f MB/s) on %d threads\n",
+	        bytes / 1e6, elapsed, elapsed > 0 ? bytes / 1e6 / elapsed : 0, ThreadPool::shared().size() + 1);
+	if (output.index) {
+		const GeoIndex::Stats stats = index.stats();
+		fprintf(stderr, "Archive: %u flights, %llu points\n", stats.flights, (unsigned long long)stats.points);
+	}
+	return 0;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options] <file|directory>...\n", progname);
+	fprintf(stderr, "Imports PTU logs and GPX tracks written by the module, including ones cut short by a crash\n");
+	fprintf(stderr, "\t-f <format>  Output format: lp (InfluxDB line protocol, default) or csv\n");
+	fprintf(stderr, "\t-o <file>    Output file (default: stdout)\n");
+	fprintf(stderr, "\t-g <dir>     Also add the tracks to the flight archive in dir (see radiosonde_geo)\n");
+	fprintf(stderr, "\t-n           Parse only, do not write anything\n");
+}
+
+/* Parse a whole file, from its mapping */
+static void
+import(FileJob *job, Output *output)
+{
+	MappedFile file;
+	std::string buf;
+	const char *data;
+	size_t len;
+
+	if (!file.open(job->path.string().c_str())) {
+		/* Empty files cannot be mapped, but are legitimate logs of a flight that never started */
+		job->failed = job->size > 0;
+		return;
+	}
+	file.prefetch();
+
+	data = (const char*)file.data();
+	len = file.size();
+	if (output->format != FMT_NONE) buf.reserve(FLUSH_THRESHOLD + 4096);
+
+	if (len >= 6 && !memcmp(data, "Epoch,", 6)) {
+		parsePtu(data, len, job, output, &buf);
+	} else {
+		const char *sniffEnd = data + std::min(len, (size_t)SNIFF_LEN);
+		if (std::search(data, sniffEnd, "<gpx", "<gpx" + 4) != sniffEnd) {
+			parseGpx(data, len, job, output, &buf);
+		} else {
+			job->failed = true;
+		}
+	}
+
+	flush(output, &buf);
+}
+
+/* PTU log: one header line, then comma separated rows whose last column is free-form */
+static void
+parsePtu(const char *data, size_t len, FileJob *job, Output *output, std::string *buf)
+{
+	const std::string serial;
+	std::vector<GeoIndex::Point> track;
+	const char *start[PTU_COLUMNS], *end[PTU_COLUMNS];
+	double values[PTU_COLUMNS - 2];
+	const char *header;
+	size_t lineStart, pos;
+	int field = 0;
+	bool ok;
+	Row row;
+
+	if (!(header = (const char*)memchr(data, '\n', len))) return;
+	lineStart = header - data + 1;
+
+	DelimiterScanner scanner(data, len, ',', '\n');
+	scanner.seek(lineStart);
+	start[0] = data + lineStart;
+
+	for (;;) {
+		if ((pos = scanner.next()) >= len) {
+			/* A row without its newline was being written when the file was closed */
+			if (lineStart < len) job->truncated = true;
+			break;
+		}
+
+		/* Commas past the last column belong to XDATA */
+		if (data[pos] == ',') {
+			if (field < PTU_COLUMNS - 1) {
+				end[field++] = data + pos;
+				start[field] = data + pos + 1;
+			}
+			continue;
+		}
+
+		end[field] = data + pos;
+		if (end[field] > start[field] && end[field][-1] == '\r') end[field]--;
+
+		if (field == PTU_COLUMNS - 1) {
+			double epoch;
+
+			ok = parse_decimal(start[0], end[0], &epoch);
+			for (int i=0; ok && i<PTU_COLUMNS-2; i++) ok = parse_decimal(start[i+1], end[i+1], &values[i]);
+
+			if (ok) {
+				row.epoch = (int64_t)epoch;
+				row.temp = values[0];
+				row.rh = values[1];
+				row.dewpt = values[2];
+				row.pressure = values[3];
+				row.lat = values[4];
+				row.lon = values[5];
+				row.alt = values[6];
+				row.spd = values[7];
+				row.hdg = values[8];
+				row.climb = values[9];
+				row.xdata = start[PTU_COLUMNS - 1];
+				row.xdataLen = end[PTU_COLUMNS - 1] - start[PTU_COLUMNS - 1];
+				job->rows++;
+				if (output->format != FMT_NONE) emit(output, buf, *job, serial, row);
+				addPoint(output, &track, row);
+			} else {
+				job->bad++;
+			}
+		} else if (pos > lineStart) {
+			job->bad++;
+		}
+
+		lineStart = pos + 1;
+		start[0] = data + lineStart;
+		field = 0;
+	}
+
+	/* PTU logs do not record the serial number */
+	indexTrack(output, *job, serial, &track);
+}
+
+/* First occurrence of needle in [p, end), or NULL */
+static const char*
+find(const char *p, const char *end, const char *needle)
+{
+	const size_t len = strlen(needle);
+
+	/* memchr is vectorized by the C library: skip straight to candidates */
+	while (end - p >= (long)len && (p = (const char*)memchr(p, needle[0], end - p - len + 1))) {
+		if (!memcmp(p, needle, len)) return p;
+		p++;
+	}
+	return NULL;
+}
+
+/* Text between <tag> and the next '<', within [p, end) */
+static bool
+element(const char *p, const char *end, const char *tag, const char **valStart, const char **valEnd)
+{
+	if (!(p = find(p, end, tag))) return false;
+	*valStart = p + strlen(tag);
+	*valEnd = (const char*)memchr(*valStart, '<', end - *valStart);
+	return *valEnd != NULL;
+}
+
+/* Quoted value of an attribute, including the leading space and opening quote, within [p, end) */
+static bool
+attribute(const char *p, const char *end, const char *prefix, const char **valStart, const char **valEnd)
+{
+	if (!(p = find(p, end, prefix))) return false;
+	*valStart = p + strlen(prefix);
+	*valEnd = (const char*)memchr(*valStart, '"', end - *valStart);
+	return *valEnd != NULL;
+}
+
+/* GPX track, as written by GPXWriter */
+static void
+parseGpx(const char *data, size_t len, FileJob *job, Output *output, std::string *buf)
+{
+	const char *end = data + len;
+	const char *p = data, *point, *close, *next, *tagEnd, *track, *vs, *ve;
+	std::vector<GeoIndex::Point> points;
+	std::string serial;
+	Row row;
+
+	row.temp = row.rh = row.dewpt = row.pressure = row.climb = NAN;
+	row.xdata = NULL;
+	row.xdataLen = 0;
+
+	while ((point = find(p, end, "<trkpt "))) {
+		/* Each sonde gets its own track, named after its serial number */
+		if ((track = find(p, point, "<trk>"))) {
+			indexTrack(output, *job, serial, &points);
+			serial.clear();
+			if (element(track, point, "<name>", &vs, &ve)) serial.assign(vs, ve);
+		}
+
+		/*
+		 * A crash while a point is written leaves it incomplete, possibly followed
+		 * by what remains of the previous trailer: only closed points count
+		 */
+		close = find(point, end, "</trkpt>");
+		next = find(point + 1, close ? close : end, "<trkpt ");
+		if (!close || next) {
+			job->truncated = true;
+			if (!close) break;
+			p = next;
+			continue;
+		}
+		p = close + strlen("</trkpt>");
+
+		tagEnd = (const char*)memchr(point, '>', close - point);
+		row.lat = row.lon = row.alt = row.spd = row.hdg = NAN;
+		if (!tagEnd
+		    || !attribute(point, tagEnd, " lat=\"", &vs, &ve) || !parse_decimal(vs, ve, &row.lat)
+		    || !attribute(point, tagEnd, " lon=\"", &vs, &ve) || !parse_decimal(vs, ve, &row.lon)
+		    || !element(tagEnd, close, "<time>", &vs, &ve) || !parse_iso8601(vs, ve, &row.epoch)) {
+			job->bad++;
+			continue;
+		}
+
+		/* Optional elements */
+		if (element(tagEnd, close, "<ele>", &vs, &ve)) parse_decimal(vs, ve, &row.alt);
+		if (element(tagEnd, close, "<speed>", &vs, &ve)) parse_decimal(vs, ve, &row.spd);
+		if (element(tagEnd, close, "<course>", &vs, &ve)) parse_decimal(vs, ve, &row.hdg);
+
+		job->rows++;
+		if (output->format != FMT_NONE) emit(output, buf, *job, serial, row);
+		addPoint(output, &points, row);
+	}
+	indexTrack(output, *job, serial, &points);
+
+	/* The trailer is rewritten after every point: without it, the last write did not complete */
+	if (!point && !find(p, end, "</gpx>")) job->truncated = true;
+}
+
+/* Append a fixed-point number */
+static void
+appendFixed(std::string *buf, double value, int decimals)
+{
+	char tmp[64];
+	const std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), value, std::chars_format::fixed, decimals);
+
+	if (res.ec == std::errc()) buf->append(tmp, res.ptr);
+}
+
+/* Append a line protocol tag value, escaping the characters that delimit it */
+static void
+appendTag(std::string *buf, const char *key, const std::string &value)
+{
+	*buf += ',';
+	*buf += key;
+	*buf += '=';
+	for (char c : value) {
+		if (c == ',' || c == '=' || c == ' ') *buf += '\\';
+		*buf += c;
+	}
+}
+
+static void
+emit(Output *output, std::string *buf, const FileJob &job, const std::string &serial, const Row &row)
+{
+	const std::string fname = job.path.filename().string();
+	char tmp[24];
+	bool first = true;
+
+	if (output->format == FMT_LINE_PROTOCOL) {
+		/* Same measurement and field names as the module's InfluxDB output */
+		const struct { const char *key; double value; int decimals; } fields[] = {
+			{"lat", row.lat, 6}, {"lon", row.lon, 6}, {"alt", row.alt, 1}, {"spd", row.spd, 2},
+			{"hdg", row.hdg, 1}, {"climb", row.climb, 2}, {"temp", row.temp, 2}, {"rh", row.rh, 1},
+			{"dewpt", row.dewpt, 2}, {"pressure", row.pressure, 2},
+		};
+		const size_t mark = buf->size();
+
+		*buf += "radiosonde";
+		appendTag(buf, "file", fname);
+		if (!serial.empty()) appendTag(buf, "serial", serial);
+		for (const auto &field : fields) {
+			if (!isfinite(field.value)) continue;
+			*buf += first ? ' ' : ',';
+			*buf += field.key;
+			*buf += '=';
+			appendFixed(buf, field.value, field.decimals);
+			first = false;
+		}
+
+		/* Points without any value cannot be represented */
+		if (first) {
+			buf->resize(mark);
+			return;
+		}
+		*buf += ' ';
+		buf->append(tmp, std::to_chars(tmp, tmp + sizeof(tmp), row.epoch).ptr);
+		*buf += "000000000\n";
+	} else {
+		const double values[] = {
+			row.temp, row.rh, row.dewpt, row.pressure, row.lat, row.lon,
+			row.alt, row.spd, row.hdg, row.climb,
+		};
+
+		*buf += fname;
+		*buf += ',';
+		*buf += serial;
+		*buf += ',';
+		buf->append(tmp, std::to_chars(tmp, tmp + sizeof(tmp), row.epoch).ptr);
+		for (size_t i=0; i<sizeof(values)/sizeof(values[0]); i++) {
+			*buf += ',';
+			if (isfinite(values[i])) appendFixed(buf, values[i], i == 4 || i == 5 ? 6 : 1);
+		}
+		*buf += ',';
+		if (row.xdata) buf->append(row.xdata, row.xdataLen);
+		*buf += '\n';
+	}
+
+	if (buf->size() >= FLUSH_THRESHOLD) flush(output, buf);
+}
+
+/* Hand whole lines over to the output: jobs interleave by chunk, never within a line */
+static void
+flush(Output *output, std::string *buf)
+{
+	if (buf->empty()) return;
+
+	std::lock_guard<std::mutex> lck(output->mtx);
+	fwrite(buf->data(), 1, buf->size(), output->fd);
+	buf->clear();
+}
+
+/* Keep the position of a point, if the archive is being built */
+static void
+addPoint(const Output *output, std::vector<GeoIndex::Point> *track, const Row &row)
+{
+	if (!output->index || !isfinite(row.lat) || !isfinite(row.lon) || (row.lat == 0 && row.lon == 0)) return;
+	track->push_back({row.epoch, (float)row.lat, (float)row.lon, isfinite(row.alt) ? (float)row.alt : 0.0f});
+}
+
+/* Add a complete track to the archive, named after the file if the serial number is unknown */
+static void
+indexTrack(Output *output, const FileJob &job, const std::string &serial, std::vector<GeoIndex::Point> *track)
+{
+	if (!output->index || track->empty()) return;
+
+	output->index->addFlight(serial.empty() ? job.path.stem().string().c_str() : serial.c_str(), *track);
+	track->clear();
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Text scanning helpers for the importer: delimiter search and number parsing */
+
+static inline int
+scan_ctz(uint64_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, mask);
+	return idx;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+/**
+ * Find two delimiters in a 64-byte block.
+ *
+ * @return mask with bit i set if block[i] is either delimiter
+ */
+static inline uint64_t
+scan_block(const char *block, char a, char b)
+{
+#ifdef SCAN_SSE2
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	uint64_t mask = 0;
+
+	for (int i=0; i<4; i++) {
+		const __m128i chunk = _mm_loadu_si128((const __m128i*)(block + 16*i));
+		const __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb));
+		mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(hits) << (16*i);
+	}
+	return mask;
+#else
+	uint64_t mask = 0;
+
+	for (int i=0; i<64; i++) {
+		mask |= (uint64_t)(block[i] == a || block[i] == b) << i;
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Iterates over the positions of two delimiters in a buffer, classifying 64
+ * bytes at a time, so that the cost per byte does not depend on how far apart
+ * delimiters are.
+ */
+class DelimiterScanner {
+public:
+	DelimiterScanner(const char *data, size_t len, char a, char b) {
+		m_data = data;
+		m_len = len;
+		m_a = a;
+		m_b = b;
+		m_base = 0;
+		m_mask = len ? load(0) : 0;
+	}
+
+	/**
+	 * @return offset of the next delimiter, or the length of the buffer if there is none
+	 */
+	size_t next() {
+		size_t pos;
+
+		while (!m_mask) {
+			m_base += 64;
+			if (m_base >= m_len) return m_len;
+			m_mask = load(m_base);
+		}
+
+		pos = m_base + scan_ctz(m_mask);
+		m_mask &= m_mask - 1;
+		return pos;
+	}
+
+	/**
+	 * Skip delimiters before the given offset.
+	 */
+	void seek(size_t offset) {
+		if (offset >= m_base + 64) {
+			m_base = offset & ~(size_t)63;
+			m_mask = m_base < m_len ? load(m_base) : 0;
+		}
+		if (offset > m_base) m_mask &= ~(uint64_t)0 << (offset - m_base);
+	}
+
+private:
+	uint64_t load(size_t base) {
+		char tail[64];
+
+		if (base + 64 <= m_len) return scan_block(m_data + base, m_a, m_b);
+
+		/* The last block is partial: pad it with bytes that match neither delimiter */
+		memset(tail, m_a == ' ' || m_b == ' ' ? '\0' : ' ', sizeof(tail));
+		memcpy(tail, m_data + base, m_len - base);
+		return scan_block(tail, m_a, m_b) & (~(uint64_t)0 >> (64 - (m_len - base)));
+	}
+
+	const char *m_data;
+	size_t m_len, m_base;
+	uint64_t m_mask;
+	char m_a, m_b;
+};
+
+/**
+ * Parse a decimal number as written by printf("%f"), or nan/inf. Anything else
+ * (exponents, more than 18 digits) falls back to strtod().
+ *
+ * @param p start of the number
+ * @param end end of the field
+ * @param dst destination for the value
+ * @return true if the whole field was a number, false otherwise
+ */
+static inline bool
+parse_decimal(const char *p, const char *end, double *dst)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+		1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+	};
+	const char *start = p;
+	bool negative = false;
+	uint64_t mantissa = 0;
+	int digits = 0, decimals = 0;
+	char buf[64], *stop;
+
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	/* nan, -nan, inf, -inf */
+	if (end - p == 3 && (p[0] | 0x20) == 'n' && (p[1] | 0x20) == 'a' && (p[2] | 0x20) == 'n') {
+		*dst = NAN;
+		return true;
+	}
+	if (end - p == 3 && (p[0] | 0x20) == 'i' && (p[1] | 0x20) == 'n' && (p[2] | 0x20) == 'f') {
+		*dst = negative ? -INFINITY : INFINITY;
+		return true;
+	}
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) mantissa = mantissa * 10 + (*p - '0');
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, decimals++) mantissa = mantissa * 10 + (*p - '0');
+	}
+
+	if (p == end && digits > 0 && digits <= 18) {
+		*dst = (negative ? -(double)mantissa : (double)mantissa) / pow10[decimals];
+		return true;
+	}
+
+	/* Unusual syntax: let the C library deal with it */
+	if (end - start <= 0 || end - start >= (long)sizeof(buf)) return false;
+	memcpy(buf, start, end - start);
+	buf[end - start] = '\0';
+	*dst = strtod(buf, &stop);
+	return stop == buf + (end - start);
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static inline int64_t
+days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = (unsigned)(y - era * 400);
+	const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+/**
+ * Parse a UTC timestamp formatted as YYYY-MM-DDThh:mm:ssZ.
+ *
+ * @return true on success, false otherwise
+ */
+static inline bool
+parse_iso8601(const char *p, const char *end, int64_t *dst)
+{
+	int v[6];
+	static const int offsets[6] = {0, 5, 8, 11, 14, 17};
+	static const int widths[6] = {4, 2, 2, 2, 2, 2};
+
+	if (end - p != 20 || p[4] != '-' || p[7] != '-' || p[10] != 'T' || p[13] != ':' || p[16] != ':' || p[19] != 'Z') {
+		return false;
+	}
+
+	for (int i=0; i<6; i++) {
+		v[i] = 0;
+		for (int j=0; j<widths[i]; j++) {
+			const char c = p[offsets[i] + j];
+			if (c < '0' || c > '9') return false;
+			v[i] = v[i] * 10 + (c - '0');
+		}
+	}
+
+	*dst = days_from_civil(v[0], v[1], v[2]) * 86400 + v[3] * 3600 + v[4] * 60 + v[5];
+	return true;
+}
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "capture.hpp"
+#include "decode/sondetypes.hpp"
+#include "frontend.hpp"
+#include "threadpool.hpp"
+#include "utils.hpp"
+
+#define DEFAULT_SAMPLERATE 48000
+#define DEFAULT_BLOCK_MS 10
+
+using namespace radiosonde;
+
+/* One point of the parameter grid */
+struct Combination {
+	const SondeType *type;
+	double bandwidth;           /* VFO bandwidth, Hz, only relevant for I/Q captures */
+	int samplerate;             /* Decoder sample rate */
+	int blockMs;                /* Buffer duration */
+};
+
+/* Outcome of a combination, summed over the corpus */
+struct SweepResult {
+	size_t samples;             /* At the decoder sample rate */
+	size_t captureSamples;      /* At the capture sample rate */
+	unsigned long frames;
+	double decoderCpu, frontendCpu;
+	double latencySum, maxLatency;
+	size_t buffers;
+};
+
+static void usage(const char *progname);
+static bool parseList(const char *str, std::vector<double> *dst);
+static void run(const Combination &comb, const Capture &capture, SweepResult *result);
+static void merge(SweepResult *dst, const SweepResult &src);
+
+int
+main(int argc, char *argv[])
+{
+	std::vector<const SondeType*> types;
+	std::vector<double> bandwidths, samplerates, blocks;
+	std::vector<Combination> combs;
+	std::vector<Capture> captures;
+	std::vector<SweepResult> jobs, results;
+	std::vector<bool> best;
+	int rawSamplerate = DEFAULT_SAMPLERATE, rawChannels = 1;
+	const char *csvFname = NULL;
+	FILE *csv = NULL;
+	int i;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-i")) {
+			rawChannels = 2;
+		} else if (i+1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		} else if (!strcmp(argv[i], "-t")) {
+			std::string list = argv[++i];
+			for (size_t start = 0, end; start <= list.size(); start = end + 1) {
+				end = std::min(list.find(',', start), list.size());
+				const SondeType *type = findSondeType(list.substr(start, end - start).c_str());
+				if (!type) {
+					fprintf(stderr, "Unknown sonde type: %s\n", list.substr(start, end - start).c_str());
+					return 1;
+				}
+				types.push_back(type);
+			}
+		} else if (!strcmp(argv[i], "-w")) {
+			if (!parseList(argv[++i], &bandwidths)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-s")) {
+			if (!parseList(argv[++i], &samplerates)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-b")) {
+			if (!parseList(argv[++i], &blocks)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-r")) {
+			rawSamplerate = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-o")) {
+			csvFname = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (i >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* Defaults: every type, at the module's bandwidth and sample rate */
+	if (types.empty()) {
+		for (const SondeType &type : sondeTypes) types.push_back(&type);
+	}
+	if (samplerates.empty()) samplerates.push_back(DEFAULT_SAMPLERATE);
+	if (blocks.empty()) blocks.push_back(DEFAULT_BLOCK_MS);
+
+	for (const SondeType *type : types) {
+		const std::vector<double> typeBandwidths = bandwidths.empty() ? std::vector<double>{type->bandwidth} : bandwidths;
+		for (double bandwidth : typeBandwidths) {
+			for (double samplerate : samplerates) {
+				for (double block : blocks) {
+					combs.push_back({type, bandwidth, (int)samplerate, (int)block});
+				}
+			}
+		}
+	}
+
+	captures.resize(argc - i);
+	for (size_t j=0; j<captures.size(); j++) {
+		if (!captures[j].load(argv[i + j], rawSamplerate, rawChannels)) {
+			fprintf(stderr, "Could not load %s\n", argv[i + j]);
+			return 1;
+		}
+	}
+
+	if (csvFname && !(csv = fopen(csvFname, "w"))) {
+		fprintf(stderr, "Could not open %s for writing\n", csvFname);
+		return 1;
+	}
+
+	/* One job per combination and capture, spread over every core */
+	jobs.resize(combs.size() * captures.size());
+	fprintf(stderr, "Running %zu combinations over %zu captures on %d threads\n",
+	        combs.size(), captures.size(), ThreadPool::shared().size() + 1);
+	ThreadPool::shared().parallelFor(jobs.size(), 1, [&](int begin, int end) {
+		for (int job=begin; job<end; job++) {
+			run(combs[job / captures.size()], captures[job % captures.size()], &jobs[job]);
+		}
+	});
+
+	results.resize(combs.size());
+	for (size_t job=0; job<jobs.size(); job++) merge(&results[job / captures.size()], jobs[job]);
+
+	/* Best combination of each type: most frames, then least CPU */
+	best.resize(combs.size());
+	for (size_t j=0; j<combs.size(); j++) {
+		size_t winner = j;
+		for (size_t k=0; k<combs.size(); k++) {
+			if (combs[k].type != combs[j].type) continue;
+			if (results[k].frames > results[winner].frames
+			    || (results[k].frames == results[winner].frames && results[k].decoderCpu < results[winner].decoderCpu)) {
+				winner = k;
+			}
+		}
+		best[j] = winner == j;
+	}
+
+	printf("  %-14s %9s %7s %6s %7s %12s %13s %10s %10s\n",
+	       "Type", "Bandwidth", "Rate", "Block", "Frames", "Decoder ns/s", "Frontend ns/s", "Mean ms", "Max ms");
+	if (csv) {
+		fprintf(csv, "type,bandwidth,samplerate,block_ms,frames,decoder_ns_per_sample,frontend_ns_per_sample,"
+		             "mean_buffer_latency_ms,max_buffer_latency_ms\n");
+	}
+
+	for (size_t j=0; j<combs.size(); j++) {
+		const Combination &comb = combs[j];
+		const SweepResult &result = results[j];
+		const double decoderNs = result.samples ? 1e9 * result.decoderCpu / result.samples : 0;
+		const double frontendNs = result.captureSamples ? 1e9 * result.frontendCpu / result.captureSamples : 0;
+		const double meanMs = result.buffers ? 1e3 * result.latencySum / result.buffers : 0;
+
+		printf("%c %-14s %9.0f %7d %6d %7lu %12.2f %13.2f %10.3f %10.3f\n",
+		       best[j] ? '*' : ' ', comb.type->name, comb.bandwidth, comb.samplerate, comb.blockMs,
+		       result.frames, decoderNs, frontendNs, meanMs, 1e3 * result.maxLatency);
+		if (csv) {
+			fprintf(csv, "%s,%.0f,%d,%d,%lu,%.2f,%.2f,%.3f,%.3f\n",
+			        comb.type->key, comb.bandwidth, comb.samplerate, comb.blockMs,
+			        result.frames, decoderNs, frontendNs, meanMs, 1e3 * result.maxLatency);
+		}
+	}
+
+	if (csv) fclose(csv);
+	return 0;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options] <capture>...\n", progname);
+	fprintf(stderr, "\t-t <types>   Sonde types, comma separated (default: all):");
+	for (const SondeType &type : sondeTypes) fprintf(stderr, " %s", type.key);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "\t-w <list>    VFO bandwidths in Hz, I/Q captures only (default: same as the module)\n");
+	fprintf(stderr, "\t-s <list>    Decoder sample rates (default: %d)\n", DEFAULT_SAMPLERATE);
+	fprintf(stderr, "\t-b <list>    Buffer durations in ms (default: %d)\n", DEFAULT_BLOCK_MS);
+	fprintf(stderr, "\t-r <rate>    Sample rate of raw captures (default: %d)\n", DEFAULT_SAMPLERATE);
+	fprintf(stderr, "\t-i           Raw captures are I/Q baseband rather than FM demodulated audio\n");
+	fprintf(stderr, "\t-o <file>    Also write the results as CSV to file\n");
+}
+
+/* Parse a comma separated list of positive numbers */
+static bool
+parseList(const char *str, std::vector<double> *dst)
+{
+	char *end;
+	double value;
+
+	for (;;) {
+		value = strtod(str, &end);
+		if (end == str || value <= 0) return false;
+		dst->push_back(value);
+		if (*end != ',') return *end == '\0';
+		str = end + 1;
+	}
+}
+
+static void
+run(const Combination &comb, const Capture &capture, SweepResult *result)
+{
+	typedef std::chrono::steady_clock clock;
+	const size_t blockSize = std::max(1, comb.samplerate * comb.blockMs / 1000);
+	std::vector<float> audio;
+	SondeData fragment;
+	int lastSeq = -1;
+	double cpuStart;
+	void *decoder;
+
+	memset(result, 0, sizeof(*result));
+	result->captureSamples = capture.length();
+
+	cpuStart = threadCpuSeconds();
+	frontend(capture, comb.bandwidth, comb.samplerate, &audio);
+	result->frontendCpu = threadCpuSeconds() - cpuStart;
+
+	if (!(decoder = comb.type->init(comb.samplerate))) return;
+	result->samples = audio.size();
+
+	cpuStart = threadCpuSeconds();
+	for (size_t offset = 0; offset < audio.size(); offset += blockSize) {
+		const size_t len = std::min(blockSize, audio.size() - offset);
+		const clock::time_point bufStart = clock::now();
+		double latency;
+
+		/* Same calling convention as radiosonde::Decoder::run() */
+		while (comb.type->decode(decoder, &fragment, audio.data() + offset, len) != PROCEED) {
+			if ((fragment.fields & DATA_SEQ) && fragment.seq != lastSeq) {
+				lastSeq = fragment.seq;
+				result->frames++;
+			}
+		}
+
+		latency = std::chrono::duration<double>(clock::now() - bufStart).count();
+		result->latencySum += latency;
+		result->maxLatency = std::max(result->maxLatency, latency);
+		result->buffers++;
+	}
+	result->decoderCpu = threadCpuSeconds() - cpuStart;
+
+	comb.type->deinit(decoder);
+}
+
+static void
+merge(SweepResult *dst, const SweepResult &src)
+{
+	dst->samples += src.samples;
+	dst->captureSamples += src.captureSamples;
+	dst->frames += src.frames;
+	dst->decoderCpu += src.decoderCpu;
+	dst->frontendCpu += src.frontendCpu;
+	dst->latencySum += src.latencySum;
+	dst->maxLatency = std::max(dst->maxLatency, src.maxLatency);
+	dst->buffers += src.buffers;
+}